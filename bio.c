@@ -17,6 +17,13 @@
 // * B_VALID: the buffer data has been read from the disk.
 // * B_DIRTY: the buffer data has been modified
 //     and needs to be written to disk.
+//
+// Every cached block is charged to the cgroup of the process that
+// read it in (b->cgroup) and to the cgroup's ancestors. A cgroup holds
+// at most its cache_max blocks, so it recycles its own blocks once it
+// has that many, and keeps its cache_min blocks from being recycled by
+// other cgroups. When the shares leave no buffer to recycle, any
+// unused buffer is taken.
 
 #include "types.h"
 #include "defs.h"
@@ -28,6 +35,7 @@
 #include "device.h"
 #include "proc.h"
 #include "cgroup.h"
+#include "psi.h"
 
 struct {
   struct spinlock lock;
@@ -58,6 +66,52 @@ binit(void)
   }
 }
 
+// Whether cgroup is ancestor or the cgroup itself.
+static int
+cgroup_within(struct cgroup *cg, struct cgroup *ancestor)
+{
+  for(; cg; cg = cg->parent)
+    if(cg == ancestor)
+      return 1;
+  return 0;
+}
+
+// Charge b to cgroup and its ancestors, moving the charge from the
+// cgroup b was charged to. Caller must hold bcache.lock.
+static void
+bcharge(struct buf *b, struct cgroup *cgroup)
+{
+  struct cgroup *cg;
+
+  for(cg = b->cgroup; cg; cg = cg->parent)
+    cg->mem_stat_file--;
+  b->cgroup = cgroup;
+  for(cg = b->cgroup; cg; cg = cg->parent)
+    cg->mem_stat_file++;
+}
+
+// Whether recycling b for cgroup keeps every cgroup within its share
+// of the cache. Caller must hold bcache.lock.
+static int
+bshares(struct buf *b, struct cgroup *cgroup)
+{
+  struct cgroup *cg;
+
+  // A cgroup at its maximum recycles only its own blocks.
+  for(cg = cgroup; cg; cg = cg->parent)
+    if(cg->cache_max < NBUF && cg->mem_stat_file >= cg->cache_max &&
+       !cgroup_within(b->cgroup, cg))
+      return 0;
+
+  // A cgroup at its minimum keeps its blocks from others.
+  for(cg = b->cgroup; cg; cg = cg->parent)
+    if(cg->cache_min > 0 && cg->mem_stat_file <= cg->cache_min &&
+       !cgroup_within(cgroup, cg))
+      return 0;
+
+  return 1;
+}
+
 void
 invalidateblocks(uint dev)
 {
@@ -71,6 +125,56 @@ invalidateblocks(uint dev)
   release(&bcache.lock);
 }
 
+// Drop up to n clean, unused blocks cached for cgroup or its
+// descendants, oldest first, so they are recycled before others.
+// Returns the number of blocks dropped.
+int
+breclaim(struct cgroup *cgroup, int n)
+{
+  struct buf *b, *prev;
+  int dropped = 0;
+
+  acquire(&bcache.lock);
+  for(b = bcache.head.prev; b != &bcache.head && dropped < n; b = prev){
+    prev = b->prev;
+    if(b->refcnt != 0 || (b->flags & B_DIRTY) || !(b->flags & B_VALID))
+      continue;
+    if(!cgroup_within(b->cgroup, cgroup))
+      continue;
+    b->flags = 0;
+    bcharge(b, 0);
+    // Move to the LRU end.
+    b->next->prev = b->prev;
+    b->prev->next = b->next;
+    b->prev = bcache.head.prev;
+    b->next = &bcache.head;
+    bcache.head.prev->next = b;
+    bcache.head.prev = b;
+    dropped++;
+  }
+  release(&bcache.lock);
+  return dropped;
+}
+
+// Move the blocks of cgroup, which is deleted, to its parent.
+void
+breparent(struct cgroup *cgroup)
+{
+  struct buf *b;
+
+  acquire(&bcache.lock);
+  for(b = bcache.head.next; b != &bcache.head; b = b->next){
+    // The ancestors are already charged for the block.
+    if(b->cgroup == cgroup){
+      cgroup->mem_stat_file--;
+      b->cgroup = cgroup->parent;
+    }
+    if(b->dirty_cgroup == cgroup)
+      b->dirty_cgroup = cgroup->parent;
+  }
+  release(&bcache.lock);
+}
+
 // Look through buffer cache for block on device dev.
 // If not found, allocate a buffer.
 // In either case, return locked buffer.
@@ -79,6 +183,7 @@ bget(uint dev, uint blockno)
 {
   struct buf *b;
   struct cgroup *cg = proc_get_cgroup();
+  int shares;
 
   acquire(&bcache.lock);
 
@@ -86,6 +191,10 @@ bget(uint dev, uint blockno)
   for(b = bcache.head.next; b != &bcache.head; b = b->next){
     if(b->dev == dev && b->blockno == blockno){
       b->refcnt++;
+      // A block dropped by breclaim() keeps its identity but not its
+      // charge; it is read in again for cg.
+      if(b->cgroup == 0)
+        bcharge(b, cg);
       release(&bcache.lock);
       acquiresleep(&b->lock);
       cgroup_mem_stat_pgfault_incr(cg);
@@ -93,20 +202,25 @@ bget(uint dev, uint blockno)
     }
   }
 
-  // Not cached; recycle an unused buffer.
+  // Not cached; recycle an unused buffer, within the cache
+  // shares of the cgroups if possible.
   // Even if refcnt==0, B_DIRTY indicates a buffer is in use
   // because log.c has modified it but not yet committed it.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->flags = 0;
-      b->cgroup = 0;
-      b->refcnt = 1;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      cgroup_mem_stat_pgmajfault_incr(cg);
-      return b;
+  for(shares = 1; shares >= 0; shares--){
+    for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
+      if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0 &&
+         (!shares || bshares(b, cg))) {
+        b->dev = dev;
+        b->blockno = blockno;
+        b->flags = 0;
+        bcharge(b, cg);
+        b->dirty_cgroup = 0;
+        b->refcnt = 1;
+        release(&bcache.lock);
+        acquiresleep(&b->lock);
+        cgroup_mem_stat_pgmajfault_incr(cg);
+        return b;
+      }
     }
   }
   panic("bget: no buffers");
@@ -124,10 +238,18 @@ devicerw(struct inode *device, struct buf *b)
   b->flags &= ~B_DIRTY;
 }
 
+// Read or write b, charging the I/O to cgroup. Cgroups over their
+// limits are throttled before they take any file system lock, in
+// begin_op() and fileread(), rather than here where the buffer and
+// usually an inode are locked.
 void
-brw(struct buf *b)
+brw(struct buf *b, struct cgroup *cgroup)
 {
   struct inode *device;
+  int write = (b->flags & B_DIRTY) != 0;
+
+  cgroup_io_charge(cgroup, b->dev, write, BSIZE);
+
   if ((device = getinodefordevice(b->dev)) != 0) {
     devicerw(device, b);
   } else {
@@ -140,22 +262,35 @@ struct buf*
 bread(uint dev, uint blockno)
 {
   struct buf *b;
+  int psi;
 
+  // Waiting for a buffer another process reads in is waiting for I/O too.
+  psi = psi_enter(PSI_IOWAIT);
   b = bget(dev, blockno);
   if((b->flags & B_VALID) == 0) {
-    brw(b);
+    brw(b, proc_get_cgroup());
   }
+  psi_leave(psi);
   return b;
 }
 
-// Write b's contents to disk.  Must be locked.
+// Write b's contents to disk, charging the write to cgroup.
+// Must be locked.
 void
-bwrite(struct buf *b)
+bwritefor(struct buf *b, struct cgroup *cgroup)
 {
   if(!holdingsleep(&b->lock))
     panic("bwrite");
   b->flags |= B_DIRTY;
-  brw(b);
+  brw(b, cgroup);
+}
+
+// Write b's contents to disk.  Must be locked.
+// The write is charged to the cgroup that dirtied the buffer.
+void
+bwrite(struct buf *b)
+{
+  bwritefor(b, b->dirty_cgroup ? b->dirty_cgroup : proc_get_cgroup());
 }
 
 // Release a locked buffer.
@@ -7,7 +7,8 @@ struct buf {
   struct buf *prev; // LRU cache list
   struct buf *next;
   struct buf *qnext; // disk queue
-  struct cgroup *cgroup;
+  struct cgroup *cgroup;       // charged for the block, see bio.c
+  struct cgroup *dirty_cgroup; // dirtied the block, for file_dirty
   uchar data[BSIZE];
 };
 #define B_VALID 0x2  // buffer has been read from disk
@@ -7,6 +7,7 @@
 #include "spinlock.h"
 #include "types.h"
 #include "mmu.h"
+#include "steady_clock.h"
 
 #define MAX_PID_LENGTH 5
 #define MAX_CGROUP_DIR_ENTRIES 64
@@ -137,30 +138,12 @@ static inline void move_and_add(char* destination, char* source, int* var)
     *var += strlen(source);
 }
 
-static int fdalloc(struct file * f)
+static int find_procs_offsets(struct proc ** procp, int * pidoff, struct file * f)
 {
-    int fd;
-    struct proc * curproc = myproc();
-
-    for (fd = 0; fd < NOFILE; fd++) {
-        if (curproc->ofile[fd] == 0) {
-            curproc->ofile[fd] = f;
-            return fd;
-        }
-    }
-    return -1;
-}
-
-static int find_procs_offsets(int * procoff, int * pidoff, struct file * f)
-{
-    *procoff = 0;
+    *procp = f->cgp->procs;
     *pidoff = f->off;
-    while (*procoff < sizeof(f->cgp->proc) / sizeof(*f->cgp->proc)) {
-        if (f->cgp->proc[*procoff] == 0) {
-            *procoff += 1;
-            continue;
-        }
-        int pid = proc_pid(f->cgp->proc[*procoff]);
+    while (*procp) {
+        int pid = proc_pid(*procp);
         int pidlen = 1;
         while (pid > 0) {
             pidlen++;
@@ -168,12 +151,12 @@ static int find_procs_offsets(int * procoff, int * pidoff, struct file * f)
         }
         if (*pidoff >= pidlen) {
             *pidoff -= pidlen;
-            *procoff += 1;
+            *procp = (*procp)->cgnext;
         } else
             break;
     }
 
-    if (*procoff >= sizeof(f->cgp->proc) / sizeof(*f->cgp->proc))
+    if (*procp == 0)
         return -1;
 
     return 0;
@@ -210,44 +193,89 @@ static int is_file_writable(cgroup_file_name_t filetype)
    return -1;
 }
 
+/* Cgroup file names of one prefix, with their constants.*/
+struct cg_file_name
+{
+    char * name;
+    cgroup_file_name_t type;
+};
+
+static const struct cg_file_name cgroup_file_names[] = {
+    {CGFS_PROCS, CGROUP_PROCS},
+    {CGFS_SUBTREE_CONTROL, CGROUP_SUBTREE_CONTROL},
+    {CGFS_MAX_DESCENDANTS, CGROUP_MAX_DESCENDANTS},
+    {CGFS_MAX_DEPTH, CGROUP_MAX_DEPTH},
+    {CGFS_CONTROLLERS, CGROUP_CONTROLLERS},
+    {CGFS_EVENTS, CGROUP_EVENTS},
+    {CGFS_STAT, CGROUP_STAT},
+    {CGFS_SET_FRZ, SET_FRZ},
+    {0, 0}
+};
+
+static const struct cg_file_name cpu_file_names[] = {
+    {CGFS_CPU_WEIGHT, CPU_WEIGHT},
+    {CGFS_CPU_MAX, CPU_MAX},
+    {CGFS_CPU_MAX_BURST, CPU_MAX_BURST},
+    {CGFS_CPU_STAT, CPU_STAT},
+    {CGFS_CPU_SCHED_STAT, CPU_SCHED_STAT},
+    {CGFS_CPU_PRESSURE, CPU_PRESSURE},
+    {CGFS_SET_CPU, SET_CPU},
+    {CGFS_SET_CPU_EFFECTIVE, SET_CPU_EFFECTIVE},
+    {0, 0}
+};
+
+static const struct cg_file_name io_file_names[] = {
+    {CGFS_IO_PRESSURE, IO_PRESSURE},
+    {CGFS_IO_STAT, IO_STAT},
+    {CGFS_IO_MAX, IO_MAX},
+    {0, 0}
+};
+
+static const struct cg_file_name memory_file_names[] = {
+    {CGFS_MEM_CUR, MEM_CUR},
+    {CGFS_MEM_MAX, MEM_MAX},
+    {CGFS_MEM_MIN, MEM_MIN},
+    {CGFS_MEM_STAT, MEM_STAT},
+    {CGFS_MEM_PRESSURE, MEM_PRESSURE},
+    {CGFS_MEM_HIGH, MEM_HIGH},
+    {CGFS_MEM_EVENTS, MEM_EVENTS},
+    {CGFS_MEM_CACHE_MIN, MEM_CACHE_MIN},
+    {CGFS_MEM_CACHE_MAX, MEM_CACHE_MAX},
+    {0, 0}
+};
+
+static const struct cg_file_name pid_file_names[] = {
+    {CGFS_PID_MAX, PID_MAX},
+    {CGFS_PID_CUR, PID_CUR},
+    {0, 0}
+};
+
 static cgroup_file_name_t get_file_name_constant(char * filename)
 {
-    if (strcmp(filename, CGFS_PROCS) == 0)
-        return CGROUP_PROCS;
-    else if (strcmp(filename, CGFS_SUBTREE_CONTROL) == 0)
-        return CGROUP_SUBTREE_CONTROL;
-    else if (strcmp(filename, CGFS_MAX_DESCENDANTS) == 0)
-        return CGROUP_MAX_DESCENDANTS;
-    else if (strcmp(filename, CGFS_MAX_DEPTH) == 0)
-        return CGROUP_MAX_DEPTH;
-    else if (strcmp(filename, CGFS_CONTROLLERS) == 0)
-        return CGROUP_CONTROLLERS;
-    else if (strcmp(filename, CGFS_EVENTS) == 0)
-        return CGROUP_EVENTS;
-    else if (strcmp(filename, CGFS_STAT) == 0)
-        return CGROUP_STAT;
-    else if (strcmp(filename, CGFS_CPU_WEIGHT) == 0)
-        return CPU_WEIGHT;
-    else if (strcmp(filename, CGFS_CPU_MAX) == 0)
-        return CPU_MAX;
-    else if (strcmp(filename, CGFS_CPU_STAT) == 0)
-        return CPU_STAT;
-    else if (strcmp(filename, CGFS_PID_MAX) == 0)
-        return PID_MAX;
-    else if (strcmp(filename, CGFS_PID_CUR) == 0)
-        return PID_CUR;
-    else if (strcmp(filename, CGFS_SET_CPU) == 0)
-        return SET_CPU;
-    else if (strcmp(filename, CGFS_SET_FRZ) == 0)
-        return SET_FRZ;
-    else if (strcmp(filename, CGFS_MEM_CUR) == 0)
-      return MEM_CUR;
-    else if (strcmp(filename, CGFS_MEM_MAX) == 0)
-      return MEM_MAX;
-    else if (strcmp(filename, CGFS_MEM_MIN) == 0)
-        return MEM_MIN;
-    else if (strcmp(filename, CGFS_MEM_STAT) == 0)
-      return MEM_STAT;
+    const struct cg_file_name * names;
+
+    // Pick the names of the file's prefix by its first letters, so only
+    // a few names are compared.
+    switch (filename[0]) {
+        case 'c':
+            names = filename[1] == 'g' ? cgroup_file_names : cpu_file_names;
+            break;
+        case 'i':
+            names = io_file_names;
+            break;
+        case 'm':
+            names = memory_file_names;
+            break;
+        case 'p':
+            names = pid_file_names;
+            break;
+        default:
+            return -1;
+    }
+
+    for (; names->name; names++)
+        if (strcmp(filename, names->name) == 0)
+            return names->type;
 
     return -1;
 }
@@ -276,11 +304,24 @@ static int unsafe_cg_open_dir(char * dirname, struct cgroup * cgp, int omode)
     f->writable = 0;
     f->cgp = cgp;
     *f->cgfilename = 0;
+    f->cgfiletype = -1;
 
     cgp->ref_count++;
     return fd;
 }
 
+/**
+ * This function returns the pressure stall resource of a pressure file.
+ */
+static int pressure_resource(cgroup_file_name_t filename_const)
+{
+    if (filename_const == MEM_PRESSURE)
+        return PSI_MEM;
+    if (filename_const == IO_PRESSURE)
+        return PSI_IO;
+    return PSI_CPU;
+}
+
 /**
  * This function opens a cgroup file
  */
@@ -288,6 +329,8 @@ static int unsafe_cg_open_file(char * filename, struct cgroup * cgp, int omode)
 {
     int writable = 1;
     int fd = -1;
+    int resource;
+    unsigned int * events;
     struct file * f;
     cgroup_file_name_t filename_const = get_file_name_constant(filename);
 
@@ -309,13 +352,23 @@ static int unsafe_cg_open_file(char * filename, struct cgroup * cgp, int omode)
                 return -1;
             f->cpu.stat.active = cgp->cpu_controller_enabled;
             f->cpu.stat.usage_usec = cgp->cpu_time;
-            f->cpu.stat.user_usec = cgp->cpu_time;
-            f->cpu.stat.system_usec = 0;
+            f->cpu.stat.user_usec = cgp->cpu_user_time;
+            f->cpu.stat.system_usec = cgp->cpu_system_time;
             f->cpu.stat.nr_periods = cgp->cpu_nr_periods;
             f->cpu.stat.nr_throttled = cgp->cpu_nr_throttled;
             f->cpu.stat.throttled_usec = cgp->cpu_throttled_usec;
             break;
 
+        case CPU_SCHED_STAT:
+            if (cgp == cgroup_root())
+                return -1;
+            f->cpu.sched.run_delay_usec = cgp->sched_run_delay;
+            f->cpu.sched.max_wait_usec = cgp->sched_max_wait;
+            f->cpu.sched.nr_voluntary_switches = cgp->sched_nvcsw;
+            f->cpu.sched.nr_involuntary_switches = cgp->sched_nivcsw;
+            f->cpu.sched.nr_migrations = cgp->sched_migrations;
+            break;
+
         case CPU_WEIGHT:
             if (cgp == cgroup_root())
                 return -1;
@@ -329,6 +382,12 @@ static int unsafe_cg_open_file(char * filename, struct cgroup * cgp, int omode)
             f->cpu.max.period = cgp->cpu_account_period;
             break;
 
+        case CPU_MAX_BURST:
+            if (cgp == cgroup_root())
+                return -1;
+            f->cpu.burst.burst = cgp->cpu_burst;
+            break;
+
         case PID_MAX:
             if (cgp == cgroup_root())
                 return -1;
@@ -340,7 +399,14 @@ static int unsafe_cg_open_file(char * filename, struct cgroup * cgp, int omode)
             if (cgp == cgroup_root())
                 return -1;
             f->cpu_s.set.active = cgp->set_controller_enabled;
-            f->cpu_s.set.cpu_id = cgp->cpu_to_use;
+            f->cpu_s.set.cpus = cgp->cpus;
+            break;
+
+        case SET_CPU_EFFECTIVE:
+            if (cgp == cgroup_root())
+                return -1;
+            f->cpu_s.set.active = cgp->set_controller_enabled;
+            f->cpu_s.set.cpus_effective = cgp->cpus_effective;
             break;
 
         case SET_FRZ:
@@ -356,6 +422,22 @@ static int unsafe_cg_open_file(char * filename, struct cgroup * cgp, int omode)
             f->mem.max.max = cgp->max_mem;
             break;
 
+        case MEM_HIGH:
+            if (cgp == cgroup_root())
+                return -1;
+            f->mem.high.active = cgp->mem_controller_enabled;
+            f->mem.high.high = cgp->high_mem;
+            break;
+
+        case MEM_CACHE_MIN:
+        case MEM_CACHE_MAX:
+            if (cgp == cgroup_root())
+                return -1;
+            f->mem.cache.active = cgp->mem_controller_enabled;
+            f->mem.cache.min = cgp->cache_min;
+            f->mem.cache.max = cgp->cache_max;
+            break;
+
         case MEM_MIN:
             if (cgp == cgroup_root())
                 return -1;
@@ -367,12 +449,36 @@ static int unsafe_cg_open_file(char * filename, struct cgroup * cgp, int omode)
             if (cgp == cgroup_root())
                 return -1;
             f->mem.stat.active = cgp->mem_controller_enabled;
-            f->mem.stat.file_dirty = cgp->mem_stat_file_dirty;
-            f->mem.stat.file_dirty_aggregated = cgp->mem_stat_file_dirty_aggregated;
+            f->mem.stat.file = cgp->mem_stat_file * BSIZE;
+            f->mem.stat.file_dirty = cgp->mem_stat_file_dirty * BSIZE;
+            f->mem.stat.file_dirty_aggregated = cgp->mem_stat_file_dirty_aggregated * BSIZE;
             f->mem.stat.pgfault = cgp->mem_stat_pgfault;
             f->mem.stat.pgmajfault = cgp->mem_stat_pgmajfault;
             f->mem.stat.kernel = get_total_memory() * PGSIZE;
             break;
+
+        case CPU_PRESSURE:
+        case MEM_PRESSURE:
+        case IO_PRESSURE:
+            if (cgp == cgroup_root())
+                return -1;
+            resource = pressure_resource(filename_const);
+            memmove(f->psi.avg, cgp->psi.avg[resource], sizeof(f->psi.avg));
+            memmove(f->psi.total, cgp->psi.total[resource], sizeof(f->psi.total));
+            break;
+
+        // io files are read from the cgroup, they hold a line per device.
+        case IO_STAT:
+        case IO_MAX:
+            if (cgp == cgroup_root())
+                return -1;
+            break;
+
+        // memory events are read from the cgroup as they happen.
+        case MEM_EVENTS:
+            if (cgp == cgroup_root())
+                return -1;
+            break;
         // for any other type we do nothing (no special handling)
         default:
             break;
@@ -384,6 +490,11 @@ static int unsafe_cg_open_file(char * filename, struct cgroup * cgp, int omode)
     f->writable = ((omode & O_WRONLY) || (omode & O_RDWR)) && writable;
     f->cgp = cgp;
     strncpy(f->cgfilename, filename, sizeof(f->cgfilename));
+    f->cgfiletype = filename_const;
+
+    // Pollers wait for events after the open.
+    if ((events = unsafe_cg_events(f)) != 0)
+        f->events_seq = *events;
 
     cgp->ref_count++;
     return fd;
@@ -408,31 +519,25 @@ int unsafe_cg_open(cg_file_type type, char * filename, struct cgroup * cgp, int
 
 static int read_file_cg_procs(struct file * f, char * addr, int n)
 {
-    int procoff;
+    struct proc * p;
     int pidoff;
     int r = 0;
 
-    if (find_procs_offsets(&procoff, &pidoff, f) < 0) {
+    if (find_procs_offsets(&p, &pidoff, f) < 0) {
         return 0;
     }
 
-    while (procoff < (sizeof(f->cgp->proc) / sizeof(*f->cgp->proc)) &&
-            r < n) 
+    while (p && r < n)
     {
-        if (f->cgp->proc[procoff] == 0) {
-            procoff++;
-            continue;
-        }
-
         memset(buf,'\0',MAX_PID_LENGTH);
-        int pidlength = itoa(buf, proc_pid(f->cgp->proc[procoff]));
+        int pidlength = itoa(buf, proc_pid(p));
         if (pidoff < pidlength) {
             *addr = buf[pidoff];
             pidoff++;
         } else {
             *addr = '\n';
             pidoff = 0;
-            procoff++;
+            p = p->cgnext;
         }
         addr++;
         r++;
@@ -458,6 +563,9 @@ static int read_file_cg_controllers(struct file * f, char * addr, int n)
     if (f->cgp->mem_controller_avalible) {
         move_and_add(buf, "mem\n", &i);
     }
+    if (f->cgp->io_controller_avalible) {
+        move_and_add(buf, "io\n", &i);
+    }
 
     return copy_buffer_up_to_end(buf + f->off, min(i, n), addr);
 }
@@ -479,6 +587,9 @@ static int read_file_cg_subtree(struct file * f, char * addr, int n)
     if (f->cgp->mem_controller_enabled) {
         move_and_add(buf, "mem\n", &i);
     }
+    if (f->cgp->io_controller_enabled) {
+        move_and_add(buf, "io\n", &i);
+    }
 
     return copy_buffer_up_to_end(buf + f->off, min(i, n), addr);
 }
@@ -549,6 +660,151 @@ static int read_file_cpu_stat(struct  file * f, char * addr, int n)
     return copy_buffer_up_to_end(stattext + f->off, min(abs(stattextp - stattext - f->off), n), addr);
 }
 
+static int read_file_cpu_sched_stat(struct file * f, char * addr, int n)
+{
+    char run_delay_buf[11] = {0};
+    char max_wait_buf[11] = {0};
+    char nvcsw_buf[11] = {0};
+    char nivcsw_buf[11] = {0};
+    char migrations_buf[11] = {0};
+    char * stattext = buf;
+    char * stattextp = stattext;
+
+    itoa(run_delay_buf, f->cpu.sched.run_delay_usec);
+    itoa(max_wait_buf, f->cpu.sched.max_wait_usec);
+    itoa(nvcsw_buf, f->cpu.sched.nr_voluntary_switches);
+    itoa(nivcsw_buf, f->cpu.sched.nr_involuntary_switches);
+    itoa(migrations_buf, f->cpu.sched.nr_migrations);
+
+    copy_and_move_buffer(&stattextp, "run_delay_usec - ", strlen("run_delay_usec - "));
+    copy_and_move_buffer(&stattextp, run_delay_buf, strlen(run_delay_buf));
+    copy_and_move_buffer(&stattextp, "\n", strlen("\n"));
+    copy_and_move_buffer(&stattextp, "max_wait_usec - ", strlen("max_wait_usec - "));
+    copy_and_move_buffer(&stattextp, max_wait_buf, strlen(max_wait_buf));
+    copy_and_move_buffer(&stattextp, "\n", strlen("\n"));
+    copy_and_move_buffer(&stattextp, "nr_voluntary_switches - ", strlen("nr_voluntary_switches - "));
+    copy_and_move_buffer(&stattextp, nvcsw_buf, strlen(nvcsw_buf));
+    copy_and_move_buffer(&stattextp, "\n", strlen("\n"));
+    copy_and_move_buffer(&stattextp, "nr_involuntary_switches - ", strlen("nr_involuntary_switches - "));
+    copy_and_move_buffer(&stattextp, nivcsw_buf, strlen(nivcsw_buf));
+    copy_and_move_buffer(&stattextp, "\n", strlen("\n"));
+    copy_and_move_buffer(&stattextp, "nr_migrations - ", strlen("nr_migrations - "));
+    copy_and_move_buffer(&stattextp, migrations_buf, strlen(migrations_buf));
+    copy_and_move_buffer(&stattextp, "\n", strlen("\n"));
+
+    return copy_buffer_up_to_end(stattext + f->off, min(abs(stattextp - stattext - f->off), n), addr);
+}
+
+/**
+ * This function appends a line of pressure stall information to "buffer":
+ * the averages as percentages with two decimals and the total stall time.
+ */
+static void copy_and_move_pressure(char ** buffer, char * state, uint * avg, uint total)
+{
+    static char * names[NR_PSI_AVGS] = {" avg10=", " avg60=", " avg300="};
+    char num_buf[11];
+
+    copy_and_move_buffer(buffer, state, strlen(state));
+    for (int i = 0; i < NR_PSI_AVGS; i++) {
+        copy_and_move_buffer(buffer, names[i], strlen(names[i]));
+        copy_and_move_buffer(buffer, num_buf, utoa(num_buf, avg[i] / 10000));
+        copy_and_move_buffer(buffer, ".", strlen("."));
+        if (avg[i] / 100 % 100 < 10)
+            copy_and_move_buffer(buffer, "0", strlen("0"));
+        copy_and_move_buffer(buffer, num_buf, utoa(num_buf, avg[i] / 100 % 100));
+    }
+    copy_and_move_buffer(buffer, " total=", strlen(" total="));
+    copy_and_move_buffer(buffer, num_buf, utoa(num_buf, total));
+    copy_and_move_buffer(buffer, "\n", strlen("\n"));
+}
+
+static int read_file_pressure(struct file * f, char * addr, int n)
+{
+    char * pressuretext = buf;
+    char * pressuretextp = pressuretext;
+
+    copy_and_move_pressure(&pressuretextp, "some", f->psi.avg[PSI_SOME], f->psi.total[PSI_SOME]);
+    copy_and_move_pressure(&pressuretextp, "full", f->psi.avg[PSI_FULL], f->psi.total[PSI_FULL]);
+
+    return copy_buffer_up_to_end(pressuretext + f->off, min(abs(pressuretextp - pressuretext - f->off), n), addr);
+}
+
+/**
+ * This function appends the device of the given io index as "major:minor" to "buffer".
+ */
+static void copy_and_move_io_dev(char ** buffer, int index)
+{
+    char num_buf[11];
+    unsigned int dev = IO_INDEX_TO_DEV(index);
+
+    copy_and_move_buffer(buffer, num_buf, utoa(num_buf, dev >> 16));
+    copy_and_move_buffer(buffer, ":", strlen(":"));
+    copy_and_move_buffer(buffer, num_buf, utoa(num_buf, dev & 0xffff));
+}
+
+static int read_file_io_stat(struct file * f, char * addr, int n)
+{
+    static char * names[] = {" rbytes=", " wbytes=", " rios=", " wios="};
+    char num_buf[11];
+    char * stattext = buf;
+    char * stattextp = stattext;
+    struct cgroup_io * io;
+    unsigned int values[4];
+
+    // Only devices with I/O have a line.
+    for (int i = 0; i < NIODEVS; i++) {
+        io = &f->cgp->io[i];
+        if (io->rios == 0 && io->wios == 0)
+            continue;
+        values[0] = io->rbytes;
+        values[1] = io->wbytes;
+        values[2] = io->rios;
+        values[3] = io->wios;
+        copy_and_move_io_dev(&stattextp, i);
+        for (int j = 0; j < 4; j++) {
+            copy_and_move_buffer(&stattextp, names[j], strlen(names[j]));
+            copy_and_move_buffer(&stattextp, num_buf, utoa(num_buf, values[j]));
+        }
+        copy_and_move_buffer(&stattextp, "\n", strlen("\n"));
+    }
+
+    return copy_buffer_up_to_end(stattext + f->off, min(abs(stattextp - stattext - f->off), n), addr);
+}
+
+static char * io_limit_names[NR_IO_LIMITS] = {"rbps", "wbps", "riops", "wiops"};
+
+static int read_file_io_max(struct file * f, char * addr, int n)
+{
+    char num_buf[11];
+    char * maxtext = buf;
+    char * maxtextp = maxtext;
+    struct cgroup_io * io;
+    int limited;
+
+    // Only devices with limits have a line.
+    for (int i = 0; i < NIODEVS; i++) {
+        io = &f->cgp->io[i];
+        limited = 0;
+        for (int j = 0; j < NR_IO_LIMITS; j++)
+            limited |= io->max[j] != ~0;
+        if (!limited)
+            continue;
+        copy_and_move_io_dev(&maxtextp, i);
+        for (int j = 0; j < NR_IO_LIMITS; j++) {
+            copy_and_move_buffer(&maxtextp, " ", strlen(" "));
+            copy_and_move_buffer(&maxtextp, io_limit_names[j], strlen(io_limit_names[j]));
+            copy_and_move_buffer(&maxtextp, "=", strlen("="));
+            if (io->max[j] == ~0)
+                copy_and_move_buffer(&maxtextp, "max", strlen("max"));
+            else
+                copy_and_move_buffer(&maxtextp, num_buf, utoa(num_buf, io->max[j]));
+        }
+        copy_and_move_buffer(&maxtextp, "\n", strlen("\n"));
+    }
+
+    return copy_buffer_up_to_end(maxtext + f->off, min(abs(maxtextp - maxtext - f->off), n), addr);
+}
+
 static int read_file_cpu_weight(struct file * f, char * addr, int n)
 {
     char tmp_num_buff[20] = {0};
@@ -578,6 +834,19 @@ static int read_file_cpu_max(struct file * f, char * addr, int n)
     return copy_buffer_up_to_end(maxtext + f->off, min(abs(maxtextp - maxtext - f->off), n), addr);
 }
 
+static int read_file_cpu_max_burst(struct file * f, char * addr, int n)
+{
+    char tmp_num_buff[20] = {0};
+    char * bursttext = buf;
+    char *bursttextp = bursttext;
+    copy_and_move_buffer(&bursttextp, "burst - ", strlen("burst - "));
+    int num_str_length = utoa(tmp_num_buff, f->cpu.burst.burst);
+    copy_and_move_buffer(&bursttextp, tmp_num_buff, num_str_length);
+    copy_and_move_buffer(&bursttextp, "\n", strlen("\n"));
+
+    return copy_buffer_up_to_end(bursttext + f->off, min(abs(bursttextp - bursttext - f->off), n), addr);
+}
+
 static int read_file_pid_max(struct file *f, char * addr, int n)
 {
     char max_buf[11] = {0};
@@ -608,13 +877,82 @@ static int read_file_pid_cur(struct file * f, char * addr, int n)
     return copy_buffer_up_to_end(stattext + f->off, min(abs(stattextp - stattext - f->off), n), addr);
 }
 
+/*Format a mask of cpus as a cpu list such as "0,2-3".*/
+static void cpus_to_list(char * list, unsigned int cpus)
+{
+    char * p = list;
+    int first;
+
+    for (int i = 0; i < 32; i++) {
+        if (!(cpus & (1u << i)))
+            continue;
+        for (first = i; i < 31 && (cpus & (1u << (i + 1))); i++)
+            ;
+        if (p != list)
+            *p++ = ',';
+        p += itoa(p, first);
+        if (i > first) {
+            *p++ = '-';
+            p += itoa(p, i);
+        }
+    }
+    *p = 0;
+}
+
+/**
+ * This function parses the cpu number at *list and moves *list past it.
+ * Returns -1 if there is no number or it is not a cpu of the mask.
+ */
+static int list_to_cpu(char ** list)
+{
+    int cpu = 0;
+
+    if (**list < '0' || **list > '9')
+        return -1;
+    for (; **list >= '0' && **list <= '9'; (*list)++) {
+        cpu = cpu * 10 + **list - '0';
+        if (cpu >= 32)
+            return -1;
+    }
+    return cpu;
+}
+
+/*Parse a cpu list such as "0,2-3" into a mask of cpus.
+ * Returns 0 if the list is malformed.*/
+static unsigned int list_to_cpus(char * list)
+{
+    unsigned int cpus = 0;
+    int first, last;
+
+    for (;;) {
+        if ((first = list_to_cpu(&list)) < 0)
+            return 0;
+        last = first;
+        if (*list == '-') {
+            list++;
+            if ((last = list_to_cpu(&list)) < 0)
+                return 0;
+        }
+        if (first > last)
+            return 0;
+        for (; first <= last; first++)
+            cpus |= 1u << first;
+        if (*list != ',')
+            break;
+        list++;
+    }
+    if (*list != 0 && *list != '\n')
+        return 0;
+    return cpus;
+}
+
 static int read_file_set_cpu(struct file * f, char * addr, int n)
 {
-    char cpu_buf[11] = {0};
+    char cpu_buf[3 * 32] = {0};
     char * cputext = buf;
     char * cputextp = cputext;
 
-    itoa(cpu_buf, f->cpu_s.set.cpu_id);
+    cpus_to_list(cpu_buf, f->cpu_s.set.cpus);
 
     copy_and_move_buffer(&cputextp, "use_cpu - ", strlen("use_cpu - "));
     copy_and_move_buffer(&cputextp, cpu_buf, strlen(cpu_buf));
@@ -623,6 +961,20 @@ static int read_file_set_cpu(struct file * f, char * addr, int n)
     return copy_buffer_up_to_end(cputext + f->off, min(abs(cputextp - cputext - f->off), n), addr);
 }
 
+static int read_file_set_cpu_effective(struct file * f, char * addr, int n)
+{
+    char cpu_buf[3 * 32] = {0};
+    char * cputext = buf;
+    char * cputextp = cputext;
+
+    cpus_to_list(cpu_buf, f->cpu_s.set.cpus_effective);
+
+    copy_and_move_buffer(&cputextp, cpu_buf, strlen(cpu_buf));
+    copy_and_move_buffer(&cputextp, "\n", strlen("\n"));
+
+    return copy_buffer_up_to_end(cputext + f->off, min(abs(cputextp - cputext - f->off), n), addr);
+}
+
 static int read_file_set_frz(struct file * f, char * addr, int n)
 {
     char frz_buf[11] = {0};
@@ -665,6 +1017,46 @@ static int read_file_mem_max(struct file * f, char * addr, int n)
     return copy_buffer_up_to_end(maxtext + f->off, min(abs(maxtextp - maxtext - f->off), n), addr);
 }
 
+static int read_file_mem_high(struct file * f, char * addr, int n)
+{
+    char high_buf[11] = {0};
+    char * hightext = buf;
+    char * hightextp = hightext;
+
+    copy_and_move_buffer(&hightextp, high_buf, utoa(high_buf, f->mem.high.high));
+    copy_and_move_buffer(&hightextp, "\n", strlen("\n"));
+
+    return copy_buffer_up_to_end(hightext + f->off, min(abs(hightextp - hightext - f->off), n), addr);
+}
+
+static int read_file_mem_cache(struct file * f, char * addr, int n, unsigned int blocks)
+{
+    char blocks_buf[11] = {0};
+    char * cachetext = buf;
+    char * cachetextp = cachetext;
+
+    copy_and_move_buffer(&cachetextp, blocks_buf, utoa(blocks_buf, blocks));
+    copy_and_move_buffer(&cachetextp, "\n", strlen("\n"));
+
+    return copy_buffer_up_to_end(cachetext + f->off, min(abs(cachetextp - cachetext - f->off), n), addr);
+}
+
+static int read_file_mem_events(struct file * f, char * addr, int n)
+{
+    static char * names[NR_MEM_EVENTS] = {"high - ", "max - ", "oom - ", "oom_kill - "};
+    char num_buf[11];
+    char * eventstext = buf;
+    char * eventstextp = eventstext;
+
+    for (int i = 0; i < NR_MEM_EVENTS; i++) {
+        copy_and_move_buffer(&eventstextp, names[i], strlen(names[i]));
+        copy_and_move_buffer(&eventstextp, num_buf, utoa(num_buf, f->cgp->mem_events[i]));
+        copy_and_move_buffer(&eventstextp, "\n", strlen("\n"));
+    }
+
+    return copy_buffer_up_to_end(eventstext + f->off, min(abs(eventstextp - eventstext - f->off), n), addr);
+}
+
 static int read_file_mem_min(struct file * f, char * addr, int n)
 {
     char max_buf[10] = { 0 };
@@ -681,13 +1073,16 @@ static int read_file_mem_min(struct file * f, char * addr, int n)
 
 static int read_file_mem_stat(struct file * f, char * addr, int n)
 {
+    char file_buf[10] = {0};
     char file_dirty_buf[10] = {0};
     char file_dirty_aggregated_buf[10] = {0};
     char pgfault_buf[10] = {0};
     char pgmajfault_buf[10] = {0};
     char kernel_buf[10] = {0};
 
-    uint stattext_size = strlen("file_dirty - ") +
+    uint stattext_size = strlen("file - ") +
+            utoa(file_buf, f->mem.stat.file) + 1 +
+            strlen("file_dirty - ") +
             utoa(file_dirty_buf, f->mem.stat.file_dirty) + 1
             + strlen("file_dirty_aggregated - ") +
             utoa(file_dirty_aggregated_buf, f->mem.stat.file_dirty_aggregated) + 1 +
@@ -702,6 +1097,10 @@ static int read_file_mem_stat(struct file * f, char * addr, int n)
     char *stattextp = stattext;
     memset(stattext, '\0', stattext_size);
 
+    copy_and_move_buffer(&stattextp, "file - ", strlen("file - "));
+    copy_and_move_buffer(&stattextp, file_buf, strlen(file_buf));
+    copy_and_move_buffer(&stattextp, "\n", strlen("\n"));
+
     copy_and_move_buffer(&stattextp, "file_dirty - ", strlen("file_dirty - "));
     copy_and_move_buffer(&stattextp, file_dirty_buf, strlen(file_dirty_buf));
     copy_and_move_buffer(&stattextp, "\n", strlen("\n"));
@@ -747,11 +1146,16 @@ static int read_file_cg_max_descen(struct file * f, char * addr, int n)
 static int unsafe_cg_read_file(struct file * f, char * addr, int n)
 {
         int r = 0;
-        cgroup_file_name_t filename_const = get_file_name_constant(f->cgfilename);
+        unsigned int * events;
+        cgroup_file_name_t filename_const = f->cgfiletype;
         
         if (filename_const < 1 || f->readable == 0 || *f->cgp->cgroup_dir_path == 0)
             return -1;
 
+        // Pollers wait for events after the last read.
+        if ((events = unsafe_cg_events(f)) != 0)
+            f->events_seq = *events;
+
         switch(filename_const)
         {
         case CGROUP_PROCS:
@@ -788,6 +1192,24 @@ static int unsafe_cg_read_file(struct file * f, char * addr, int n)
             r = read_file_cpu_stat(f, addr, n);
             break;
 
+        case CPU_SCHED_STAT:
+            r = read_file_cpu_sched_stat(f, addr, n);
+            break;
+
+        case CPU_PRESSURE:
+        case MEM_PRESSURE:
+        case IO_PRESSURE:
+            r = read_file_pressure(f, addr, n);
+            break;
+
+        case IO_STAT:
+            r = read_file_io_stat(f, addr, n);
+            break;
+
+        case IO_MAX:
+            r = read_file_io_max(f, addr, n);
+            break;
+
         case CPU_WEIGHT:
             r = read_file_cpu_weight(f, addr, n);
             break;
@@ -795,6 +1217,10 @@ static int unsafe_cg_read_file(struct file * f, char * addr, int n)
         case CPU_MAX:
             r = read_file_cpu_max(f, addr, n);
             break;
+
+        case CPU_MAX_BURST:
+            r = read_file_cpu_max_burst(f, addr, n);
+            break;
         
         case PID_MAX:
             r = read_file_pid_max(f, addr, n);
@@ -807,6 +1233,10 @@ static int unsafe_cg_read_file(struct file * f, char * addr, int n)
         case SET_CPU:
             r = read_file_set_cpu(f, addr, n);
             break;
+
+        case SET_CPU_EFFECTIVE:
+            r = read_file_set_cpu_effective(f, addr, n);
+            break;
         
         case SET_FRZ:
             r = read_file_set_frz(f, addr, n);
@@ -824,6 +1254,22 @@ static int unsafe_cg_read_file(struct file * f, char * addr, int n)
             r = read_file_mem_min(f, addr, n);
             break;
 
+        case MEM_HIGH:
+            r = read_file_mem_high(f, addr, n);
+            break;
+
+        case MEM_EVENTS:
+            r = read_file_mem_events(f, addr, n);
+            break;
+
+        case MEM_CACHE_MIN:
+            r = read_file_mem_cache(f, addr, n, f->mem.cache.min);
+            break;
+
+        case MEM_CACHE_MAX:
+            r = read_file_mem_cache(f, addr, n, f->mem.cache.max);
+            break;
+
         case MEM_STAT:
             r = read_file_mem_stat(f, addr, n);
             break;
@@ -878,11 +1324,18 @@ int unsafe_cg_read(cg_file_type type, struct file * f, char * addr, int n)
         if (f->cgp != cgroup_root()) {
             copy_and_move_buffer_max_len(&bufp, CGFS_MEM_CUR);
             copy_and_move_buffer_max_len(&bufp, CGFS_CPU_STAT);
+            copy_and_move_buffer_max_len(&bufp, CGFS_CPU_SCHED_STAT);
+            copy_and_move_buffer_max_len(&bufp, CGFS_CPU_PRESSURE);
             copy_and_move_buffer_max_len(&bufp, CGFS_MEM_STAT);
+            copy_and_move_buffer_max_len(&bufp, CGFS_MEM_EVENTS);
+            copy_and_move_buffer_max_len(&bufp, CGFS_MEM_PRESSURE);
+            copy_and_move_buffer_max_len(&bufp, CGFS_IO_PRESSURE);
+            copy_and_move_buffer_max_len(&bufp, CGFS_IO_STAT);
 
             if (f->cgp->cpu_controller_enabled) {
                 copy_and_move_buffer_max_len(&bufp, CGFS_CPU_WEIGHT);
                 copy_and_move_buffer_max_len(&bufp, CGFS_CPU_MAX);
+                copy_and_move_buffer_max_len(&bufp, CGFS_CPU_MAX_BURST);
             }
 
             if (f->cgp->pid_controller_enabled) {
@@ -891,11 +1344,19 @@ int unsafe_cg_read(cg_file_type type, struct file * f, char * addr, int n)
 
             if (f->cgp->set_controller_enabled) {
                 copy_and_move_buffer_max_len(&bufp, CGFS_SET_CPU);
+                copy_and_move_buffer_max_len(&bufp, CGFS_SET_CPU_EFFECTIVE);
+            }
+
+            if (f->cgp->io_controller_enabled) {
+                copy_and_move_buffer_max_len(&bufp, CGFS_IO_MAX);
             }
 
             if (f->cgp->mem_controller_enabled) {
               copy_and_move_buffer_max_len(&bufp, CGFS_MEM_MAX);
+              copy_and_move_buffer_max_len(&bufp, CGFS_MEM_HIGH);
               copy_and_move_buffer_max_len(&bufp, CGFS_MEM_MIN);
+              copy_and_move_buffer_max_len(&bufp, CGFS_MEM_CACHE_MIN);
+              copy_and_move_buffer_max_len(&bufp, CGFS_MEM_CACHE_MAX);
             }
         }
 
@@ -931,6 +1392,7 @@ static int write_file_cg_subtree(struct file * f, char * addr, int n)
     char pidcontroller = 0;
     char setcontroller = 0;
     char memcontroller = 0;
+    char iocontroller = 0;
     char ch = ' ';
     int len = 0;
     int total_len = 0;
@@ -957,6 +1419,10 @@ static int write_file_cg_subtree(struct file * f, char * addr, int n)
             memcontroller = return_new_controller_state(*addr);
             addr += len + 1;
             total_len += len + 1;
+        } else if (strcmp(buf, "io") == 0) {
+            iocontroller = return_new_controller_state(*addr);
+            addr += len + 1;
+            total_len += len + 1;
         } else
             return -1;
     }
@@ -985,6 +1451,12 @@ static int write_file_cg_subtree(struct file * f, char * addr, int n)
         unsafe_disable_mem_controller(f->cgp) < 0)
         return -1;
 
+    if (iocontroller == 1 && unsafe_enable_io_controller(f->cgp) < 0)
+        return -1;
+    if (iocontroller == 2 &&
+        unsafe_disable_io_controller(f->cgp) < 0)
+        return -1;
+
     return n - total_len;
 }
 
@@ -1011,6 +1483,7 @@ static int write_file_cpu_max(struct file * f, char * addr, int n)
     int max = -1;
     int period = -1;
     int i = 0;
+    unsigned int now;
 
     //sh.c doesn't treat space inside for example: "1000 20000" as a single argument
     //so we will use special format, this also allows to parse zeroes inside a value
@@ -1033,14 +1506,14 @@ static int write_file_cpu_max(struct file * f, char * addr, int n)
 
     // Update max.
     max = atoi(max_string);
-    if (-1 == max) {
+    if (-1 == max || max > CGROUP_CPU_MAX_LIMIT) {
         return -1;
     }
 
     // Update period.
     if (period_string[0]) {
         period = atoi(period_string);
-        if (-1 == period) {
+        if (-1 == period || 0 == period) {
             return -1;
         }
 
@@ -1053,6 +1526,39 @@ static int write_file_cpu_max(struct file * f, char * addr, int n)
     f->cgp->cpu_time_limit = max;
     f->cpu.max.max = max;
 
+    // The burst may not exceed the quota.
+    if (f->cgp->cpu_burst > max)
+        f->cgp->cpu_burst = max;
+
+    // Start a new period with a full runtime pool, closing any
+    // throttled interval so that it still counts in cpu.stat.
+    now = steady_clock_now();
+    if (f->cgp->cpu_is_throttled) {
+        f->cgp->cpu_throttled_usec += now - f->cgp->cpu_throttled_at;
+        f->cgp->cpu_is_throttled = 0;
+    }
+    f->cgp->cpu_runtime = max;
+    f->cgp->cpu_period_start = now;
+
+    return n;
+}
+
+static int write_file_cpu_max_burst(struct file * f, char * addr, int n)
+{
+    char burst_string[32] = {0};
+    int burst;
+
+    memmove(burst_string, addr, min(n, sizeof(burst_string) - 1));
+
+    // Update burst, which may not exceed the quota.
+    burst = atoi(burst_string);
+    if (-1 == burst || burst > f->cgp->cpu_time_limit) {
+        return -1;
+    }
+
+    f->cgp->cpu_burst = burst;
+    f->cpu.burst.burst = burst;
+
     return n;
 }
 
@@ -1087,30 +1593,20 @@ static int write_file_pid_max(struct file * f, char * addr, int n)
 
 static int write_file_set_cpu(struct file * f, char * addr, int n)
 {
-    char set_string[32] = { 0 };
-    int set = -1;
-    int i = 0;
+    char set_string[3 * 32] = { 0 };
+    unsigned int cpus;
 
-    while (*addr && *addr != ',' &&  *addr != '\0' && i < sizeof(set_string)) {
-        set_string[i] = *addr;
-        i++;
-        addr++;
-    }
-    set_string[i] = '\0';
-    i = 0;
-    addr++;
+    memmove(set_string, addr, min(n, sizeof(set_string) - 1));
 
-    // Update set parameter.
-    set = atoi(set_string);
-    if (-1 == set) {
+    // Parse the cpu list, e.g. "1" or "0,2-3".
+    if ((cpus = list_to_cpus(set_string)) == 0)
         return -1;
-    }
 
-    // Update cpu id field if the paramter is within allowed values.
-    int test = set_cpu_id(f->cgp, set);
+    // Update cpus field if the paramter is within allowed values.
+    int test = set_cpus(f->cgp, cpus);
     if (test == 0 || test == -1)
         return -1;
-    f->cpu_s.set.cpu_id = set;
+    f->cpu_s.set.cpus = cpus;
 
     return  n;
 }
@@ -1145,6 +1641,60 @@ static int write_file_set_frz(struct file * f, char * addr, int n)
     return n;
 }
 
+/*Parse a decimal number at "s" into "value".
+ * Returns the position after the digits, or 0 if there are none.*/
+static char * parse_uint(char * s, unsigned int * value)
+{
+    if (*s < '0' || *s > '9')
+        return 0;
+    for (*value = 0; *s >= '0' && *s <= '9'; s++)
+        *value = *value * 10 + *s - '0';
+    return s;
+}
+
+static int write_file_io_max(struct file * f, char * addr, int n)
+{
+    char line[128] = {0};
+    char * p = line;
+    unsigned int major, minor, value;
+    unsigned int max[NR_IO_LIMITS] = {0};
+    int limit;
+
+    memmove(line, addr, min(n, sizeof(line) - 1));
+
+    // The device, as "major:minor".
+    if (!(p = parse_uint(p, &major)) || *p++ != ':' ||
+        !(p = parse_uint(p, &minor)) || major > 0xffff || minor > 0xffff)
+        return -1;
+
+    // Followed by limits, as "key=value" or "key=max". The whole line
+    // is parsed before any limit is set.
+    while (*p == ' ') {
+        p++;
+        for (limit = 0; limit < NR_IO_LIMITS; limit++)
+            if (strncmp(p, io_limit_names[limit], strlen(io_limit_names[limit])) == 0 &&
+                p[strlen(io_limit_names[limit])] == '=')
+                break;
+        if (limit == NR_IO_LIMITS)
+            return -1;
+        p += strlen(io_limit_names[limit]) + 1;
+        if (strncmp(p, "max", strlen("max")) == 0) {
+            value = ~0;
+            p += strlen("max");
+        } else if (!(p = parse_uint(p, &value)) || value == 0) {
+            return -1;
+        }
+        max[limit] = value;
+    }
+    if (*p != 0 && *p != '\n')
+        return -1;
+
+    if (unsafe_set_io_max(f->cgp, major << 16 | minor, max) < 0)
+        return -1;
+
+    return n;
+}
+
 static int write_file_mem_max(struct file * f, char * addr, int n)
 {
     char max_string[32] = { 0 };
@@ -1174,6 +1724,43 @@ static int write_file_mem_max(struct file * f, char * addr, int n)
     return n;
 }
 
+static int write_file_mem_high(struct file * f, char * addr, int n)
+{
+    char high_string[32] = { 0 };
+    unsigned int high;
+    int i = 0;
+
+    while (*addr && *addr != '\n' && i < sizeof(high_string) - 1)
+        high_string[i++] = *addr++;
+
+    high = atoi(high_string);
+    if (-1 == high || set_high_mem(f->cgp, high) != 1)
+        return -1;
+    f->mem.high.high = high;
+
+    return n;
+}
+
+static int write_file_mem_cache(struct file * f, char * addr, int n, int is_max)
+{
+    char blocks_string[32] = { 0 };
+    unsigned int blocks;
+    int i = 0;
+
+    while (*addr && *addr != '\n' && i < sizeof(blocks_string) - 1)
+        blocks_string[i++] = *addr++;
+
+    blocks = atoi(blocks_string);
+    if (-1 == blocks)
+        return -1;
+    if ((is_max ? set_cache_max(f->cgp, blocks) : set_cache_min(f->cgp, blocks)) != 1)
+        return -1;
+    f->mem.cache.min = f->cgp->cache_min;
+    f->mem.cache.max = f->cgp->cache_max;
+
+    return n;
+}
+
 static int write_file_mem_min(struct file * f, char * addr, int n)
 {
     char min_string[32] = { 0 };
@@ -1205,7 +1792,7 @@ static int write_file_mem_min(struct file * f, char * addr, int n)
 int unsafe_cg_write(struct file * f, char * addr, int n)
 {
     int r = 0;
-    cgroup_file_name_t filename_const = get_file_name_constant(f->cgfilename);
+    cgroup_file_name_t filename_const = f->cgfiletype;
 
     if (f->writable == 0 || *f->cgp->cgroup_dir_path == 0 || n > MAX_BUF)
         return -1;
@@ -1226,6 +1813,9 @@ int unsafe_cg_write(struct file * f, char * addr, int n)
     else if (filename_const == CPU_MAX && f->cgp->cpu_controller_enabled){
         r = write_file_cpu_max(f, addr, n);
     }
+    else if (filename_const == CPU_MAX_BURST && f->cgp->cpu_controller_enabled){
+        r = write_file_cpu_max_burst(f, addr, n);
+    }
     else if (filename_const == PID_MAX && f->cgp->pid_controller_enabled){
         r = write_file_pid_max(f, addr, n);
     }
@@ -1235,22 +1825,49 @@ int unsafe_cg_write(struct file * f, char * addr, int n)
     else if (filename_const == SET_FRZ) {
         r = write_file_set_frz(f, addr, n);
     }
+    else if (filename_const == IO_MAX && f->cgp->io_controller_enabled) {
+        r = write_file_io_max(f, addr, n);
+    }
     else if (filename_const == MEM_MAX && f->cgp->mem_controller_enabled) {
         r = write_file_mem_max(f, addr, n);
     }
     else if (filename_const == MEM_MIN && f->cgp->mem_controller_enabled) {
         r = write_file_mem_min(f, addr, n);
     }
+    else if (filename_const == MEM_HIGH && f->cgp->mem_controller_enabled) {
+        r = write_file_mem_high(f, addr, n);
+    }
+    else if (filename_const == MEM_CACHE_MIN && f->cgp->mem_controller_enabled) {
+        r = write_file_mem_cache(f, addr, n, 0);
+    }
+    else if (filename_const == MEM_CACHE_MAX && f->cgp->mem_controller_enabled) {
+        r = write_file_mem_cache(f, addr, n, 1);
+    }
 
     return r;
 }
 
+unsigned int * unsafe_cg_events(struct file * f)
+{
+    switch (f->cgfiletype) {
+        case CGROUP_EVENTS:
+            return &f->cgp->events_seq;
+        case MEM_EVENTS:
+            return &f->cgp->mem_events_seq;
+        default:
+            return 0;
+    }
+}
+
 int unsafe_cg_close(struct file * file)
 {
+    struct cgroup * cgp = file->cgp;
+
+    /* The file structure may be freed by fileclose. */
     fileclose(file);
-    file->cgp->ref_count--;
-    if (file->cgp->ref_count == 0 && *file->cgp->cgroup_dir_path == 0)
-        decrement_nr_dying_descendants(file->cgp->parent);
+    cgp->ref_count--;
+    if (cgp->ref_count == 0 && *cgp->cgroup_dir_path == 0)
+        decrement_nr_dying_descendants(cgp->parent);
     return 0;
 }
 
@@ -1307,22 +1924,16 @@ int get_dir_name(char * path, char * dir_name)
 static int cg_file_size(struct file * f)
 {
     int size = 0;
-    int filename_const = get_file_name_constant(f->cgfilename);
+    int filename_const = f->cgfiletype;
 
     if (filename_const == CGROUP_PROCS) {
-        int procoff = 0;
-        while (procoff < (sizeof(f->cgp->proc) / sizeof(*f->cgp->proc))) {
-            if (f->cgp->proc[procoff] == 0) {
-                procoff++;
-                continue;
-            }
-            int i = proc_pid(f->cgp->proc[procoff]);
+        for (struct proc * p = f->cgp->procs; p; p = p->cgnext) {
+            int i = proc_pid(p);
             while (i != 0) {
                 i /= 10;
                 size++;
             }
             size++;
-            procoff++;
         }
     } else if (filename_const == CGROUP_CONTROLLERS) {
         if (f->cgp->cpu_controller_avalible)
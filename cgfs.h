@@ -15,15 +15,27 @@
 #define CGFS_STAT "cgroup.stat"
 #define CGFS_CPU_WEIGHT "cpu.weight"
 #define CGFS_CPU_MAX "cpu.max"
+#define CGFS_CPU_MAX_BURST "cpu.max.burst"
 #define CGFS_CPU_STAT "cpu.stat"
+#define CGFS_CPU_SCHED_STAT "cpu.schedstat"
+#define CGFS_CPU_PRESSURE "cpu.pressure"
 #define CGFS_PID_MAX "pid.max"
 #define CGFS_PID_CUR "pid.current"
 #define CGFS_SET_CPU "cpuset.cpus"
+#define CGFS_SET_CPU_EFFECTIVE "cpuset.cpus.effective"
 #define CGFS_SET_FRZ "cgroup.freeze"
 #define CGFS_MEM_CUR "memory.current"
 #define CGFS_MEM_MAX "memory.max"
 #define CGFS_MEM_MIN "memory.min"
 #define CGFS_MEM_STAT "memory.stat"
+#define CGFS_MEM_HIGH "memory.high"
+#define CGFS_MEM_EVENTS "memory.events"
+#define CGFS_MEM_CACHE_MIN "memory.cache.min"
+#define CGFS_MEM_CACHE_MAX "memory.cache.max"
+#define CGFS_MEM_PRESSURE "memory.pressure"
+#define CGFS_IO_PRESSURE "io.pressure"
+#define CGFS_IO_STAT "io.stat"
+#define CGFS_IO_MAX "io.max"
 
 
 typedef enum cgroup_file_name_e
@@ -40,6 +52,11 @@ typedef enum cgroup_file_name_e
     SET_FRZ,
     MEM_MAX,
     MEM_MIN,
+    CPU_MAX_BURST,
+    IO_MAX,
+    MEM_HIGH,
+    MEM_CACHE_MIN,
+    MEM_CACHE_MAX,
 
     NON_WRITABLE,
 
@@ -50,6 +67,13 @@ typedef enum cgroup_file_name_e
     PID_CUR,
     MEM_CUR,
     MEM_STAT,
+    SET_CPU_EFFECTIVE,
+    CPU_SCHED_STAT,
+    CPU_PRESSURE,
+    MEM_PRESSURE,
+    IO_PRESSURE,
+    IO_STAT,
+    MEM_EVENTS,
     INVALID_TYPE
 } cgroup_file_name_t;
 
@@ -82,7 +106,19 @@ typedef enum cgroup_file_name_e
  *    15)   "memory.current"
  *    16)   "memory.max"
  *    17)   "memory.min"
- * *  18)    cgroup directories
+ *    18)   "cpuset.cpus.effective"
+ *    19)   "cpu.max.burst"
+ *    20)   "cpu.schedstat"
+ *    21)   "cpu.pressure"
+ *    22)   "memory.pressure"
+ *    23)   "io.pressure"
+ *    24)   "io.stat"
+ *    25)   "io.max"
+ *    26)   "memory.high"
+ *    27)   "memory.events"
+ *    28)   "memory.cache.min"
+ *    29)   "memory.cache.max"
+ * *  30)    cgroup directories
  */
 int unsafe_cg_open(cg_file_type type, char * filename, struct cgroup * cgp, int omode);
 
@@ -113,7 +149,19 @@ int unsafe_cg_open(cg_file_type type, char * filename, struct cgroup * cgp, int
  *    15)   "memory.current"
  *    16)   "memory.max"
  *    17)   "memory.min"
- **   18)    cgroup directories
+ *    18)   "cpuset.cpus.effective"
+ *    19)   "cpu.max.burst"
+ *    20)   "cpu.schedstat"
+ *    21)   "cpu.pressure"
+ *    22)   "memory.pressure"
+ *    23)   "io.pressure"
+ *    24)   "io.stat"
+ *    25)   "io.max"
+ *    26)   "memory.high"
+ *    27)   "memory.events"
+ *    28)   "memory.cache.min"
+ *    29)   "memory.cache.max"
+ **   30)    cgroup directories
  */
 int unsafe_cg_read(cg_file_type type, struct file * f, char * addr, int n);
 
@@ -138,9 +186,23 @@ int unsafe_cg_read(cg_file_type type, struct file * f, char * addr, int n);
  *    8)    "cgroup.freeze"
  *    9)    "memory.max"
  *   10)    "memory.min"
+ *   11)    "cpu.max.burst"
+ *   12)    "io.max"
+ *   13)    "memory.high"
+ *   14)    "memory.cache.min"
+ *   15)    "memory.cache.max"
  */
 int unsafe_cg_write(struct file * f, char * addr, int n);
 
+/**
+ * This function returns the counter of changes of the events a cgroup filesystem file reports.
+ * Receives file struct pointer parameter "f".
+ * Return values:
+ * pointer to the counter of the cgroup for "cgroup.events" and "memory.events".
+ * 0 for any other file.
+ */
+unsigned int * unsafe_cg_events(struct file * f);
+
 /**
  * This function closes a cgroup filesystem file or directory.
  * Executes fileclose() function from "file.c".
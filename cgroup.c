@@ -2,21 +2,46 @@
 #include "cgfs.h"
 #include "spinlock.h"
 #include "memlayout.h"
+#include "steady_clock.h"
+#include "fs.h"
+#include "file.h"
 
 #define MAX_DES_DEF 64
 #define MAX_DEP_DEF 64
 #define MAX_CGROUP_FILE_NAME_LENGTH 64
 #define CGROUP_ACCOUNT_PERIOD_100MS (100 * 1000)
+#define CGROUP_PATH_HASH_SIZE 32 // Power of two.
 
 struct
 {
     struct spinlock lock;
-    struct cgroup cgroups[NPROC];
+    struct cgroup cgroups[NCGROUP];
+    struct cgroup * path_hash[CGROUP_PATH_HASH_SIZE]; /* Cgroups with a path,
+                                                         by its hash.*/
 } cgtable;
 
+// Pollers of cgroup.events and memory.events sleep on cgevents. Events
+// happen with the process table or the cgroup table locked, so instead of
+// waking the pollers right away, which needs the process table lock, they
+// are woken by the next timer tick.
+static struct
+{
+    struct spinlock lock; /* Orders pollers going to sleep before the tick wakes them.*/
+    int pending;          /* Whether events happened since the last wakeup.*/
+    int nr_timed;         /* Pollers with a timeout, woken on every tick.*/
+} cgevents;
+
 void cginit(void)
 {
     initlock(&cgtable.lock, "cgtable");
+    initlock(&cgevents.lock, "cgevents");
+}
+
+/*Record a change of an events file of a cgroup, seq being its counter.*/
+static void cgroup_events_notify(unsigned int * seq)
+{
+    (*seq)++;
+    cgevents.pending = 1;
 }
 
 void cgroup_lock()
@@ -29,17 +54,56 @@ void cgroup_unlock()
     release(&cgtable.lock);
 }
 
+// FNV-1a hash of a formatted path.
+static unsigned int cgroup_path_hash(char * path)
+{
+    unsigned int hash = 2166136261u;
+
+    while (*path)
+        hash = (hash ^ (unsigned char)*path++) * 16777619u;
+    return hash;
+}
+
+static struct cgroup ** cgroup_path_bucket(unsigned int hash)
+{
+    return &cgtable.path_hash[hash & (CGROUP_PATH_HASH_SIZE - 1)];
+}
+
+/*Remove the cgroup from the path hash, if it is there.*/
+static void unsafe_cgroup_path_unhash(struct cgroup * cgroup)
+{
+    struct cgroup ** pp = cgroup_path_bucket(cgroup->path_hash);
+
+    for (; *pp; pp = &(*pp)->path_next)
+        if (*pp == cgroup) {
+            *pp = cgroup->path_next;
+            break;
+        }
+    cgroup->path_next = 0;
+}
+
+/*Clear the path of the cgroup, so it no longer names a directory.*/
+static void unsafe_clear_cgroup_dir_path(struct cgroup * cgroup)
+{
+    unsafe_cgroup_path_unhash(cgroup);
+    *(cgroup->cgroup_dir_path) = '\0';
+}
+
 static struct cgroup * unsafe_get_cgroup_by_path(char * path)
 {
     char fpath[MAX_PATH_LENGTH];
+    unsigned int hash;
+    struct cgroup * cgp;
     format_path(fpath, path);
 
-    if (*fpath != 0)
-        for (int i = 0;
-             i < sizeof(cgtable.cgroups) / sizeof(cgtable.cgroups[0]);
-             i++)
-            if (strcmp(cgtable.cgroups[i].cgroup_dir_path, fpath) == 0)
-                return &cgtable.cgroups[i];
+    if (*fpath == 0)
+        return 0;
+
+    hash = cgroup_path_hash(fpath);
+    for (cgp = *cgroup_path_bucket(hash); cgp; cgp = cgp->path_next)
+        if (cgp->path_hash == hash &&
+            strcmp(cgp->cgroup_dir_path, fpath) == 0)
+            return cgp;
 
     return 0;
 }
@@ -49,37 +113,58 @@ static void unsafe_set_cgroup_dir_path(struct cgroup * cgroup, char * path)
     char fpath[MAX_PATH_LENGTH];
     format_path(fpath, path);
     char * fpathp = fpath;
+    struct cgroup ** bucket;
     char * cgroup_dir_path = cgroup->cgroup_dir_path;
     if (*fpathp != 0)
         for (int i = 0; (i < sizeof(cgroup->cgroup_dir_path)) &&
                         ((*cgroup_dir_path++ = *fpathp++) != 0);
              i++)
             ;
+
+    /*Rehash the cgroup under its new path.*/
+    if (*fpath == 0)
+        return;
+    unsafe_cgroup_path_unhash(cgroup);
+    cgroup->path_hash = cgroup_path_hash(cgroup->cgroup_dir_path);
+    bucket = cgroup_path_bucket(cgroup->path_hash);
+    cgroup->path_next = *bucket;
+    *bucket = cgroup;
+}
+
+static int unsafe_cgroup_has_proc(struct cgroup * cgroup, struct proc * proc)
+{
+    // A process is linked into at most one list, the one of proc->cgroup.
+    return proc->cgroup == cgroup && (cgroup->procs == proc || proc->cgprev);
 }
 
 static void unsafe_cgroup_erase(struct cgroup * cgroup, struct proc * proc)
 {
-    // Iterate all cgroup processes.
-    for (unsigned int i = 0;
-         i < sizeof(cgroup->proc) / sizeof(*cgroup->proc);
-         ++i) {
-        // If process was found, remove it from the cgroup.
-        if (proc == cgroup->proc[i]) {
-            proc->cgroup = cgroup_root();
-            cgroup->proc[i] = 0;
-
-            // Update current number of processes in cgroup subtree for all
-            // ancestors.
-            while (cgroup != 0) {
-                cgroup->num_of_procs--;
-                cgroup->current_mem -= proc->sz;
-                cgroup->current_page -= PGROUNDUP(proc->sz)/PGSIZE;
-                if (cgroup->num_of_procs == 0)
-                    cgroup->populated = 0;
-                cgroup = cgroup->parent;
-            }
-            break;
+    if (!unsafe_cgroup_has_proc(cgroup, proc))
+        return;
+
+    // Unlink the process from the cgroup process list.
+    if (proc->cgprev)
+        proc->cgprev->cgnext = proc->cgnext;
+    else
+        cgroup->procs = proc->cgnext;
+    if (proc->cgnext)
+        proc->cgnext->cgprev = proc->cgprev;
+    else
+        cgroup->procs_tail = proc->cgprev;
+    proc->cgnext = proc->cgprev = 0;
+    proc->cgroup = cgroup_root();
+
+    // Update current number of processes in cgroup subtree for all
+    // ancestors.
+    while (cgroup != 0) {
+        cgroup->num_of_procs--;
+        cgroup->current_mem -= PROC_CHARGED_MEM(proc);
+        cgroup->current_page -= PGROUNDUP(PROC_CHARGED_MEM(proc))/PGSIZE;
+        if (cgroup->num_of_procs == 0) {
+            cgroup->populated = 0;
+            cgroup_events_notify(&cgroup->events_seq);
         }
+        cgroup = cgroup->parent;
     }
 }
 
@@ -90,9 +175,11 @@ void format_path(char * buf, char * path)
     struct proc * curproc = myproc();
     char * bufp = buf;
     if (*path != '/') {
-        char * cwdp = curproc->cwdp;
+        acquire(&curproc->files->lock);
+        char * cwdp = curproc->files->cwdp;
         strncpy(bufp, cwdp, strlen(cwdp));
         bufp += strlen(cwdp);
+        release(&curproc->files->lock);
         if (*(bufp - 1) != '/')
             *bufp++ = '/';
     }
@@ -236,8 +323,14 @@ int cgroup_delete(char * path, char * type)
     if (cgp != cgroup_root() && cgp -> mem_controller_enabled)
         set_min_mem(cgp, 0);
 
-    /*Delete the path.*/
-    *(cgp->cgroup_dir_path) = '\0';
+    /*Hand the cached blocks of the cgroup to its parent.*/
+    if (cgp != cgroup_root())
+        breparent(cgp);
+
+    /*Delete the path, and let pollers of the cgroup see it is gone.*/
+    unsafe_clear_cgroup_dir_path(cgp);
+    cgroup_events_notify(&cgp->events_seq);
+    cgroup_events_notify(&cgp->mem_events_seq);
 
     char increase_num_dying_desc = 0;
     if (cgp->ref_count > 0)
@@ -264,7 +357,7 @@ void cgroup_initialize(struct cgroup * cgroup,
         cgroup->cpu_controller_avalible = 1;
         cgroup->cpu_controller_enabled = 1;
         cgroup->depth = 0;
-        *(cgroup->cgroup_dir_path) = 0;
+        unsafe_clear_cgroup_dir_path(cgroup);
         cgroup->parent = 0;
         cgroup->pid_controller_avalible = 1;
         cgroup->pid_controller_enabled = 1;
@@ -272,6 +365,8 @@ void cgroup_initialize(struct cgroup * cgroup,
         cgroup->set_controller_enabled = 0;
         cgroup->mem_controller_avalible = 1;
         cgroup->mem_controller_enabled = 1;
+        cgroup->io_controller_avalible = 1;
+        cgroup->io_controller_enabled = 1;
     }
     else {
         cgroup->parent = parent_cgroup;
@@ -308,6 +403,14 @@ void cgroup_initialize(struct cgroup * cgroup,
         else
           cgroup->mem_controller_avalible = 0;
 
+        /*Cgroup's io controller avalible only when it is enabled in the
+         * parent.*/
+        if (parent_cgroup->io_controller_enabled)
+            cgroup->io_controller_avalible = 1;
+        else
+            cgroup->io_controller_avalible = 0;
+
+        cgroup->io_controller_enabled = 0;
         cgroup->pid_controller_enabled = 0;
         cgroup->cpu_controller_enabled = 0;
         cgroup->set_controller_enabled = 0;
@@ -317,6 +420,8 @@ void cgroup_initialize(struct cgroup * cgroup,
     }
 
     cgroup->ref_count = 0;
+    cgroup->procs = 0;
+    cgroup->procs_tail = 0;
     cgroup->num_of_procs = 0;
     cgroup->populated = 0;
     cgroup->current_mem = 0;
@@ -326,8 +431,8 @@ void cgroup_initialize(struct cgroup * cgroup,
     set_nr_dying_descendants(cgroup, 0);
     // Without any changes, set the maximum number of processes to max in system
     set_max_procs(cgroup, NPROC);
-    // Without any changes, set the default cpu id to be used as 0
-    set_cpu_id(cgroup, 0);
+    // Without any changes, set the default cpu to be used as 0
+    set_cpus(cgroup, 1 << 0);
     // By default a group is not frozen
     frz_grp(cgroup, 0);
 
@@ -339,6 +444,16 @@ void cgroup_initialize(struct cgroup * cgroup,
     // By default a group has limit of KERNBASE memory.
     set_max_mem(cgroup, KERNBASE);
 
+    // By default a group may use the whole buffer cache and keeps none of it.
+    // Its cached blocks, kept by the buffer cache, were handed to the parent
+    // when the group in this slot was deleted.
+    cgroup->cache_min = 0;
+    cgroup->cache_max = NBUF;
+
+    // By default allocations are not throttled.
+    set_high_mem(cgroup, KERNBASE);
+    memset(cgroup->mem_events, 0, sizeof(cgroup->mem_events));
+
     // By default a group has minimum 0 memory.
     set_min_mem(cgroup, 0);
     cgroup->current_page = 0;
@@ -347,13 +462,32 @@ void cgroup_initialize(struct cgroup * cgroup,
     cgroup->cpu_account_frame = 0;
     cgroup->cpu_percent = 0;
     cgroup->cpu_time = 0;
+    cgroup->cpu_user_time = 0;
+    cgroup->cpu_system_time = 0;
     cgroup->cpu_period_time = 0;
     cgroup->cpu_time_limit = ~0;
+    cgroup->cpu_burst = 0;
+    cgroup->cpu_runtime = 0;
+    cgroup->cpu_period_start = 0;
     cgroup->cpu_account_period = CGROUP_ACCOUNT_PERIOD_100MS;
     cgroup->cpu_nr_periods = 0;
     cgroup->cpu_nr_throttled = 0;
     cgroup->cpu_throttled_usec = 0;
-    cgroup->cpu_is_throttled_period = 0;
+    cgroup->cpu_throttled_at = 0;
+    cgroup->cpu_is_throttled = 0;
+
+    cgroup->sched_run_delay = 0;
+    cgroup->sched_max_wait = 0;
+    cgroup->sched_nvcsw = 0;
+    cgroup->sched_nivcsw = 0;
+    cgroup->sched_migrations = 0;
+
+    memset(&cgroup->psi, 0, sizeof(cgroup->psi));
+
+    memset(cgroup->io, 0, sizeof(cgroup->io));
+    for (int i = 0; i < NIODEVS; i++)
+        for (int j = 0; j < NR_IO_LIMITS; j++)
+            cgroup->io[i].max[j] = ~0;
 }
 
 int cgroup_insert(struct cgroup * cgroup, struct proc * proc)
@@ -373,48 +507,30 @@ int unsafe_cgroup_insert(struct cgroup * cgroup, struct proc * proc)
 
     // If the process memory in addition to existing memory is over the limit and memory controller is enabled, return error.
     if (cgroup->mem_controller_enabled == 1 &&
-      (cgroup->current_mem + proc->sz) > cgroup->max_mem)
+      (cgroup->current_mem + PROC_CHARGED_MEM(proc)) > cgroup->max_mem)
       return -1;
 
-    // Whether a free slot was found.
-    int found = 0;
-
-    // Index of the free slot.
-    unsigned int index = 0;
-
-    // Find available slot.
-    for (unsigned int i = 0;
-         i < sizeof(cgroup->proc) / sizeof(*cgroup->proc);
-         ++i) {
-        // If not found yet, and the current entry is available, save the
-        // index and indicate that an entry was found.
-        if (!found && !cgroup->proc[i]) {
-            index = i;
-            found = 1;
-            continue;
-        }
-
-        // If process was found, return success.
-        if (proc == cgroup->proc[i]) {
-            return 0;
-        }
-    }
-
-    // If not found, return a failure.
-    if (!found) {
-        return -1;
+    // If process is already in the cgroup, return success.
+    if (unsafe_cgroup_has_proc(cgroup, proc)) {
+        return 0;
     }
 
     // Erase the proc from the other cgroup.
     if (proc->cgroup) {
-        if (protect_memory(proc->cgroup, cgroup, proc->sz)!=0) {
+        if (protect_memory(proc->cgroup, cgroup, PROC_CHARGED_MEM(proc))!=0) {
             return -1;
         }
         unsafe_cgroup_erase(proc->cgroup, proc);
     }
 
     // Associate the process with the cgroup.
-    cgroup->proc[index] = proc;
+    proc->cgnext = 0;
+    proc->cgprev = cgroup->procs_tail;
+    if (cgroup->procs_tail)
+        cgroup->procs_tail->cgnext = proc;
+    else
+        cgroup->procs = proc;
+    cgroup->procs_tail = proc;
 
     // Set the cgroup of the current process.
     proc->cgroup = cgroup;
@@ -423,9 +539,12 @@ int unsafe_cgroup_insert(struct cgroup * cgroup, struct proc * proc)
     // ancestors.
     while (cgroup != 0) {
         cgroup->num_of_procs++;
-        cgroup->populated = 1;
-        cgroup->current_mem += proc->sz;
-        cgroup->current_page += PGROUNDUP(proc->sz)/PGSIZE;
+        if (!cgroup->populated) {
+            cgroup->populated = 1;
+            cgroup_events_notify(&cgroup->events_seq);
+        }
+        cgroup->current_mem += PROC_CHARGED_MEM(proc);
+        cgroup->current_page += PGROUNDUP(PROC_CHARGED_MEM(proc))/PGSIZE;
         cgroup = cgroup->parent;
     }
     return 0;
@@ -648,6 +767,31 @@ void decrement_nr_dying_descendants(struct cgroup * cgroup)
     }
 }
 
+void cgroup_psi_sample(unsigned int delta, unsigned int period)
+{
+    struct cgroup * cgroup;
+    struct cgroup * ancestor;
+    struct proc * p;
+
+    // Count each process in its cgroup and all the ancestors.
+    for (cgroup = cgtable.cgroups;
+         cgroup < &cgtable.cgroups[NELEM(cgtable.cgroups)];
+         cgroup++)
+        for (p = cgroup->procs; p; p = p->cgnext)
+            for (ancestor = cgroup; ancestor; ancestor = ancestor->parent)
+                psi_group_account(&ancestor->psi, p);
+
+    for (cgroup = cgtable.cgroups;
+         cgroup < &cgtable.cgroups[NELEM(cgtable.cgroups)];
+         cgroup++) {
+        if (*cgroup->cgroup_dir_path == 0)
+            continue;
+        psi_group_record(&cgroup->psi, delta);
+        if (period)
+            psi_group_average(&cgroup->psi, period);
+    }
+}
+
 int cg_open(cg_file_type type, char * filename, struct cgroup * cgp, int omode)
 {
     acquire(&cgtable.lock);
@@ -704,6 +848,48 @@ int cg_stat(struct file * f, struct stat * st)
     return res;
 }
 
+int cg_poll(struct file * f, int timeout)
+{
+    struct proc * p = myproc();
+    unsigned int * seq;
+    unsigned int start;
+    int changed;
+
+    if (timeout < -1)
+        return -1;
+
+    acquire(&cgtable.lock);
+    seq = unsafe_cg_events(f);
+    release(&cgtable.lock);
+    if (seq == 0)
+        return -1;
+
+    acquire(&cgevents.lock);
+    if (timeout >= 0)
+        cgevents.nr_timed++;
+    start = ticks;
+    while (!(changed = *seq != f->events_seq) && !p->killed &&
+           (timeout < 0 || ticks - start < timeout))
+        sleep(&cgevents, &cgevents.lock);
+    if (timeout >= 0)
+        cgevents.nr_timed--;
+    release(&cgevents.lock);
+
+    if (changed)
+        return 1;
+    return p->killed ? -1 : 0;
+}
+
+void cgroup_events_tick(void)
+{
+    acquire(&cgevents.lock);
+    if (cgevents.pending || cgevents.nr_timed) {
+        cgevents.pending = 0;
+        wakeup(&cgevents);
+    }
+    release(&cgevents.lock);
+}
+
 int set_max_procs(struct cgroup * cgroup, int limit) {
     // If no cgroup found, return error.
     if (cgroup == 0)
@@ -793,15 +979,38 @@ int disable_pid_controller(struct cgroup * cgroup)
     return res;
 }
 
-int set_cpu_id(struct cgroup * cgroup, int cpuid) {
+/*Recompute the effective cpus of the cgroup and its descendants. A cgroup
+ * without the cpu set controller, or whose cpus are all outside of its
+ * parent's, runs wherever its parent may.*/
+static void update_cpus_effective(struct cgroup * cgroup)
+{
+    unsigned int parent_cpus = ~0;
+
+    if (cgroup->parent)
+        parent_cpus = cgroup->parent->cpus_effective;
+    if (cgroup->set_controller_enabled && (cgroup->cpus & parent_cpus))
+        cgroup->cpus_effective = cgroup->cpus & parent_cpus;
+    else
+        cgroup->cpus_effective = parent_cpus;
+
+    for (int i = 1;
+         i < sizeof(cgtable.cgroups) / sizeof(cgtable.cgroups[0]);
+         i++)
+        if (cgtable.cgroups[i].parent == cgroup &&
+            *cgtable.cgroups[i].cgroup_dir_path)
+            update_cpus_effective(&cgtable.cgroups[i]);
+}
+
+int set_cpus(struct cgroup * cgroup, unsigned int cpus) {
     // If no cgroup found, return error.
     if (cgroup == 0)
         return -1;
 
-    // Set the cpu id if it is within allowed parameters.
+    // Set the cpus if they are within allowed parameters.
     // NCPU+1 is used for testing, since this cpu id can never be in the system.
-    if (cpuid >= 0 && cpuid <= NCPU + 1) {
-        cgroup->cpu_to_use = cpuid;
+    if (cpus != 0 && (cpus >> (NCPU + 2)) == 0) {
+        cgroup->cpus = cpus;
+        update_cpus_effective(cgroup);
         return 1;
     }
 
@@ -822,6 +1031,7 @@ int unsafe_enable_set_controller(struct cgroup *cgroup) {
     if (cgroup->set_controller_avalible) {
         // Set cpu set controller to enabled.
         cgroup->set_controller_enabled = 1;
+        update_cpus_effective(cgroup);
         // Set cpu set controller to avalible in all child cgroups.
         for (int i = 1;
              i < sizeof(cgtable.cgroups) / sizeof(cgtable.cgroups[0]);
@@ -855,6 +1065,7 @@ int unsafe_disable_set_controller(struct cgroup *cgroup) {
 
     // Set cpu set controller to disabled.
     cgroup->set_controller_enabled = 0;
+    update_cpus_effective(cgroup);
 
     // Set cpu set controller to unavalible in all child cgroups.
     for (int i = 1;
@@ -889,6 +1100,8 @@ int frz_grp(struct cgroup * cgroup, int frz) {
 
     // Freeze/unfreeze cgroup based on input.
     if (frz == 1 || frz == 0) {
+        if (cgroup->is_frozen != frz)
+            cgroup_events_notify(&cgroup->events_seq);
         cgroup->is_frozen = frz;
         return 1;
     }
@@ -911,6 +1124,45 @@ int set_max_mem(struct cgroup* cgroup, unsigned int limit) {
   return 0;
 }
 
+int set_high_mem(struct cgroup* cgroup, unsigned int limit) {
+    // If no cgroup found, return error.
+    if (cgroup == 0)
+        return -1;
+
+    if (limit <= KERNBASE) {
+        cgroup->high_mem = limit;
+        return 1;
+    }
+
+    return 0;
+}
+
+int set_cache_min(struct cgroup* cgroup, unsigned int limit) {
+    // If no cgroup found, return error.
+    if (cgroup == 0)
+        return -1;
+
+    if (limit <= cgroup->cache_max) {
+        cgroup->cache_min = limit;
+        return 1;
+    }
+
+    return 0;
+}
+
+int set_cache_max(struct cgroup* cgroup, unsigned int limit) {
+    // If no cgroup found, return error.
+    if (cgroup == 0)
+        return -1;
+
+    if (limit <= NBUF && limit >= cgroup->cache_min) {
+        cgroup->cache_max = limit;
+        return 1;
+    }
+
+    return 0;
+}
+
 int set_min_mem(struct cgroup* cgroup, unsigned int limit) {
     // If no cgroup found, return error.
     if (cgroup == 0)
@@ -1002,6 +1254,9 @@ int unsafe_disable_mem_controller(struct cgroup* cgroup) {
   // set limits to default
   set_min_mem(cgroup, 0);
   set_max_mem(cgroup, KERNBASE);
+  set_high_mem(cgroup, KERNBASE);
+  set_cache_min(cgroup, 0);
+  set_cache_max(cgroup, NBUF);
 
   // Set memory controller to unavalible in all child cgroups.
   for (int i = 1;
@@ -1029,6 +1284,89 @@ int disable_mem_controller(struct cgroup* cgroup)
   return res;
 }
 
+/*Memory of the cgroup subtree counted against its limits: process memory
+ * and the blocks of the buffer cache charged to it, which reclaim frees.*/
+static unsigned int mem_usage(struct cgroup * cgroup)
+{
+    return cgroup->current_mem + cgroup->mem_stat_file * BSIZE;
+}
+
+/*Return the cgroup or ancestor with the memory controller enabled whose
+ * memory.high, or memory.max if high is 0, is crossed by size more bytes,
+ * or 0 if there is none.*/
+static struct cgroup * mem_over_limit(struct cgroup * cgroup, unsigned int size, int high)
+{
+    for (; cgroup; cgroup = cgroup->parent)
+        if (cgroup->mem_controller_enabled &&
+            mem_usage(cgroup) + size > (high ? cgroup->high_mem : cgroup->max_mem))
+            return cgroup;
+    return 0;
+}
+
+/*Count a memory event in the cgroup and its ancestors.*/
+static void mem_event(struct cgroup * cgroup, int event)
+{
+    acquire(&cgtable.lock);
+    for (; cgroup; cgroup = cgroup->parent) {
+        cgroup->mem_events[event]++;
+        cgroup_events_notify(&cgroup->mem_events_seq);
+    }
+    release(&cgtable.lock);
+}
+
+/*Blocks of cache to reclaim for the cgroup to fit size more bytes under limit.*/
+static int mem_reclaim_blocks(struct cgroup * cgroup, unsigned int size, unsigned int limit)
+{
+    unsigned int excess = mem_usage(cgroup) + size - limit;
+    return (excess + BSIZE - 1) / BSIZE;
+}
+
+int cgroup_mem_charge(struct cgroup * cgroup, unsigned int size)
+{
+    struct proc * p = myproc();
+    struct cgroup * over;
+    unsigned long long excess;
+    unsigned int delay, start;
+    int psi;
+
+    // Over memory.high the allocation goes through, but the group gives
+    // up cache and is slowed down the more the further it is over.
+    if ((over = mem_over_limit(cgroup, size, 1)) != 0) {
+        mem_event(over, MEM_EVENT_HIGH);
+        breclaim(over, mem_reclaim_blocks(over, size, over->high_mem));
+        // The reclaimed cache may have brought the group back under.
+        excess = mem_usage(over) + size;
+        excess = excess > over->high_mem ? excess - over->high_mem : 0;
+        delay = excess ? 1 + excess * CGROUP_MEM_HIGH_MAX_DELAY /
+                             (over->high_mem > PGSIZE ? over->high_mem : PGSIZE)
+                       : 0;
+        if (delay > CGROUP_MEM_HIGH_MAX_DELAY)
+            delay = CGROUP_MEM_HIGH_MAX_DELAY;
+
+        psi = psi_enter(PSI_MEMSTALL);
+        acquire(&tickslock);
+        start = ticks;
+        while (!p->killed && ticks - start < delay)
+            sleep(&ticks, &tickslock);
+        release(&tickslock);
+        psi_leave(psi);
+    }
+
+    // Over memory.max the group must make room before the allocation.
+    if ((over = mem_over_limit(cgroup, size, 0)) != 0) {
+        mem_event(over, MEM_EVENT_MAX);
+        breclaim(over, mem_reclaim_blocks(over, size, over->max_mem));
+    }
+    while (!p->killed && (over = mem_over_limit(cgroup, size, 0)) != 0) {
+        mem_event(over, MEM_EVENT_OOM);
+        if (oom_kill(over) < 0)
+            return -1;
+        mem_event(over, MEM_EVENT_OOM_KILL);
+    }
+
+    return p->killed ? -1 : 0;
+}
+
 void cgroup_mem_stat_file_dirty_incr(struct cgroup* cgroup)
 {
     if (cgroup != cgroup_root() && cgroup != 0 && cgroup->populated == 1) {
@@ -1063,3 +1401,198 @@ void cgroup_mem_stat_pgmajfault_incr(struct cgroup* cgroup)
         cgroup->mem_stat_pgmajfault++;
     }
 }
+
+int unsafe_enable_io_controller(struct cgroup *cgroup) {
+    // If cgroup has processes in it, controllers can't be enabled.
+    if (cgroup == 0 || cgroup->populated == 1) {
+        return -1;
+    }
+
+    // If controller is enabled do nothing.
+    if (cgroup->io_controller_enabled) {
+        return 0;
+    }
+
+    if (cgroup->io_controller_avalible) {
+        // Set io controller to enabled.
+        cgroup->io_controller_enabled = 1;
+        // Set io controller to avalible in all child cgroups.
+        for (int i = 1;
+                i < sizeof(cgtable.cgroups) / sizeof(cgtable.cgroups[0]);
+                i++)
+            if (cgtable.cgroups[i].parent == cgroup)
+                cgtable.cgroups[i].io_controller_avalible = 1;
+    }
+
+    return 0;
+}
+
+int unsafe_disable_io_controller(struct cgroup *cgroup) {
+    if (cgroup == 0) {
+        return -1;
+    }
+
+    // If controller is disabled do nothing.
+    if (cgroup->io_controller_enabled == 0) {
+        return 0;
+    }
+
+    // Check that all child cgroups have io controller disabled. (cannot
+    // disable controller when children have it enabled)
+    for (int i = 1;
+            i < sizeof(cgtable.cgroups) / sizeof(cgtable.cgroups[0]);
+            i++)
+        if (cgtable.cgroups[i].parent == cgroup &&
+                cgtable.cgroups[i].io_controller_enabled) {
+            return -1;
+        }
+
+    // Set io controller to disabled and remove the limits.
+    cgroup->io_controller_enabled = 0;
+    for (int i = 0; i < NIODEVS; i++)
+        for (int j = 0; j < NR_IO_LIMITS; j++)
+            cgroup->io[i].max[j] = ~0;
+
+    // Set io controller to unavalible in all child cgroups.
+    for (int i = 1;
+            i < sizeof(cgtable.cgroups) / sizeof(cgtable.cgroups[0]);
+            i++)
+        if (cgtable.cgroups[i].parent == cgroup)
+            cgtable.cgroups[i].io_controller_avalible = 0;
+
+    return 0;
+}
+
+int enable_io_controller(struct cgroup * cgroup)
+{
+    acquire(&cgtable.lock);
+    int res = unsafe_enable_io_controller(cgroup);
+    release(&cgtable.lock);
+    return res;
+}
+
+int disable_io_controller(struct cgroup * cgroup)
+{
+    acquire(&cgtable.lock);
+    int res = unsafe_disable_io_controller(cgroup);
+    release(&cgtable.lock);
+    return res;
+}
+
+/*Refill the io budgets of a device with the limit of every second that
+ * passed, keeping at most one second worth.*/
+static void io_refill(struct cgroup_io * io, unsigned int now)
+{
+    unsigned int elapsed = now - io->budget_stamp;
+    unsigned long long refill;
+
+    io->budget_stamp = now;
+    for (int i = 0; i < NR_IO_LIMITS; i++) {
+        if (io->max[i] == ~0)
+            continue;
+        refill = (unsigned long long)io->max[i] * elapsed / 1000000;
+        if (refill >= (long long)io->max[i] - io->budget[i])
+            io->budget[i] = io->max[i];
+        else
+            io->budget[i] += refill;
+    }
+}
+
+int unsafe_set_io_max(struct cgroup * cgroup, unsigned int dev, unsigned int * max)
+{
+    struct cgroup_io * io;
+    int i;
+
+    if (DEV_TO_IO_INDEX(dev) >= NIODEVS)
+        return -1;
+    for (i = 0; i < NR_IO_LIMITS; i++)
+        if (max[i] != 0 && max[i] != ~0 && max[i] > CGROUP_IO_MAX_LIMIT)
+            return -1;
+
+    // Start the new limits with a full budget.
+    io = &cgroup->io[DEV_TO_IO_INDEX(dev)];
+    for (i = 0; i < NR_IO_LIMITS; i++) {
+        if (max[i] == 0)
+            continue;
+        io->max[i] = max[i];
+        io->budget[i] = max[i];
+    }
+    io->budget_stamp = steady_clock_now();
+    return 1;
+}
+
+void cgroup_io_charge(struct cgroup * cgroup, unsigned int dev, int write, unsigned int bytes)
+{
+    unsigned int now = steady_clock_now();
+    struct cgroup_io * io;
+
+    if (cgroup == 0 || DEV_TO_IO_INDEX(dev) >= NIODEVS)
+        return;
+
+    acquire(&cgtable.lock);
+    for (; cgroup; cgroup = cgroup->parent) {
+        io = &cgroup->io[DEV_TO_IO_INDEX(dev)];
+        if (write) {
+            io->wbytes += bytes;
+            io->wios++;
+        } else {
+            io->rbytes += bytes;
+            io->rios++;
+        }
+
+        // Only the limits of the group take from its budgets.
+        if (!cgroup->io_controller_enabled)
+            continue;
+        io_refill(io, now);
+        if (io->max[write ? IO_WBPS : IO_RBPS] != ~0)
+            io->budget[write ? IO_WBPS : IO_RBPS] -= bytes;
+        if (io->max[write ? IO_WIOPS : IO_RIOPS] != ~0)
+            io->budget[write ? IO_WIOPS : IO_RIOPS]--;
+    }
+    release(&cgtable.lock);
+}
+
+/*Return whether the cgroup or an ancestor overran a read or write limit on
+ * the device with the given index, or on any device for index -1.*/
+static int io_overrun(struct cgroup * cgroup, int index, int write)
+{
+    unsigned int now = steady_clock_now();
+    int bps = write ? IO_WBPS : IO_RBPS;
+    int iops = write ? IO_WIOPS : IO_RIOPS;
+    struct cgroup_io * io;
+    int overrun = 0;
+
+    acquire(&cgtable.lock);
+    for (; cgroup && !overrun; cgroup = cgroup->parent) {
+        if (!cgroup->io_controller_enabled)
+            continue;
+        for (int i = 0; i < NIODEVS && !overrun; i++) {
+            if (index != -1 && i != index)
+                continue;
+            io = &cgroup->io[i];
+            io_refill(io, now);
+            overrun = (io->max[bps] != ~0 && io->budget[bps] < 0) ||
+                      (io->max[iops] != ~0 && io->budget[iops] < 0);
+        }
+    }
+    release(&cgtable.lock);
+    return overrun;
+}
+
+void cgroup_io_throttle(int dev, int write)
+{
+    struct proc * p = myproc();
+    int index = dev == -1 ? -1 : DEV_TO_IO_INDEX(dev);
+    int psi;
+
+    if (p == 0 || index >= NIODEVS)
+        return;
+
+    // Wait a tick at a time for the budgets to be refilled.
+    psi = psi_enter(PSI_IOWAIT);
+    acquire(&tickslock);
+    while (!p->killed && io_overrun(p->cgroup, index, write))
+        sleep(&ticks, &tickslock);
+    release(&tickslock);
+    psi_leave(psi);
+}
@@ -1,6 +1,8 @@
 #include "param.h"
 #include "proc.h"
 #include "defs.h"
+#include "psi.h"
+#include "device.h"
 
 #ifndef XV6_CGROUP_H
 #define XV6_CGROUP_H
@@ -9,20 +11,54 @@
 #define MAX_DEPTH_SIZE 3      // Max length of string representation of depth number. (the value is a number of at most two digits + null terminator)
 
 #define MAX_CONTROLLER_NAME_LENGTH 16  // Max length allowed for controller names
+#define CGROUP_CPU_MAX_LIMIT 1000000000 // Max cpu quota and burst in microseconds, their sum fits an int
 
 typedef enum { CG_FILE, CG_DIR } cg_file_type;
 
+#define IO_RBPS 0  // Read bytes per second.
+#define IO_WBPS 1  // Written bytes per second.
+#define IO_RIOPS 2 // Read requests per second.
+#define IO_WIOPS 3 // Write requests per second.
+#define NR_IO_LIMITS 4
+#define CGROUP_IO_MAX_LIMIT 0x7fffffff // Max io.max limit, so a budget fits an int
+
+#define MEM_EVENT_HIGH 0     // Allocations over memory.high.
+#define MEM_EVENT_MAX 1      // Allocations that reached memory.max.
+#define MEM_EVENT_OOM 2      // Allocations reclaim could not make room for.
+#define MEM_EVENT_OOM_KILL 3 // Processes killed to make room.
+#define NR_MEM_EVENTS 4
+#define CGROUP_MEM_HIGH_MAX_DELAY 20 // Max ticks an allocation over memory.high is delayed
+
 /**
- * Control group, contains up to NPROC processes.
+ * Block I/O of a cgroup on one device.
+ */
+struct cgroup_io
+{
+    unsigned int rbytes; /*Bytes read.*/
+    unsigned int wbytes; /*Bytes written.*/
+    unsigned int rios; /*Read requests.*/
+    unsigned int wios; /*Write requests.*/
+
+    unsigned int max[NR_IO_LIMITS]; /*Limits per second, ~0 if unlimited.*/
+    int budget[NR_IO_LIMITS]; /*What may still be submitted, negative if overrun.*/
+    unsigned int budget_stamp; /*When the budgets were last refilled.*/
+};
+
+/**
+ * Control group, contains a list of processes.
  */
 struct cgroup
 {
     char cgroup_dir_path[MAX_PATH_LENGTH]; /* Path of the cgroup
                                               directory.*/
+    unsigned int path_hash;      /* Hash of cgroup_dir_path.*/
+    struct cgroup * path_next;   /* Next cgroup of the same path hash bucket.*/
 
     int ref_count; /* Reference count.*/
 
-    struct proc * proc[NPROC]; /* Array of all processes in the cgroup.*/
+    struct proc * procs;      /* List of the processes in the cgroup,
+                                 linked through proc->cgnext.*/
+    struct proc * procs_tail; /* Last process in the procs list.*/
     int num_of_procs;          /* Number of processes in the cgroup subtree
                                   (including processes in this cgroup).*/
 
@@ -48,6 +84,11 @@ struct cgroup
     char mem_controller_enabled;  /* Is 1 if memory controller is enabled,
                                   otherwise 0.*/
 
+    char io_controller_avalible; /* Is 1 if io controller may be enabled,
+                                    otherwise 0.*/
+    char io_controller_enabled;  /* Is 1 if io controller is enabled,
+                                    otherwise 0.*/
+
     char populated; /* Is 1 if subtree has at least one process in it,
                        otherise 0.*/
 
@@ -65,32 +106,59 @@ struct cgroup
     int max_num_of_procs; /*The maximum number of processes that are allowed in the cgroup.
                             Used by pid controller.*/
 
-    uchar cpu_to_use; /*Which cpu id to use for cpu set controller.*/
+    unsigned int cpus; /*Mask of cpus to use for cpu set controller.*/
+
+    unsigned int cpus_effective; /*Mask of cpus the group may run on: its own mask
+                                   intersected with the parent's effective mask.*/
 
     int is_frozen; /*Indicates whether cgroup is frozen. */
 
+    unsigned int events_seq; /*Changes of cgroup.events, see cg_poll.*/
+    unsigned int mem_events_seq; /*Changes of memory.events, see cg_poll.*/
+
     unsigned int current_mem; /*The current amount of memory used by the group.*/
     unsigned int current_page; /*The current amount of memory used by the group in pages.*/
 
+    unsigned int mem_stat_file; /* Blocks of the buffer cache charged to the group and its descendants, protected by the buffer cache lock */
     unsigned int mem_stat_file_dirty; /* Amount of cached filesystem data that was modified but not yet written back to disk */
     unsigned int mem_stat_file_dirty_aggregated; /* Total number of cached filesystem data that was modified and written back to disk */
     unsigned int mem_stat_pgfault;/*Number of page faults incurred when the kernel dos not needs to read the data from disk*/
     unsigned int mem_stat_pgmajfault;/*Number of page faults incurred and the kernel actually needs to read the data from disk*/
 
     unsigned int max_mem; /*The maximum memory allowed for a group to use.*/
+    unsigned int high_mem; /*Memory over which allocations of the group are throttled.*/
+    unsigned int cache_min; /*Blocks of the buffer cache other groups may not take from the group.*/
+    unsigned int cache_max; /*Most blocks of the buffer cache the group may hold, NBUF if unlimited.*/
     unsigned int min_mem; /*Amount of memory that protected for this cgroup.*/
     unsigned int protected_mem; /*How meny pages of memory we need to protect for this group (e.g. min_mem - current_page).*/
+    unsigned int mem_events[NR_MEM_EVENTS]; /*Memory limit events of the group and its descendants.*/
 
     unsigned long long cpu_time;
+    unsigned long long cpu_user_time; /*Part of cpu_time spent in user mode.*/
+    unsigned long long cpu_system_time; /*Part of cpu_time spent in the kernel.*/
     unsigned int cpu_period_time;
     unsigned int cpu_percent;
     unsigned int cpu_account_period;
-    unsigned int cpu_time_limit;
+    unsigned int cpu_time_limit; /*Quota of cpu time per period, ~0 if unlimited.*/
+    unsigned int cpu_burst; /*Unused quota that may be carried over to later periods.*/
+    int cpu_runtime; /*Runtime left in the pool, negative if overrun.*/
+    unsigned int cpu_period_start; /*When the pool was last refilled.*/
     unsigned int cpu_account_frame;
     unsigned int cpu_nr_periods;
     unsigned int cpu_nr_throttled;
     unsigned int cpu_throttled_usec;
-    char cpu_is_throttled_period;
+    unsigned int cpu_throttled_at; /*When the group was throttled.*/
+    char cpu_is_throttled;
+
+    unsigned long long sched_run_delay; /*Time processes of the group spent runnable waiting for a cpu.*/
+    unsigned int sched_max_wait; /*Longest such wait of a single process.*/
+    unsigned int sched_nvcsw; /*Switches out of processes that went to sleep.*/
+    unsigned int sched_nivcsw; /*Switches out of processes that were preempted.*/
+    unsigned int sched_migrations; /*Times a process ran on a different cpu than before.*/
+
+    struct psi_group psi; /*Pressure stall information of the group.*/
+
+    struct cgroup_io io[NIODEVS]; /*Block I/O per device, see DEV_TO_IO_INDEX.*/
 };
 
 /**
@@ -304,6 +372,17 @@ void format_path(char * buf, char * path);
  */
 void decrement_nr_dying_descendants(struct cgroup * cgroup);
 
+/**
+ * This function samples the processes of every cgroup into the pressure stall
+ * information of the cgroup and its ancestors.
+ * Receives unsigned int parameters "delta" and "period".
+ * "delta" is the time in microseconds since the last sample.
+ * "period" is the length of the averaging period that ended now, or 0 if none did.
+ * Must be called with the ptable and cgroup locks held.
+ * Return value is void.
+ */
+void cgroup_psi_sample(unsigned int delta, unsigned int period);
+
 
 /**
  * Safe implementation of cgroup file manipulation functions defined in cgfs.c. (Implementation with locks)
@@ -334,6 +413,25 @@ int cg_close(struct file * file);
  */
 int cg_stat(struct file * f, struct stat * st);
 
+/**
+ * This function waits for the cgroup.events or memory.events file "f" to change.
+ * A file changes when the events it reports change after it was opened or last read.
+ * "timeout" is the most ticks to wait, or -1 to wait until a change.
+ * Changes are seen on the timer tick after they happen.
+ * Return values:
+ * - 1 if the file changed.
+ * - 0 on timeout.
+ * - -1 if the timeout is below -1, the file is not an events file or the process was killed.
+ */
+int cg_poll(struct file * f, int timeout);
+
+/**
+ * Wake the processes waiting in cg_poll for events that happened since the
+ * last tick, and those waiting with a timeout. Called on every timer tick of
+ * the first cpu.
+ */
+void cgroup_events_tick(void);
+
 /**
  * This function opens cgroup file or directory. Meant to be called in sys_open().
  * Receives string parameter "path", integer parameter "omode".
@@ -379,12 +477,13 @@ int unsafe_disable_pid_controller(struct cgroup *cgroup);
 int disable_pid_controller(struct cgroup * cgroup);
 
 /**
- * This function sets the cpu id to use.
- * Receives cgroup pointer parameter "cgroup" and integer "cpuid".
- * Sets the cpu id to "cpuid" on which the cgroup has to run.
+ * This function sets the cpus to use.
+ * Receives cgroup pointer parameter "cgroup" and mask "cpus".
+ * Sets the mask of cpu ids on which the cgroup may run to "cpus", and
+ * updates the effective masks of the cgroup and its descendants.
  * Returns 1 upon successes, 0 if no action taken, -1 upon failure.
  */
-int set_cpu_id(struct cgroup * cgroup, int cpuid);
+int set_cpus(struct cgroup * cgroup, unsigned int cpus);
 
 /**
  * These functions enables the cpu id controller of a cgroup.
@@ -410,6 +509,59 @@ int enable_set_controller(struct cgroup * cgroup);
 int unsafe_disable_set_controller(struct cgroup *cgroup);
 int disable_set_controller(struct cgroup * cgroup);
 
+/**
+ * These functions enables the io controller of a cgroup.
+ * Unsafe and safe versions of function (unsafe does not acquire cgroup table lock and safe does).
+ * Receives cgroup pointer parameter "cgroup".
+ * "cgroup" is pointer to the cgroup in which we enable the controller. Must be valid cgroup.
+ * Return values:
+ * - 0 on success.
+ * - -1 on failure.
+ */
+int unsafe_enable_io_controller(struct cgroup *cgroup);
+int enable_io_controller(struct cgroup * cgroup);
+
+/**
+ * These functions disable the io controller of a cgroup, and remove its io limits.
+ * Unsafe and safe versions of function (unsafe does not acquire cgroup table lock and safe does).
+ * Receives cgroup pointer parameter "cgroup".
+ * "cgroup" is pointer to the cgroup in which we disable the controller. Must be valid cgroup.
+ * Return values:
+ * - 0 on success.
+ * - -1 on failure.
+ */
+int unsafe_disable_io_controller(struct cgroup *cgroup);
+int disable_io_controller(struct cgroup * cgroup);
+
+/**
+ * This function sets the io limits of a cgroup on a device.
+ * Receives cgroup pointer parameter "cgroup", device number "dev" and an array "max"
+ * of NR_IO_LIMITS limits per second, indexed by IO_RBPS, IO_WBPS, IO_RIOPS and IO_WIOPS,
+ * ~0 for no limit and 0 to keep the current limit.
+ * Either every limit is set or, if one is invalid, none is.
+ * Must be called with the cgroup table lock held.
+ * Returns 1 upon successes, -1 upon failure.
+ */
+int unsafe_set_io_max(struct cgroup * cgroup, unsigned int dev, unsigned int * max);
+
+/**
+ * This function charges a block I/O request to a cgroup and its ancestors.
+ * Receives cgroup pointer parameter "cgroup", device number "dev", "write" which is
+ * nonzero for a write, and the request size "bytes".
+ * Return value is void.
+ */
+void cgroup_io_charge(struct cgroup * cgroup, unsigned int dev, int write, unsigned int bytes);
+
+/**
+ * This function delays the current process while its cgroup or an ancestor has
+ * overrun an io limit.
+ * Receives device number "dev", -1 for any device, and "write" which is nonzero
+ * to check the write limits and zero to check the read limits.
+ * Must not be called with spinlocks held.
+ * Return value is void.
+ */
+void cgroup_io_throttle(int dev, int write);
+
 /**
  * This function freezes/unfreezes a cgroup.
  * Receives cgroup pointer parameter "cgroup" and integer "frz".
@@ -426,6 +578,25 @@ int frz_grp(struct cgroup * cgroup, int frz);
  */
 int set_max_mem(struct cgroup* cgp, unsigned int limit);
 
+/**
+ *This function sets the memory throttling threshold.
+ *Receives cgroup pointer parameter "cgroup" and integer "limit".
+ *Allocations that take the cgroup over "limit" are delayed and reclaim its cached blocks.
+ *Returns 1 upon successes, 0 if no action taken, -1 upon failure.
+ */
+int set_high_mem(struct cgroup* cgp, unsigned int limit);
+
+/**
+ *These functions set the share of the buffer cache of a cgroup.
+ *Receives cgroup pointer parameter "cgroup" and the number of blocks "limit".
+ *The group keeps up to cache_min of its blocks from other groups and holds
+ *at most cache_max blocks. The minimum may not exceed the maximum, nor the
+ *maximum NBUF.
+ *Returns 1 upon successes, 0 if no action taken, -1 upon failure.
+ */
+int set_cache_min(struct cgroup* cgp, unsigned int limit);
+int set_cache_max(struct cgroup* cgp, unsigned int limit);
+
 /**
  *This function sets the minimum amount of memory.
  *Receives cgroup pointer parameter "cgroup" and integer "limit".
@@ -467,6 +638,19 @@ int enable_mem_controller(struct cgroup* cgroup);
 int unsafe_disable_mem_controller(struct cgroup* cgroup);
 int disable_mem_controller(struct cgroup* cgroup);
 
+/**
+ * Make room for the current process to use "size" more bytes of memory in
+ * "cgroup", before it grows or forks.
+ * Over memory.high of the cgroup or an ancestor, reclaims the cached blocks
+ * of the group and delays the process in proportion to the excess.
+ * Over memory.max, reclaims and then kills the process of the group using
+ * the most memory, until the memory fits. The allocating process itself is
+ * not killed, its allocation fails instead.
+ * Must be called without the cgroup table lock held.
+ * Returns 0 if the memory may be used, -1 otherwise.
+ */
+int cgroup_mem_charge(struct cgroup * cgroup, unsigned int size);
+
 /**
  * @brief Increments the cgroup Memory Controller stat of file_dirty
  *
@@ -4,11 +4,12 @@
 #include "test.h"
 #include "param.h"
 #include "mmu.h"
+#include "fs.h"
 
 #include "cgroupstests.h"
 
 char controller_names[CONTROLLER_COUNT][MAX_CONTROLLER_NAME_LENGTH] =
-  { "cpu", "pid", "set", "mem" };
+  { "cpu", "pid", "set", "mem", "io" };
 
 char suppress = 0;
 
@@ -179,42 +180,35 @@ int disable_controller(int type) {
 
 // Test verrifying a controller is active according to given type.
 int verify_controller_enabled(int type) {
-  char buf[4] = { 0 };
+  char buf[MAX_CONTROLLER_NAME_LENGTH + 1] = { 0 };
   if (!is_valid_controller_type(type)) {
     return 0;
   }
 
+  // Each enabled controller is listed on a line of its own.
   strcpy(buf, controller_names[type]);
+  strcpy(buf + strlen(buf), "\n");
 
   char* contents = read_file(TEST_1_CGROUP_SUBTREE_CONTROL, 0);
 
-  int i;
-  for (i = 0; contents[i] != 0 && i < sizeof(contents) - 2; i++) {
-    if (contents[i] == buf[0] && contents[i + 1] == buf[1] && contents[i + 2] == buf[2]) {
-      return 1;
-    }
-  }
-
-  return 0;
+  return strstr(contents, buf) != 0;
 }
 
 // Test verifying a controller is disabled according to given type.
 int verify_controller_disabled(int type) {
-  char buf[4] = { 0 };
+  char buf[MAX_CONTROLLER_NAME_LENGTH + 1] = { 0 };
   if (!is_valid_controller_type(type)) {
     return 0;
   }
 
   strcpy(buf, controller_names[type]);
+  strcpy(buf + strlen(buf), "\n");
 
   char* contents = read_file(TEST_1_CGROUP_SUBTREE_CONTROL, 0);
-  int i;
 
-  for (i = 0; contents[i + 2] != 0; i++) {
-    if (contents[i] == buf[0] && contents[i + 1] == buf[1] && contents[i + 2] == buf[2]) {
-      printf(1, "\nController %s is still enabled\n", buf);
-      return 0;
-    }
+  if (strstr(contents, buf) != 0) {
+    printf(1, "\nController %s is still enabled\n", controller_names[type]);
+    return 0;
   }
 
   return 1;
@@ -385,6 +379,20 @@ TEST(test_deleting_cgroups)
     ASSERT_FALSE(unlink(TEST_1));
 }
 
+TEST(test_recreating_cgroup_and_unknown_files)
+{
+    // A recreated cgroup is found under its path again
+    ASSERT_FALSE(unlink(TEST_2));
+    ASSERT_FALSE(open_close_file(TEST_2_MEM_MIN));
+    ASSERT_FALSE(mkdir(TEST_2));
+    ASSERT_TRUE(open_close_file(TEST_2_MEM_MIN));
+
+    // Names that only share a prefix with cgroup files do not open
+    ASSERT_TRUE(open("/cgroup/test1/cgroup.proc", O_RDWR) < 0);
+    ASSERT_TRUE(open("/cgroup/test1/cpu.stats", O_RDWR) < 0);
+    ASSERT_TRUE(open("/cgroup/test1/io.weight", O_RDWR) < 0);
+}
+
 TEST(test_opening_and_closing_cgroup_files)
 {
     ASSERT_TRUE(open_close_file(TEST_1_CGROUP_PROCS));
@@ -397,6 +405,12 @@ TEST(test_opening_and_closing_cgroup_files)
     ASSERT_TRUE(open_close_file(TEST_1_CPU_MAX));
     ASSERT_TRUE(open_close_file(TEST_1_CPU_WEIGHT));
     ASSERT_TRUE(open_close_file(TEST_1_CPU_STAT));
+    ASSERT_TRUE(open_close_file(TEST_1_CPU_SCHED_STAT));
+    ASSERT_TRUE(open_close_file(TEST_1_CPU_PRESSURE));
+    ASSERT_TRUE(open_close_file(TEST_1_MEM_PRESSURE));
+    ASSERT_TRUE(open_close_file(TEST_1_IO_PRESSURE));
+    ASSERT_TRUE(open_close_file(TEST_1_IO_STAT));
+    ASSERT_TRUE(open_close_file(TEST_1_MEM_EVENTS));
     ASSERT_TRUE(open_close_file(TEST_1_PID_MAX));
     ASSERT_TRUE(open_close_file(TEST_1_PID_CURRENT));
     ASSERT_TRUE(open_close_file(TEST_1_SET_CPU));
@@ -419,6 +433,10 @@ TEST(test_reading_cgroup_files)
     ASSERT_TRUE(read_file(TEST_1_CPU_MAX, 1));
     ASSERT_TRUE(read_file(TEST_1_CPU_WEIGHT, 1));
     ASSERT_TRUE(read_file(TEST_1_CPU_STAT, 1));
+    ASSERT_TRUE(read_file(TEST_1_CPU_SCHED_STAT, 1));
+    ASSERT_TRUE(read_file(TEST_1_CPU_PRESSURE, 1));
+    ASSERT_TRUE(read_file(TEST_1_MEM_PRESSURE, 1));
+    ASSERT_TRUE(read_file(TEST_1_IO_PRESSURE, 1));
     ASSERT_TRUE(read_file(TEST_1_PID_MAX, 1));
     ASSERT_TRUE(read_file(TEST_1_PID_CURRENT, 1));
     ASSERT_TRUE(read_file(TEST_1_SET_CPU, 1));
@@ -488,6 +506,56 @@ TEST(test_limiting_cpu_max_and_period)
     ASSERT_TRUE(disable_controller(CPU_CNT));
 }
 
+TEST(test_setting_cpu_max_burst)
+{
+    // Enable cpu controller
+    ASSERT_TRUE(enable_controller(CPU_CNT));
+
+    // Set a quota to burst over
+    ASSERT_TRUE(write_file(TEST_1_CPU_MAX, "1000,20000"));
+
+    // Update burst and check changes
+    ASSERT_TRUE(write_file(TEST_1_CPU_MAX_BURST, "500"));
+    ASSERT_FALSE(strcmp(read_file(TEST_1_CPU_MAX_BURST, 0), "burst - 500\n"));
+
+    // Burst can't be larger than the quota
+    ASSERT_FALSE(write_file(TEST_1_CPU_MAX_BURST, "2000"));
+    ASSERT_FALSE(strcmp(read_file(TEST_1_CPU_MAX_BURST, 0), "burst - 500\n"));
+
+    // Lowering the quota lowers the burst with it
+    ASSERT_TRUE(write_file(TEST_1_CPU_MAX, "200,20000"));
+    ASSERT_FALSE(strcmp(read_file(TEST_1_CPU_MAX_BURST, 0), "burst - 200\n"));
+
+    // Disable cpu controller
+    ASSERT_TRUE(disable_controller(CPU_CNT));
+}
+
+TEST(test_setting_io_max)
+{
+    // Enable io controller
+    ASSERT_TRUE(enable_controller(IO_CNT));
+
+    // No limits at first
+    ASSERT_FALSE(strcmp(read_file(TEST_1_IO_MAX, 0), ""));
+
+    // Limit read bandwidth and write requests of the root disk
+    ASSERT_TRUE(write_file(TEST_1_IO_MAX, "0:1 rbps=1048576 wiops=100"));
+    ASSERT_FALSE(strcmp(read_file(TEST_1_IO_MAX, 0), "0:1 rbps=1048576 wbps=max riops=max wiops=100\n"));
+
+    // Bad devices, keys and values are rejected
+    ASSERT_FALSE(write_file(TEST_1_IO_MAX, "0:99 rbps=1"));
+    ASSERT_FALSE(write_file(TEST_1_IO_MAX, "0:1 rbytes=1"));
+    ASSERT_FALSE(write_file(TEST_1_IO_MAX, "0:1 rbps=0"));
+    ASSERT_FALSE(write_file(TEST_1_IO_MAX, "0:1 rbps=x"));
+
+    // Removing the limits removes the line
+    ASSERT_TRUE(write_file(TEST_1_IO_MAX, "0:1 rbps=max wiops=max"));
+    ASSERT_FALSE(strcmp(read_file(TEST_1_IO_MAX, 0), ""));
+
+    // Disable io controller
+    ASSERT_TRUE(disable_controller(IO_CNT));
+}
+
 TEST(test_limiting_pids)
 {
     // Enable pid controller
@@ -640,6 +708,45 @@ TEST(test_setting_cpu_id)
     ASSERT_TRUE(disable_controller(SET_CNT));
 }
 
+TEST(test_setting_cpu_list)
+{
+    // Enable cpu set controller.
+    ASSERT_TRUE(enable_controller(SET_CNT));
+
+    // Set a list of cpus and ranges.
+    ASSERT_TRUE(write_file(TEST_1_SET_CPU, "0,2-3"));
+    ASSERT_FALSE(strcmp(read_file(TEST_1_SET_CPU, 0), "use_cpu - 0,2-3\n"));
+    ASSERT_FALSE(strcmp(read_file(TEST_1_SET_CPU_EFFECTIVE, 0), "0,2-3\n"));
+
+    // Malformed lists are rejected.
+    ASSERT_FALSE(write_file(TEST_1_SET_CPU, "3-1"));
+    ASSERT_FALSE(write_file(TEST_1_SET_CPU, "1,"));
+    ASSERT_FALSE(strcmp(read_file(TEST_1_SET_CPU, 0), "use_cpu - 0,2-3\n"));
+
+    // A child group runs on the cpus it shares with its parent, or on all
+    // of its parent's cpus if it shares none.
+    ASSERT_TRUE(write_file(TEST_1_SET_CPU, "0-1"));
+    ASSERT_FALSE(mkdir(TEST_1_NESTED));
+    ASSERT_TRUE(write_file(TEST_1_NESTED_SUBTREE_CONTROL, "+set"));
+    ASSERT_TRUE(write_file(TEST_1_NESTED_SET_CPU, "1-2"));
+    ASSERT_FALSE(strcmp(read_file(TEST_1_NESTED_SET_CPU_EFFECTIVE, 0), "1\n"));
+    ASSERT_TRUE(write_file(TEST_1_NESTED_SET_CPU, "3"));
+    ASSERT_FALSE(strcmp(read_file(TEST_1_NESTED_SET_CPU_EFFECTIVE, 0), "0-1\n"));
+
+    // Changing the parent updates the child.
+    ASSERT_TRUE(write_file(TEST_1_SET_CPU, "3"));
+    ASSERT_FALSE(strcmp(read_file(TEST_1_NESTED_SET_CPU_EFFECTIVE, 0), "3\n"));
+
+    ASSERT_TRUE(write_file(TEST_1_NESTED_SUBTREE_CONTROL, "-set"));
+    ASSERT_FALSE(unlink(TEST_1_NESTED));
+
+    // Restore default cpu id.
+    ASSERT_TRUE(write_file(TEST_1_SET_CPU, "0"));
+
+    // Disable cpu set controller.
+    ASSERT_TRUE(disable_controller(SET_CNT));
+}
+
 TEST(test_correct_cpu_running)
 {
     // Enable cpu set controller.
@@ -1282,14 +1389,186 @@ TEST(test_cant_grow_over_mem_limit)
   ASSERT_TRUE(disable_controller(MEM_CNT));
 }
 
+TEST(test_mem_high_throttles_growth)
+{
+  char mem[12];
+  char saved_high[12];
+
+  // Enable memory controller
+  ASSERT_TRUE(enable_controller(MEM_CNT));
+
+  // Copy the current high memory and remove newline at the end
+  strcpy(saved_high, read_file(TEST_1_MEM_HIGH, 0));
+  saved_high[strlen(saved_high) - 1] = '\0';
+
+  // Bad values are rejected
+  ASSERT_FALSE(write_file(TEST_1_MEM_HIGH, "abc"));
+  ASSERT_FALSE(write_file(TEST_1_MEM_HIGH, MORE_THEN_KERNBASE));
+
+  // Move the current process to "/cgroup/test1" cgroup.
+  ASSERT_TRUE(move_proc(TEST_1_CGROUP_PROCS, getpid()));
+
+  // Set memory.high to the current usage of the group
+  itoa(mem, getmem());
+  ASSERT_TRUE(write_file(TEST_1_MEM_HIGH, mem));
+  strcat(mem, "\n");
+  ASSERT_FALSE(strcmp(read_file(TEST_1_MEM_HIGH, 0), mem));
+
+  // Growing over memory.high is delayed but succeeds
+  ASSERT_FALSE((int)sbrk(PGSIZE) == -1);
+  ASSERT_TRUE(get_val(read_file(TEST_1_MEM_EVENTS, 0), "high - ") > 0);
+  ASSERT_FALSE((int)sbrk(-PGSIZE) == -1);
+
+  // Return the process to root cgroup.
+  ASSERT_TRUE(move_proc(ROOT_CGROUP_PROCS, getpid()));
+
+  // Restore memory.high
+  ASSERT_TRUE(write_file(TEST_1_MEM_HIGH, saved_high));
+
+  // Disable memory controller
+  ASSERT_TRUE(disable_controller(MEM_CNT));
+}
+
+TEST(test_mem_max_kills_largest_process)
+{
+  char mem[12];
+  char * events;
+  int pid;
+
+  // Enable memory controller
+  ASSERT_TRUE(enable_controller(MEM_CNT));
+
+  // The child grows larger than the parent and waits to be killed.
+  pid = fork();
+  if (pid == 0) {
+    sbrk(8 * PGSIZE);
+    sleep(1000);
+    exit(0);
+  }
+  sleep(5);
+
+  // Move both processes to "/cgroup/test1" cgroup.
+  ASSERT_TRUE(move_proc(TEST_1_CGROUP_PROCS, pid));
+  ASSERT_TRUE(move_proc(TEST_1_CGROUP_PROCS, getpid()));
+
+  // Limit the group to what it uses
+  strcpy(mem, read_file(TEST_1_MEM_CURRENT, 0));
+  mem[strlen(mem) - 1] = '\0';
+  ASSERT_TRUE(write_file(TEST_1_MEM_MAX, mem));
+
+  // Growing kills the child, which uses the most memory, and succeeds
+  ASSERT_FALSE((int)sbrk(PGSIZE) == -1);
+  ASSERT_UINT_EQ(wait(0), pid);
+  ASSERT_FALSE(is_pid_in_group(TEST_1_CGROUP_PROCS, pid));
+
+  events = read_file(TEST_1_MEM_EVENTS, 0);
+  ASSERT_TRUE(get_val(events, "max - ") > 0);
+  ASSERT_TRUE(get_val(events, "oom - ") > 0);
+  ASSERT_UINT_EQ(get_val(events, "oom_kill - "), 1);
+
+  ASSERT_FALSE((int)sbrk(-PGSIZE) == -1);
+
+  // Return the process to root cgroup.
+  ASSERT_TRUE(move_proc(ROOT_CGROUP_PROCS, getpid()));
+
+  // Disable memory controller, which restores memory.max
+  ASSERT_TRUE(disable_controller(MEM_CNT));
+}
+
+TEST(test_limiting_mem_cache)
+{
+  char nbuf[12];
+  char data[BSIZE];
+  int before, after;
+  int fd;
+
+  // Enable memory controller
+  ASSERT_TRUE(enable_controller(MEM_CNT));
+
+  // By default the whole cache may be used and none of it is kept
+  itoa(nbuf, NBUF);
+  strcat(nbuf, "\n");
+  ASSERT_FALSE(strcmp(read_file(TEST_1_MEM_CACHE_MIN, 0), "0\n"));
+  ASSERT_FALSE(strcmp(read_file(TEST_1_MEM_CACHE_MAX, 0), nbuf));
+
+  // The minimum may not exceed the maximum, nor the maximum the cache
+  ASSERT_TRUE(write_file(TEST_1_MEM_CACHE_MAX, "4"));
+  ASSERT_TRUE(write_file(TEST_1_MEM_CACHE_MIN, "2"));
+  ASSERT_FALSE(write_file(TEST_1_MEM_CACHE_MIN, "5"));
+  ASSERT_FALSE(write_file(TEST_1_MEM_CACHE_MAX, "1"));
+  itoa(nbuf, NBUF + 1);
+  ASSERT_FALSE(write_file(TEST_1_MEM_CACHE_MAX, nbuf));
+  ASSERT_FALSE(strcmp(read_file(TEST_1_MEM_CACHE_MIN, 0), "2\n"));
+  ASSERT_FALSE(strcmp(read_file(TEST_1_MEM_CACHE_MAX, 0), "4\n"));
+
+  // Move the current process to "/cgroup/test1" cgroup.
+  ASSERT_TRUE(move_proc(TEST_1_CGROUP_PROCS, getpid()));
+
+  // Reading a large file does not take the group over its share
+  before = get_val(read_file(TEST_1_MEM_STAT, 0), "file - ");
+  ASSERT_TRUE((fd = open("/cgroupstests", O_RDONLY)) > 0);
+  while (read(fd, data, sizeof(data)) == sizeof(data))
+    ;
+  close(fd);
+  after = get_val(read_file(TEST_1_MEM_STAT, 0), "file - ");
+  ASSERT_TRUE(after > 0);
+  ASSERT_TRUE(after <= (before > 4 * BSIZE ? before : 4 * BSIZE));
+
+  // Return the process to root cgroup.
+  ASSERT_TRUE(move_proc(ROOT_CGROUP_PROCS, getpid()));
+
+  // Disable memory controller, which restores the shares
+  ASSERT_TRUE(disable_controller(MEM_CNT));
+}
+
+TEST(test_polling_cgroup_events)
+{
+  char buf[64];
+  int fd, procs_fd, pid;
+
+  // Only events files may be polled
+  ASSERT_TRUE(procs_fd = open_file(TEST_1_CGROUP_PROCS));
+  ASSERT_UINT_EQ(cgpoll(procs_fd, 0), -1);
+  ASSERT_TRUE(close_file(procs_fd));
+
+  // Nothing changes while the group is empty
+  ASSERT_TRUE(fd = open_file(TEST_1_CGROUP_EVENTS));
+  ASSERT_UINT_EQ(cgpoll(fd, 2), 0);
+
+  // Only -1 means no timeout
+  ASSERT_UINT_EQ(cgpoll(fd, -2), -1);
+
+  // The child exits after a while
+  pid = fork();
+  if (pid == 0) {
+    sleep(10);
+    exit(0);
+  }
+
+  // Moving the child in populates the group
+  ASSERT_TRUE(move_proc(TEST_1_CGROUP_PROCS, pid));
+  ASSERT_UINT_EQ(cgpoll(fd, -1), 1);
+  ASSERT_TRUE(read(fd, buf, sizeof(buf)) > 0);
+  ASSERT_FALSE(strncmp(read_file(TEST_1_CGROUP_EVENTS, 0), "populated - 1\n", strlen("populated - 1\n")));
+
+  // The poller wakes up when the child exits
+  ASSERT_UINT_EQ(cgpoll(fd, -1), 1);
+  ASSERT_FALSE(strncmp(read_file(TEST_1_CGROUP_EVENTS, 0), "populated - 0\n", strlen("populated - 0\n")));
+  ASSERT_UINT_EQ(wait(0), pid);
+
+  ASSERT_TRUE(close_file(fd));
+}
+
 TEST(test_memory_stat_content_valid)
 {
     char buf[265];
     strcpy(buf, read_file(TEST_1_MEM_STAT, 0));
+    int file = get_val(buf, "file - ");
     int file_dirty = get_val(buf, "file_dirty - ");
     int file_dirty_aggregated = get_val(buf, "file_dirty_aggregated - ");
     int pgfault = get_val(buf, "pgfault - ");
     int pgmajfault = get_val(buf, "file_dirty - ");
+    ASSERT_UINT_EQ(file, 0);
     ASSERT_UINT_EQ(file_dirty, 0);
     ASSERT_UINT_EQ(file_dirty_aggregated, 0);
     ASSERT_UINT_EQ(pgfault, 0);
@@ -1313,6 +1592,28 @@ TEST(test_cpu_stat_content_valid)
     ASSERT_UINT_EQ(system_usec, 0);
 }
 
+TEST(test_cpu_sched_stat_content_valid)
+{
+    char buf[265];
+    strcpy(buf, read_file(TEST_1_CPU_SCHED_STAT, 0));
+    ASSERT_UINT_EQ(get_val(buf, "run_delay_usec - "), 0);
+    ASSERT_UINT_EQ(get_val(buf, "max_wait_usec - "), 0);
+    ASSERT_UINT_EQ(get_val(buf, "nr_voluntary_switches - "), 0);
+    ASSERT_UINT_EQ(get_val(buf, "nr_involuntary_switches - "), 0);
+    ASSERT_UINT_EQ(get_val(buf, "nr_migrations - "), 0);
+}
+
+TEST(test_pressure_content_valid)
+{
+    char * empty = "some avg10=0.00 avg60=0.00 avg300=0.00 total=0\n"
+                   "full avg10=0.00 avg60=0.00 avg300=0.00 total=0\n";
+
+    // A group without processes never stalls
+    ASSERT_FALSE(strcmp(read_file(TEST_1_CPU_PRESSURE, 0), empty));
+    ASSERT_FALSE(strcmp(read_file(TEST_1_MEM_PRESSURE, 0), empty));
+    ASSERT_FALSE(strcmp(read_file(TEST_1_IO_PRESSURE, 0), empty));
+}
+
 TEST(test_cpu_stat)
 {
 
@@ -1387,6 +1688,15 @@ TEST(test_cpu_stat)
         // Verify that the cpu time has changed because of the child's runing
         ASSERT_TRUE(strcmp(buf1, buf2));
 
+        // Verify that the usage is split between user and system time
+        ASSERT_UINT_EQ(get_val(buf2, "usage_usec - "),
+                       get_val(buf2, "user_usec - ") + get_val(buf2, "system_usec - "));
+        ASSERT_TRUE(get_val(buf2, "system_usec - ") > 0);
+
+        // Verify that the child going back to sleep was counted
+        strcpy(buf3, read_file(TEST_1_CPU_SCHED_STAT, 0));
+        ASSERT_TRUE(get_val(buf3, "nr_voluntary_switches - ") > 0);
+
         sleep(10);
 
         // read cpu.stat into a third buffer
@@ -1590,9 +1900,12 @@ int main(int argc, char * argv[])
     run_test(test_mount_cgroup_fs);
     run_test(test_creating_cgroups);
     run_test(test_opening_and_closing_cgroup_files);
+    run_test(test_recreating_cgroup_and_unknown_files);
     run_test_break_msg(test_reading_cgroup_files);
     run_test(test_memory_stat_content_valid);
     run_test(test_cpu_stat_content_valid);
+    run_test(test_cpu_sched_stat_content_valid);
+    run_test(test_pressure_content_valid);
     run_test(test_moving_process);
     run_test(test_enable_and_disable_all_controllers);
     run_test(test_limiting_pids);
@@ -1601,6 +1914,7 @@ int main(int argc, char * argv[])
     run_test(test_cpu_stat);
     run_test(test_pid_current);
     run_test(test_setting_cpu_id);
+    run_test(test_setting_cpu_list);
     run_test(test_correct_cpu_running);
     run_test(test_no_run);
     run_test(test_mem_stat);
@@ -1618,7 +1932,13 @@ int main(int argc, char * argv[])
     run_test(test_cant_move_over_mem_limit);
     run_test(test_cant_fork_over_mem_limit);
     run_test(test_cant_grow_over_mem_limit);
+    run_test(test_mem_high_throttles_growth);
+    run_test(test_mem_max_kills_largest_process);
+    run_test(test_limiting_mem_cache);
+    run_test(test_polling_cgroup_events);
     run_test(test_limiting_cpu_max_and_period);
+    run_test(test_setting_cpu_max_burst);
+    run_test(test_setting_io_max);
     run_test(test_setting_max_descendants_and_max_depth);
     run_test(test_deleting_cgroups);
     run_test(test_umount_cgroup_fs);
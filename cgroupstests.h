@@ -2,9 +2,9 @@
 #define CGROUPSTESTS_H
 
 #define MAX_CONTROLLER_NAME_LENGTH      16
-#define CONTROLLER_COUNT                4
+#define CONTROLLER_COUNT                5
 
-enum controller_types { CPU_CNT, PID_CNT, SET_CNT, MEM_CNT };
+enum controller_types { CPU_CNT, PID_CNT, SET_CNT, MEM_CNT, IO_CNT };
 
 // For memory controler test
 #define KERNBASE "2147483648" // KERNBASE defined in memlayout.h as 0x80000000 == 2147483648
@@ -29,16 +29,32 @@ enum controller_types { CPU_CNT, PID_CNT, SET_CNT, MEM_CNT };
 #define TEST_1_CGROUP_MAX_DEPTH         "/cgroup/test1/cgroup.max.depth"
 #define TEST_1_CGROUP_STAT              "/cgroup/test1/cgroup.stat"
 #define TEST_1_CPU_MAX                  "/cgroup/test1/cpu.max"
+#define TEST_1_CPU_MAX_BURST            "/cgroup/test1/cpu.max.burst"
 #define TEST_1_CPU_WEIGHT               "/cgroup/test1/cpu.weight"
 #define TEST_1_CPU_STAT                 "/cgroup/test1/cpu.stat"
+#define TEST_1_CPU_SCHED_STAT           "/cgroup/test1/cpu.schedstat"
+#define TEST_1_CPU_PRESSURE             "/cgroup/test1/cpu.pressure"
+#define TEST_1_MEM_PRESSURE             "/cgroup/test1/memory.pressure"
+#define TEST_1_IO_PRESSURE              "/cgroup/test1/io.pressure"
+#define TEST_1_IO_STAT                  "/cgroup/test1/io.stat"
+#define TEST_1_IO_MAX                   "/cgroup/test1/io.max"
 #define TEST_1_PID_MAX                  "/cgroup/test1/pid.max"
 #define TEST_1_PID_CURRENT              "/cgroup/test1/pid.current"
 #define TEST_1_SET_CPU                  "/cgroup/test1/cpuset.cpus"
+#define TEST_1_SET_CPU_EFFECTIVE        "/cgroup/test1/cpuset.cpus.effective"
+#define TEST_1_NESTED                   "/cgroup/test1/nested"
+#define TEST_1_NESTED_SUBTREE_CONTROL   "/cgroup/test1/nested/cgroup.subtree_control"
+#define TEST_1_NESTED_SET_CPU           "/cgroup/test1/nested/cpuset.cpus"
+#define TEST_1_NESTED_SET_CPU_EFFECTIVE "/cgroup/test1/nested/cpuset.cpus.effective"
 #define TEST_1_SET_FRZ                  "/cgroup/test1/cgroup.freeze"
 #define TEST_1_MEM_CURRENT              "/cgroup/test1/memory.current"
 #define TEST_1_MEM_MAX                  "/cgroup/test1/memory.max"
 #define TEST_1_MEM_MIN                  "/cgroup/test1/memory.min"
 #define TEST_1_MEM_STAT                 "/cgroup/test1/memory.stat"
+#define TEST_1_MEM_HIGH                 "/cgroup/test1/memory.high"
+#define TEST_1_MEM_EVENTS               "/cgroup/test1/memory.events"
+#define TEST_1_MEM_CACHE_MIN            "/cgroup/test1/memory.cache.min"
+#define TEST_1_MEM_CACHE_MAX            "/cgroup/test1/memory.cache.max"
 
 #define TEST_2_CGROUP_SUBTREE_CONTROL   "/cgroup/test2/cgroup.subtree_control"
 #define TEST_2_MEM_MIN                  "/cgroup/test2/memory.min"
@@ -8,6 +8,8 @@ void cpu_account_initialize(struct cpu_account * cpu)
     cpu->cpu_account_period = 1 * 100 * 1000; // 100ms
     cpu->now = 0;
     cpu->process_cpu_time = 0;
+    cpu->process_run_delay = 0;
+    cpu->process_migrated = 0;
 }
 
 void cpu_account_schedule_start(struct cpu_account * cpu)
@@ -29,6 +31,42 @@ void cpu_account_schedule_proc_update(struct cpu_account * cpu, struct proc * p)
     }
 }
 
+// Refill the runtime pool of the cgroup with a quota for every period
+// that has passed, keeping at most a quota and the burst allowance,
+// and unthrottle it once it has runtime again.
+static void cpu_account_refill(struct cgroup * cgroup, unsigned int now)
+{
+    unsigned int periods;
+    unsigned int refills;
+    int capacity;
+
+    if (now - cgroup->cpu_period_start < cgroup->cpu_account_period)
+        return;
+    periods = (now - cgroup->cpu_period_start) / cgroup->cpu_account_period;
+    cgroup->cpu_period_start += periods * cgroup->cpu_account_period;
+
+    if (cgroup->cpu_time_limit == ~0)
+        return;
+
+    // An overrun in the last period is paid back from this one.
+    capacity = cgroup->cpu_time_limit + cgroup->cpu_burst;
+    for (refills = periods;
+         refills > 0 && cgroup->cpu_runtime < capacity;
+         refills--)
+        cgroup->cpu_runtime += cgroup->cpu_time_limit;
+    if (cgroup->cpu_runtime > capacity)
+        cgroup->cpu_runtime = capacity;
+
+    // Count every elapsed period, also those of an idle stretch.
+    if (cgroup->cpu_controller_enabled)
+        cgroup->cpu_nr_periods += periods;
+
+    if (cgroup->cpu_is_throttled && cgroup->cpu_runtime > 0) {
+        cgroup->cpu_throttled_usec += now - cgroup->cpu_throttled_at;
+        cgroup->cpu_is_throttled = 0;
+    }
+}
+
 int cpu_account_schedule_process_decision(struct cpu_account * cpu,
                                           struct proc * p)
 {
@@ -56,33 +94,27 @@ int cpu_account_schedule_process_decision(struct cpu_account * cpu,
                 cgroup->cpu_period_time > cgroup->cpu_account_period
                     ? cgroup->cpu_account_period
                     : cgroup->cpu_period_time;
-            if (cgroup->cpu_controller_enabled) {
-                ++cgroup->cpu_nr_periods;
-            }
-            cgroup->cpu_is_throttled_period = 0;
             cgroup->cpu_percent =
                 current_cpu_time * 100 / cgroup->cpu_account_period;
             cgroup->cpu_account_frame = cgroup_cpu_account_frame;
             cgroup->cpu_period_time -= current_cpu_time;
         }
 
-        // If cpu time is larger than cpu time limit, skip this process.
+        cpu_account_refill(cgroup, cpu->now);
+
+        // If the runtime pool is used up, skip this process until
+        // a later period refills it.
         if (cgroup->cpu_controller_enabled &&
-            cgroup->cpu_period_time > cgroup->cpu_time_limit) {
-            // Increase throttled number if not yet done.
-            if (!cgroup->cpu_is_throttled_period) {
+            cgroup->cpu_time_limit != ~0 && cgroup->cpu_runtime <= 0) {
+            // Mark the group throttled if not yet done.
+            if (!cgroup->cpu_is_throttled) {
                 ++cgroup->cpu_nr_throttled;
-                cgroup->cpu_throttled_usec +=
-                    cgroup->cpu_account_period - cgroup->cpu_period_time;
-                cgroup->cpu_is_throttled_period = 1;
+                cgroup->cpu_throttled_at = cpu->now;
+                cgroup->cpu_is_throttled = 1;
             }
 
             // Do not schedule.
             schedule = 0;
-
-            // Advance to parent and continue.
-            cgroup = cgroup->parent;
-            continue;
         }
 
         // Advance to parent and continue.
@@ -99,12 +131,29 @@ void cpu_account_before_process_schedule(struct cpu_account * cpu,
 {
     // Update process cpu time.
     cpu->process_cpu_time = steady_clock_now();
+
+    // Update process run delay, the cgroups are updated with it once
+    // the process is switched out, under the cgroup lock.
+    cpu->process_run_delay =
+        cpu->process_cpu_time - proc->sched_runnable_stamp;
+    proc->sched_run_delay += cpu->process_run_delay;
+    if (cpu->process_run_delay > proc->sched_max_wait)
+        proc->sched_max_wait = cpu->process_run_delay;
+
+    // Update process migrations.
+    cpu->process_migrated =
+        proc->sched_last_cpu != -1 && proc->sched_last_cpu != cpuid();
+    if (cpu->process_migrated)
+        ++proc->sched_migrations;
+    proc->sched_last_cpu = cpuid();
 }
 
 void cpu_account_after_process_schedule(struct cpu_account * cpu,
                                         struct proc * p)
 {
     struct cgroup * cgroup = cpu->cgroup;
+    unsigned int user_time;
+    unsigned int system_time;
 
     // Update now.
     cpu->now = steady_clock_now();
@@ -116,6 +165,23 @@ void cpu_account_after_process_schedule(struct cpu_account * cpu,
     p->cpu_time += cpu->process_cpu_time;
     p->cpu_period_time += cpu->process_cpu_time;
 
+    // Split the run between user and kernel mode. The process is
+    // always switched out from the kernel, so the rest was system time.
+    user_time = p->cpu_run_user_time > cpu->process_cpu_time
+                    ? cpu->process_cpu_time
+                    : p->cpu_run_user_time;
+    system_time = cpu->process_cpu_time - user_time;
+    p->cpu_run_user_time = 0;
+    p->cpu_user_time += user_time;
+    p->cpu_system_time += system_time;
+
+    // A process that is runnable again was preempted, one that sleeps
+    // gave up the cpu by itself.
+    if (p->state == RUNNABLE)
+        ++p->sched_nivcsw;
+    else if (p->state == SLEEPING)
+        ++p->sched_nvcsw;
+
     // Lock the cgroup lock.
     cgroup_lock();
 
@@ -124,6 +190,18 @@ void cpu_account_after_process_schedule(struct cpu_account * cpu,
         // Update cgroup cpu time.
         cgroup->cpu_time += cpu->process_cpu_time;
         cgroup->cpu_period_time += cpu->process_cpu_time;
+        cgroup->cpu_user_time += user_time;
+        cgroup->cpu_system_time += system_time;
+
+        // Update cgroup scheduling statistics.
+        cgroup->sched_run_delay += cpu->process_run_delay;
+        if (cpu->process_run_delay > cgroup->sched_max_wait)
+            cgroup->sched_max_wait = cpu->process_run_delay;
+        if (p->state == RUNNABLE)
+            ++cgroup->sched_nivcsw;
+        else if (p->state == SLEEPING)
+            ++cgroup->sched_nvcsw;
+        cgroup->sched_migrations += cpu->process_migrated;
 
         // If cgroup cpu controller is not enabled.
         if (!cgroup->cpu_controller_enabled) {
@@ -132,6 +210,11 @@ void cpu_account_after_process_schedule(struct cpu_account * cpu,
             continue;
         }
 
+        // Charge the runtime pool, overrunning it by at most the
+        // time since the last timer tick.
+        if (cgroup->cpu_time_limit != ~0)
+            cgroup->cpu_runtime -= cpu->process_cpu_time;
+
         // Advance to parent.
         cgroup = cgroup->parent;
     }
@@ -140,6 +223,22 @@ void cpu_account_after_process_schedule(struct cpu_account * cpu,
     cgroup_unlock();
 }
 
+void cpu_account_process_runnable(struct proc * p)
+{
+    p->sched_runnable_stamp = steady_clock_now();
+}
+
+void cpu_account_trap_enter(struct proc * p)
+{
+    // The time since the last return to user mode was spent there.
+    p->cpu_run_user_time += (unsigned int)steady_clock_now() - p->cpu_user_stamp;
+}
+
+void cpu_account_trap_exit(struct proc * p)
+{
+    p->cpu_user_stamp = steady_clock_now();
+}
+
 void cpu_account_schedule_finish(struct cpu_account * cpu)
 {
 }
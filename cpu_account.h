@@ -9,6 +9,8 @@ struct cpu_account
     unsigned int cpu_account_period;
     unsigned int cpu_account_frame;
     unsigned int process_cpu_time;
+    unsigned int process_run_delay;
+    char process_migrated;
     struct cgroup * cgroup;
 
 };
@@ -50,6 +52,25 @@ void cpu_account_before_process_schedule(struct cpu_account * cpu, struct proc *
  */
 void cpu_account_after_process_schedule(struct cpu_account * cpu, struct proc * p);
 
+/**
+ * Event callback function to let the cpu account mechanism know that a process
+ * became runnable and starts waiting for a cpu.
+ * Call with the ptable lock held.
+ */
+void cpu_account_process_runnable(struct proc * p);
+
+/**
+ * Event callback function to let the cpu account mechanism know that a process
+ * entered the kernel from user mode.
+ */
+void cpu_account_trap_enter(struct proc * p);
+
+/**
+ * Event callback function to let the cpu account mechanism know that a process
+ * is about to return to user mode.
+ */
+void cpu_account_trap_exit(struct proc * p);
+
 /**
  * Event callback function to let the cpu account mechanism know
  * that the scheduling has finished a cycle.
@@ -1,14 +1,18 @@
 struct buf;
 struct context;
 struct file;
+struct files;
 struct inode;
+struct kmem_cache;
 struct mount;
 struct mount_list;
 struct mount_ns;
+struct mm;
 struct nsproxy;
 struct pipe;
 struct proc;
 struct rtcdate;
+struct rwlock;
 struct spinlock;
 struct sleeplock;
 struct stat;
@@ -20,7 +24,10 @@ void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+void            bwritefor(struct buf*, struct cgroup*);
 void            invalidateblocks(uint);
+int             breclaim(struct cgroup*, int);
+void            breparent(struct cgroup*);
 
 // console.c
 void            consoleclear(void);
@@ -56,6 +63,10 @@ void            fileinit(void);
 int             fileread(struct file*, char*, int n);
 int             filestat(struct file*, struct stat*);
 int             filewrite(struct file*, char*, int n);
+struct files*   filesalloc(void);
+struct files*   filescopy(struct files*);
+struct files*   filesdup(struct files*);
+void            filesput(struct files*);
 
 // fs.c
 void            readsb(int dev, struct superblock *sb);
@@ -90,11 +101,16 @@ struct mount*   getrootmount(void);
 struct mount*   mntdup(struct mount*);
 void            mntput(struct mount*);
 struct mount*   mntlookup(struct inode*, struct mount*);
-void            umountall(struct mount_list*);
-struct mount_list* copyactivemounts(void);
+void            umountall(struct mount_ns*);
+int             copyactivemounts(struct mount_ns*);
 struct mount*   getroot(struct mount_list*);
 struct mount*   getinitialrootmount(void);
 
+// futex.c
+void            futexinit(void);
+int             futex_wait(uint*, uint);
+int             futex_wake(uint*, int);
+
 // ide.c
 void            ideinit(void);
 void            ideintr(void);
@@ -123,6 +139,7 @@ void            cmostime(struct rtcdate *r);
 int             lapicid(void);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
+void            lapicipi(uchar, int);
 void            lapicinit(void);
 void            lapicstartap(uchar, uint);
 void            microdelay(int);
@@ -140,6 +157,16 @@ struct mount_ns* mount_nsdup(struct mount_ns*);
 struct mount_ns* newmount_ns(void);
 struct mount_ns* copymount_ns(void);
 
+// mmap.c
+void            mmapinit(void);
+int             mmap(uint, int, int, struct file*, uint);
+int             munmap(uint, uint);
+void            munmapall(pde_t*);
+int             mmapcopy(pde_t*, pde_t*);
+int             mmapfault(uint, uint);
+void            pcache_write(struct inode*, char*, uint, uint);
+void            pcache_invalidate(struct inode*);
+
 // mp.c
 extern int      ismp;
 void            mpinit(void);
@@ -156,6 +183,7 @@ void            picenable(int);
 void            picinit(void);
 
 // pipe.c
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, char*, int);
@@ -168,6 +196,7 @@ void            exit(int);
 int             fork(void);
 int             growproc(int);
 int             kill(int);
+int             oom_kill(struct cgroup*);
 struct cpu*     mycpu(void);
 struct proc*    myproc();
 void            pinit(void);
@@ -178,6 +207,15 @@ void            setproc(struct proc*);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(int*);
+int             waitpid(int, int*, int);
+int             clone(void(*)(void*, void*), void*, void*, void*);
+int             join(void**);
+void            mmput(struct mm*, pde_t*);
+void            mmleave(struct mm*, pde_t*);
+void            tlbshootdown(struct mm*);
+int             ownsmem(struct proc*);
+int             unsharefiles(void);
+void            execmm(pde_t*, uint);
 void            wakeup(void*);
 void            yield(void);
 int             cgroup_move_proc(struct cgroup * cgroup, int pid);
@@ -193,6 +231,31 @@ void            initlock(struct spinlock*, char*);
 void            release(struct spinlock*);
 void            pushcli(void);
 void            popcli(void);
+int             lockstat_dump(int);
+int             locktorture(int);
+
+// rwlock.c
+void            initrwlock(struct rwlock*, char*);
+void            acquireread(struct rwlock*);
+void            releaseread(struct rwlock*);
+void            acquirewrite(struct rwlock*);
+void            releasewrite(struct rwlock*);
+int             holdingwrite(struct rwlock*);
+
+// shm.c
+void            shminit(void);
+int             shmat(int, uint);
+int             shmdt(uint);
+int             shmcopy(pde_t*, pde_t*);
+void            shmdetachall(pde_t*);
+int             shmcontains(pde_t*, uint, uint);
+
+// slab.c
+void            slabinit(void);
+struct kmem_cache* kmem_cache_create(char*, uint);
+void*           kmem_cache_alloc(struct kmem_cache*);
+void            kmem_cache_free(struct kmem_cache*, void*);
+void            kmem_cache_dump(void);
 
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
@@ -210,6 +273,12 @@ int             strncmp(const char*, const char*, uint);
 int             strcmp(const char * p, const char * q);
 char*           strncpy(char*, const char*, int);
 
+// sysfile.c
+int             fdalloc(struct file*);
+struct file*    fdfree(int);
+struct file*    fdget(int);
+void            fdput(void);
+
 // syscall.c
 int             argint(int, int*);
 int             argptr(int, char**, int);
@@ -224,6 +293,7 @@ void            timerinit(void);
 
 // trap.c
 void            idtinit(void);
+void            sysenterinit(void);
 extern uint     ticks;
 void            tvinit(void);
 extern struct spinlock tickslock;
@@ -240,7 +310,12 @@ pde_t*          setupkvm(void);
 char*           uva2ka(pde_t*, char*);
 int             allocuvm(pde_t*, uint, uint, struct cgroup* cgroup);
 int             deallocuvm(pde_t*, uint, uint);
+void            unmapuvm(pde_t*, uint, uint);
 void            freevm(pde_t*);
+uint*           walkpgdir(pde_t*, const void*, int);
+int             mapshared(pde_t*, uint, char**, uint);
+void            unmapshared(pde_t*, uint, uint);
+int             ismapped(pde_t*, uint);
 void            inituvm(pde_t*, char*, uint);
 int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
 pde_t*          copyuvm(pde_t*, uint);
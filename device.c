@@ -6,9 +6,6 @@
 #include "file.h"
 #include "device.h"
 
-#define NLOOPDEVS (10)
-#define NIDEDEVS (2)
-
 struct device {
   struct superblock sb;
   int ref;
@@ -1,4 +1,12 @@
 #define LOOP_DEVICE_DEV (7)
 #define DEV_TO_LOOP_DEVICE(dev) ((dev) & 0xffff)
 #define LOOP_DEVICE_TO_DEV(ld) ((ld) | (LOOP_DEVICE_DEV << 16))
-#define IS_LOOP_DEVICE(dev) (((dev) >> 16) == LOOP_DEVICE_DEV)
\ No newline at end of file
+#define IS_LOOP_DEVICE(dev) (((dev) >> 16) == LOOP_DEVICE_DEV)
+
+#define NLOOPDEVS (10)
+#define NIDEDEVS (2)
+
+// Dense index of a device, for per-device tables.
+#define NIODEVS (NIDEDEVS + NLOOPDEVS)
+#define DEV_TO_IO_INDEX(dev) (IS_LOOP_DEVICE(dev) ? NIDEDEVS + DEV_TO_LOOP_DEVICE(dev) : (dev))
+#define IO_INDEX_TO_DEV(i) ((i) < NIDEDEVS ? (i) : LOOP_DEVICE_TO_DEV((i) - NIDEDEVS))
@@ -18,6 +18,7 @@ exec(char *path, char **argv)
   struct inode *ip;
   struct proghdr ph;
   pde_t *pgdir, *oldpgdir;
+  struct mm *oldmm;
   struct proc *curproc = myproc();
   struct cgroup* cgroup = curproc->cgroup;
 
@@ -94,19 +95,20 @@ exec(char *path, char **argv)
       last = s+1;
   safestrcpy(curproc->name, last, sizeof(curproc->name));
 
-  // Update memory usage in cgroup and its ancestors
-  do {
-    cgroup->current_mem += sz - curproc->sz;
-  } while ((cgroup = cgroup->parent));
+  // The new image gets a file table of its own.
+  if(unsharefiles() < 0)
+    goto bad;
 
-  // Commit to the user image.
+  // Commit to the user image, killing any threads the old
+  // address space is shared with.
   oldpgdir = curproc->pgdir;
-  curproc->pgdir = pgdir;
-  curproc->sz = sz;
+  oldmm = curproc->mm;
+  execmm(pgdir, sz);
   curproc->tf->eip = elf.entry;  // main
   curproc->tf->esp = sp;
   switchuvm(curproc);
-  freevm(oldpgdir);
+  mmleave(oldmm, oldpgdir);
+  mmput(oldmm, oldpgdir);
   return 0;
 
  bad:
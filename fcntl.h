@@ -3,6 +3,12 @@
 #define O_RDWR    0x002
 #define O_CREATE  0x200
 
+// mmap protection and flags
+#define PROT_READ    0x1
+#define PROT_WRITE   0x2
+#define MAP_SHARED   0x01
+#define MAP_PRIVATE  0x02
+
 
 //ioctl tty command types
 #define DEV_CONNECT     0x1000
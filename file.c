@@ -9,17 +9,31 @@
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "mmu.h"
+
+// File structures may take up at most 1/FILEMEMDIV of the
+// memory that is free at boot.
+#define FILEMEMDIV 16
 
 struct devsw devsw[NDEV];
 struct {
   struct spinlock lock;
-  struct file file[NFILE];
+  struct kmem_cache *cache;
+  struct kmem_cache *filescache;
+  int nfile;    // allocated file structures
+  int maxfile;  // limit on nfile, sized at boot
 } ftable;
 
+// Must be called after all physical memory was handed to kalloc().
 void
 fileinit(void)
 {
   initlock(&ftable.lock, "ftable");
+  ftable.cache = kmem_cache_create("file", sizeof(struct file));
+  ftable.filescache = kmem_cache_create("files", sizeof(struct files));
+  ftable.maxfile = get_total_memory() / FILEMEMDIV * (PGSIZE / sizeof(struct file));
+  if(ftable.maxfile < NFILE)
+    ftable.maxfile = NFILE;
 }
 
 // Allocate a file structure.
@@ -29,15 +43,22 @@ filealloc(void)
   struct file *f;
 
   acquire(&ftable.lock);
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      f->ref = 1;
-      release(&ftable.lock);
-      return f;
-    }
+  if(ftable.nfile >= ftable.maxfile){
+    release(&ftable.lock);
+    return 0;
   }
+  ftable.nfile++;
   release(&ftable.lock);
-  return 0;
+
+  if((f = kmem_cache_alloc(ftable.cache)) == 0){
+    acquire(&ftable.lock);
+    ftable.nfile--;
+    release(&ftable.lock);
+    return 0;
+  }
+  memset(f, 0, sizeof(*f));
+  f->ref = 1;
+  return f;
 }
 
 // Increment ref count for file f.
@@ -66,9 +87,9 @@ fileclose(struct file *f)
     return;
   }
   ff = *f;
-  f->ref = 0;
-  f->type = FD_NONE;
+  ftable.nfile--;
   release(&ftable.lock);
+  kmem_cache_free(ftable.cache, f);
 
   if(ff.type == FD_PIPE)
     pipeclose(ff.pipe, ff.writable);
@@ -104,6 +125,8 @@ fileread(struct file *f, char *addr, int n)
   if(f->type == FD_PIPE)
     return piperead(f->pipe, addr, n);
   if(f->type == FD_INODE){
+    // Throttle before the inode lock, which other cgroups may need.
+    cgroup_io_throttle(f->ip->dev, 0);
     ilock(f->ip);
     if((r = readi(f->ip, addr, f->off, n)) > 0)
       f->off += r;
@@ -156,3 +179,64 @@ filewrite(struct file *f, char *addr, int n)
   panic("filewrite");
 }
 
+// Allocate an empty file table.
+struct files*
+filesalloc(void)
+{
+  struct files *fs;
+
+  if((fs = kmem_cache_alloc(ftable.filescache)) == 0)
+    return 0;
+  memset(fs, 0, sizeof(*fs));
+  fs->ref = 1;
+  initlock(&fs->lock, "files");
+  return fs;
+}
+
+// Copy the file table fs for a new process.
+struct files*
+filescopy(struct files *fs)
+{
+  struct files *nfs;
+  int fd;
+
+  if((nfs = filesalloc()) == 0)
+    return 0;
+  acquire(&fs->lock);
+  for(fd = 0; fd < NOFILE; fd++)
+    if(fs->ofile[fd])
+      nfs->ofile[fd] = filedup(fs->ofile[fd]);
+  nfs->fdmap = fs->fdmap;
+  nfs->cwd = idup(fs->cwd);
+  nfs->cwdmount = mntdup(fs->cwdmount);
+  safestrcpy(nfs->cwdp, fs->cwdp, sizeof(nfs->cwdp));
+  release(&fs->lock);
+  return nfs;
+}
+
+// Share the file table fs with a new thread.
+struct files*
+filesdup(struct files *fs)
+{
+  __sync_fetch_and_add(&fs->ref, 1);
+  return fs;
+}
+
+// Drop a use of the file table fs. The last one closes its files
+// and releases the current directory.
+void
+filesput(struct files *fs)
+{
+  int fd;
+
+  if(__sync_sub_and_fetch(&fs->ref, 1) > 0)
+    return;
+  for(fd = 0; fd < NOFILE; fd++)
+    if(fs->ofile[fd])
+      fileclose(fs->ofile[fd]);
+  begin_op();
+  iput(fs->cwd);
+  end_op();
+  mntput(fs->cwdmount);
+  kmem_cache_free(ftable.filescache, fs);
+}
@@ -5,6 +5,7 @@
 #include "sleeplock.h"
 #include "cgfs.h"
 #include "param.h"
+#include "psi.h"
 
 struct file {
   enum { FD_NONE, FD_PIPE, FD_INODE, FD_CG } type;
@@ -26,6 +27,8 @@ struct file {
     struct {
       struct cgroup *cgp;
       char cgfilename[MAX_CGROUP_FILE_NAME_LENGTH];
+      int cgfiletype; // cgroup_file_name_t of cgfilename, -1 for directories
+      uint events_seq; // events seen by the reader, see cg_poll
       union {
         // cpu
         union {
@@ -45,6 +48,16 @@ struct file {
             int max;
             int period;
           } max;
+          struct {
+            int burst;
+          } burst;
+          struct {
+            int run_delay_usec;
+            int max_wait_usec;
+            int nr_voluntary_switches;
+            int nr_involuntary_switches;
+            int nr_migrations;
+          } sched;
         } cpu;
         // pid
         union {
@@ -57,7 +70,8 @@ struct file {
         union {
           struct {
             char active;
-            int cpu_id;
+            unsigned int cpus;
+            unsigned int cpus_effective;
           } set;
         } cpu_s;
         // freezer
@@ -70,6 +84,7 @@ struct file {
         union {
           struct {
             char active;
+            uint file;
             uint file_dirty;
             uint file_dirty_aggregated;
             uint pgfault;
@@ -80,16 +95,42 @@ struct file {
             char active;
             unsigned int max;
           } max;
+          struct {
+            char active;
+            unsigned int high;
+          } high;
+          struct {
+            char active;
+            unsigned int min;
+            unsigned int max;
+          } cache;
           struct {
               char active;
               unsigned int min;
           } min;
         } mem;
+        // pressure stall information
+        struct {
+          uint avg[NR_PSI_STATES][NR_PSI_AVGS];
+          uint total[NR_PSI_STATES];
+        } psi;
       };
     };
   };
 };
 
+// Open files and current directory of a process, shared by the
+// threads it clone()s. Changes take the lock; lookups only need it
+// while the table is shared.
+struct files {
+  int ref;                     // processes using the table
+  struct spinlock lock;        // protects the fields below
+  struct file *ofile[NOFILE];  // Open files
+  uint fdmap;                  // Bitmap of used ofile slots (NOFILE <= 32)
+  struct inode *cwd;           // Current directory
+  struct mount *cwdmount;      // Mount in which current directory lies
+  char cwdp[MAX_PATH_LENGTH];  // Current directory path.
+};
 
 // in-memory copy of an inode
 struct inode {
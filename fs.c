@@ -446,6 +446,7 @@ itrunc(struct inode *ip)
 
   ip->size = 0;
   iupdate(ip);
+  pcache_invalidate(ip);
 }
 
 // Copy stat information from inode.
@@ -520,6 +521,7 @@ writei(struct inode *ip, char *src, uint off, uint n)
     log_write(bp);
     brelse(bp);
   }
+  pcache_write(ip, src - n, off - n, n);
 
   if(n > 0 && off > ip->size){
     ip->size = off;
@@ -652,14 +654,18 @@ namex(char *path, int nameiparent, char *name, struct mount **mnt)
   struct inode *ip, *next;
   struct mount *curmount;
   struct mount *nextmount;
+  struct files *fs;
   uint mntinum;
 
   if(*path == '/') {
     curmount = mntdup(getrootmount());
     ip = iget(ROOTDEV, ROOTINO);
   } else {
-    curmount = mntdup(myproc()->cwdmount);
-    ip = idup(myproc()->cwd);
+    fs = myproc()->files;
+    acquire(&fs->lock);
+    curmount = mntdup(fs->cwdmount);
+    ip = idup(fs->cwd);
+    release(&fs->lock);
   }
 
   while((path = skipelem(path, name)) != 0){
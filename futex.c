@@ -0,0 +1,125 @@
+// Futexes: sleep until another thread or process wakes up the
+// same user memory word.
+//
+// A futex is identified by the kernel address of its word, so
+// processes that map the same page at different user addresses
+// agree on it. Waiters are queued in a hash table of buckets, each
+// with its own lock; futex_wait() checks the word's value under
+// the bucket lock, so a futex_wake() issued after the word changed
+// can't be missed.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+
+#define NFUTEXHASH 64
+
+struct futex_waiter {
+  uint *key;                  // kernel address of the futex word
+  int woken;
+  struct futex_waiter *next;
+};
+
+static struct {
+  struct spinlock lock;
+  struct futex_waiter *waiters;
+} futextable[NFUTEXHASH];
+
+void
+futexinit(void)
+{
+  int i;
+
+  for(i = 0; i < NFUTEXHASH; i++)
+    initlock(&futextable[i].lock, "futex");
+}
+
+// Translate a word-aligned user address of the current process.
+static uint*
+futex_key(uint *uaddr)
+{
+  char *ka;
+
+  if((uint)uaddr % sizeof(uint) != 0)
+    return 0;
+  if((ka = uva2ka(myproc()->pgdir, (char*)uaddr)) == 0)
+    return 0;
+  return (uint*)(ka + ((uint)uaddr & (PGSIZE - 1)));
+}
+
+static uint
+futex_hash(uint *key)
+{
+  return ((uint)key >> 2) % NFUTEXHASH;
+}
+
+// If *uaddr is still val, sleep until futex_wake() on the same word.
+// Returns 0 when woken, -1 if the word changed or the process
+// was killed. The caller has checked uaddr is in the process.
+int
+futex_wait(uint *uaddr, uint val)
+{
+  struct futex_waiter w, **pp;
+  uint *key;
+  int b;
+
+  if((key = futex_key(uaddr)) == 0)
+    return -1;
+  b = futex_hash(key);
+
+  acquire(&futextable[b].lock);
+  if(*(volatile uint*)key != val){
+    release(&futextable[b].lock);
+    return -1;
+  }
+  // Queue at the tail so waiters are woken in order.
+  w.key = key;
+  w.woken = 0;
+  w.next = 0;
+  for(pp = &futextable[b].waiters; *pp; pp = &(*pp)->next)
+    ;
+  *pp = &w;
+  while(!w.woken && !myproc()->killed)
+    sleep(&w, &futextable[b].lock);
+
+  if(!w.woken){
+    for(pp = &futextable[b].waiters; *pp != &w; pp = &(*pp)->next)
+      ;
+    *pp = w.next;
+  }
+  release(&futextable[b].lock);
+  return w.woken ? 0 : -1;
+}
+
+// Wake up to n processes waiting on the word at uaddr, in the order
+// they started waiting. Returns how many were woken.
+int
+futex_wake(uint *uaddr, int n)
+{
+  struct futex_waiter *w, **pp;
+  uint *key;
+  int b, woken;
+
+  if((key = futex_key(uaddr)) == 0)
+    return -1;
+  b = futex_hash(key);
+
+  woken = 0;
+  acquire(&futextable[b].lock);
+  for(pp = &futextable[b].waiters; *pp && woken < n; ){
+    w = *pp;
+    if(w->key != key){
+      pp = &w->next;
+      continue;
+    }
+    *pp = w->next;
+    w->woken = 1;
+    wakeup(w);
+    woken++;
+  }
+  release(&futextable[b].lock);
+  return woken;
+}
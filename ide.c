@@ -12,6 +12,7 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "psi.h"
 
 #define SECTOR_SIZE   512
 #define IDE_BSY       0x80
@@ -138,6 +139,7 @@ void
 iderw(struct buf *b)
 {
   struct buf **pp;
+  int psi;
 
   if(!holdingsleep(&b->lock))
     panic("iderw: buf not locked");
@@ -159,9 +161,11 @@ iderw(struct buf *b)
     idestart(b);
 
   // Wait for request to finish.
+  psi = psi_enter(PSI_IOWAIT);
   while((b->flags & (B_VALID|B_DIRTY)) != B_VALID){
     sleep(b, &idelock);
   }
+  psi_leave(psi);
 
 
   release(&idelock);
@@ -5,6 +5,11 @@ typedef enum ioctl_request {
     IOCTL_CPU_START = 1000,
     IOCTL_GET_PROCESS_CPU_TIME,
     IOCTL_GET_PROCESS_CPU_PERCENT,
+    IOCTL_GET_PROCESS_RUN_DELAY,
+    IOCTL_GET_PROCESS_MAX_WAIT,
+    IOCTL_GET_PROCESS_NVCSW,
+    IOCTL_GET_PROCESS_NIVCSW,
+    IOCTL_GET_PROCESS_MIGRATIONS,
 } ioctl_request;
 
 #endif
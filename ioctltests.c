@@ -220,6 +220,39 @@ fail:
   return -1;
 }
 
+/* Verify the scheduling statistics of the calling process
+  - the requests take no file, so any fd is accepted
+  - sleeping gives up the cpu voluntarily
+  - the longest wait for a cpu is part of the total run delay
+*/
+int ioctl_sched_stat_test() {
+  int nvcsw;
+
+  if(ioctl(-1, IOCTL_GET_PROCESS_CPU_TIME) < 0){
+    printf(stderr, "IOCTL_GET_PROCESS_CPU_TIME failed without a file\n");
+    return -1;
+  }
+
+  nvcsw = ioctl(-1, IOCTL_GET_PROCESS_NVCSW);
+  sleep(2);
+  if(ioctl(-1, IOCTL_GET_PROCESS_NVCSW) <= nvcsw){
+    printf(stderr, "sleep was not counted as a voluntary switch\n");
+    return -1;
+  }
+
+  if(ioctl(-1, IOCTL_GET_PROCESS_MAX_WAIT) > ioctl(-1, IOCTL_GET_PROCESS_RUN_DELAY)){
+    printf(stderr, "max wait is larger than the total run delay\n");
+    return -1;
+  }
+
+  if(ioctl(-1, IOCTL_GET_PROCESS_NIVCSW) < 0 ||
+     ioctl(-1, IOCTL_GET_PROCESS_MIGRATIONS) < 0){
+    printf(stderr, "scheduling statistics requests failed\n");
+    return -1;
+  }
+  return 0;
+}
+
 int main() {
 
   //TTY INIT TESTS
@@ -233,6 +266,9 @@ int main() {
   if(ioctl_console_test() < 0)
     exit(1);
 
+  if(ioctl_sched_stat_test() < 0)
+    exit(1);
+
   //ioctl SCENARIO TESTS
   if(ioctl_attach_detach_test() < 0)
     exit(1);
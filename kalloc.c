@@ -179,6 +179,7 @@ kmemtest(void)
     "  list:    %d\n"
     "  errors:  %d\n",
     page_cnt, list_cnt, err_cnt);
+  kmem_cache_dump();
 
   if (page_cnt == list_cnt && !err_cnt)
     return 0;
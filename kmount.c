@@ -1,6 +1,7 @@
 #include "types.h"
 #include "defs.h"
 #include "spinlock.h"
+#include "rwlock.h"
 #include "fs.h"
 #include "sleeplock.h"
 #include "file.h"
@@ -14,37 +15,97 @@
 
 struct mount_list {
   struct mount mnt;
-  struct mount_list *next;
+  struct mount_list *next;  // active_mounts of the namespace
+  struct mount_list *prev;
+  struct mount_list *hnext; // mnt_hash chain of the namespace
+  struct mount_list *copy;  // this entry's copy while copying the namespace
 };
 
+// A mount is the first member of its mount_list entry.
+#define MNTLIST(m) ((struct mount_list*)(m))
+
 struct {
-  struct spinlock mnt_list_lock; // protects mnt_list
-  struct mount_list mnt_list[NMOUNT];
+  struct kmem_cache *cache;   // mount_list entries
+  struct mount_list rootmnt;  // root mount of the initial namespace
 } mount_holder;
 
-struct mount_list*
-getactivemounts()
+static uint
+mnthash(struct mount *parent, struct inode *mountpoint)
+{
+  return (((uint)parent >> 4) ^ ((uint)mountpoint >> 4)) % MNTHASHSIZE;
+}
+
+// Find the mount at mountpoint within parent.
+// Caller must hold ns->lock.
+static struct mount_list*
+mntfind(struct mount_ns *ns, struct inode *mountpoint, struct mount *parent)
 {
-  return myproc()->nsproxy->mount_ns->active_mounts;
+  struct mount_list *entry;
+
+  for (entry = ns->mnt_hash[mnthash(parent, mountpoint)]; entry != 0; entry = entry->hnext) {
+    if (entry->mnt.mountpoint == mountpoint && entry->mnt.parent == parent) {
+      return entry;
+    }
+  }
+  return 0;
+}
+
+static void
+mnthashadd(struct mount_ns *ns, struct mount_list *entry)
+{
+  struct mount_list **bucket = &ns->mnt_hash[mnthash(entry->mnt.parent, entry->mnt.mountpoint)];
+
+  entry->hnext = *bucket;
+  *bucket = entry;
+}
+
+// Remove entry from active_mounts and the hash.
+// Caller must hold ns->lock for writing.
+static void
+mntunlink(struct mount_ns *ns, struct mount_list *entry)
+{
+  struct mount_list **pp = &ns->mnt_hash[mnthash(entry->mnt.parent, entry->mnt.mountpoint)];
+
+  for (; *pp != 0; pp = &(*pp)->hnext) {
+    if (*pp == entry) {
+      *pp = entry->hnext;
+      break;
+    }
+  }
+
+  if (entry->prev != 0) {
+    entry->prev->next = entry->next;
+  } else {
+    ns->active_mounts = entry->next;
+  }
+  if (entry->next != 0) {
+    entry->next->prev = entry->prev;
+  }
+  entry->next = entry->prev = entry->hnext = 0;
 }
 
 // Parent mount (if it exists) must already be ref-incremented.
 static void
-addmountinternal(struct mount_list *mnt_list, uint dev, struct inode *mountpoint, struct mount *parent)
+addmountinternal(struct mount_ns *ns, struct mount_list *mnt_list, uint dev, struct inode *mountpoint, struct mount *parent)
 {
   mnt_list->mnt.mountpoint = mountpoint;
   mnt_list->mnt.dev = dev;
   mnt_list->mnt.parent = parent;
 
-  // add to linked list
-  mnt_list->next = getactivemounts();
-  myproc()->nsproxy->mount_ns->active_mounts = mnt_list;
+  // add to the front of the linked list
+  mnt_list->prev = 0;
+  mnt_list->next = ns->active_mounts;
+  if (mnt_list->next != 0) {
+    mnt_list->next->prev = mnt_list;
+  }
+  ns->active_mounts = mnt_list;
+  mnthashadd(ns, mnt_list);
 }
 
 struct mount *
 getinitialrootmount(void)
 {
-  return &mount_holder.mnt_list[0].mnt;
+  return &mount_holder.rootmnt.mnt;
 }
 
 struct mount *
@@ -56,167 +117,174 @@ getrootmount(void)
 void
 mntinit(void)
 {
-  initlock(&mount_holder.mnt_list_lock, "mount_list");
+  struct mount_ns *ns = myproc()->nsproxy->mount_ns;
+
+  mount_holder.cache = kmem_cache_create("mount", sizeof(struct mount_list));
 
-  addmountinternal(&mount_holder.mnt_list[0], ROOTDEV, 0, 0);
-  mount_holder.mnt_list[0].mnt.ref = 1;
-  myproc()->nsproxy->mount_ns->root = getinitialrootmount();
+  addmountinternal(ns, &mount_holder.rootmnt, ROOTDEV, 0, 0);
+  mount_holder.rootmnt.mnt.ref = 1;
+  ns->root = getinitialrootmount();
 }
 
+// Mount references are taken for every path component looked up,
+// so they are atomic rather than protected by a lock.
 struct mount*
 mntdup(struct mount *mnt)
 {
-  acquire(&mount_holder.mnt_list_lock);
-  mnt->ref++;
-  release(&mount_holder.mnt_list_lock);
+  __sync_fetch_and_add(&mnt->ref, 1);
   return mnt;
 }
 
 void
 mntput(struct mount *mnt)
 {
-  acquire(&mount_holder.mnt_list_lock);
-  mnt->ref--;
-  release(&mount_holder.mnt_list_lock);
+  __sync_fetch_and_sub(&mnt->ref, 1);
 }
 
+// Returns 0 if memory cannot be allocated.
 static struct mount_list*
 allocmntlist(void)
 {
-  acquire(&mount_holder.mnt_list_lock);
-  int i;
-  // Find empty mount struct
-  for (i = 0; i < NMOUNT && mount_holder.mnt_list[i].mnt.ref != 0; i++);
-
-  if (i == NMOUNT) {
-    // error - no available mount memory.
-    panic("out of mount_list objects");
+  struct mount_list *newmountentry = kmem_cache_alloc(mount_holder.cache);
+  if (newmountentry == 0) {
+    return 0;
   }
 
-  struct mount_list *newmountentry = &mount_holder.mnt_list[i];
+  memset(newmountentry, 0, sizeof(*newmountentry));
   newmountentry->mnt.ref = 1;
+  return newmountentry;
+}
 
-  release(&mount_holder.mnt_list_lock);
+// Release what a detached mount holds and free it.
+// May sleep, so no spinlock may be held.
+static void
+mntfree(struct mount_list *entry)
+{
+  struct inode *mountpoint = entry->mnt.mountpoint;
+  uint dev = entry->mnt.dev;
 
-  return newmountentry;
+  if (entry->mnt.parent != 0) {
+    mntput(entry->mnt.parent);
+  }
+  if (entry != &mount_holder.rootmnt) {
+    kmem_cache_free(mount_holder.cache, entry);
+  }
+  if (mountpoint != 0) {
+    iput(mountpoint);
+  }
+  deviceput(dev);
+}
+
+// Drop the base reference and the caller's one at once, provided
+// nobody else holds the mount. References are taken without a lock,
+// so a concurrent mntdup() makes the swap fail.
+static int
+mntclaim(struct mount *mnt)
+{
+  int ref;
+
+  do {
+    // Base ref is 1, +1 for the mount being acquired before entering umount.
+    ref = mnt->ref;
+    if (ref > 2) {
+      return -1;
+    }
+  } while (!__sync_bool_compare_and_swap(&mnt->ref, ref, 0));
+  return 0;
 }
 
 // mountpoint and device must be locked.
 int
 mount(struct inode *mountpoint, struct inode *device, struct mount *parent)
 {
+  struct mount_ns *ns = myproc()->nsproxy->mount_ns;
   struct mount_list *newmountentry = allocmntlist();
-  struct mount *newmount = &newmountentry->mnt;
+  if (newmountentry == 0) {
+    cprintf("out of memory for mounts.\n");
+    return -1;
+  }
 
   int dev = getorcreatedevice(device);
   if (dev < 0) {
-    newmount->ref = 0;
+    kmem_cache_free(mount_holder.cache, newmountentry);
     cprintf("failed to create device.\n");
     return -1;
   }
 
-  acquire(&myproc()->nsproxy->mount_ns->lock);
-  struct mount_list *current = getactivemounts();
-  while (current != 0) {
-    if (current->mnt.parent == parent && current->mnt.mountpoint == mountpoint) {
-      // error - mount already exists.
-      release(&myproc()->nsproxy->mount_ns->lock);
-      deviceput(dev);
-      newmount->ref = 0;
-      cprintf("mount already exists at that point.\n");
-      return -1;
-    }
-    current = current->next;
+  acquirewrite(&ns->lock);
+  if (mntfind(ns, mountpoint, parent) != 0) {
+    // error - mount already exists.
+    releasewrite(&ns->lock);
+    deviceput(dev);
+    kmem_cache_free(mount_holder.cache, newmountentry);
+    cprintf("mount already exists at that point.\n");
+    return -1;
   }
 
   mntdup(parent);
 
-  addmountinternal(newmountentry, dev, mountpoint, parent);
-  release(&myproc()->nsproxy->mount_ns->lock);
+  addmountinternal(ns, newmountentry, dev, mountpoint, parent);
+  releasewrite(&ns->lock);
   return 0;
 }
 
 int
 umount(struct mount *mnt)
 {
-  acquire(&myproc()->nsproxy->mount_ns->lock);
-  struct mount_list *current = getactivemounts();
-  struct mount_list **previous = &(myproc()->nsproxy->mount_ns->active_mounts);
-  while (current != 0) {
-    if (&current->mnt == mnt) {
-      break;
-    }
-    previous = &current->next;
-    current = current->next;
-  }
+  struct mount_ns *ns = myproc()->nsproxy->mount_ns;
 
-  if (current == 0) {
+  acquirewrite(&ns->lock);
+  struct mount_list *current = mntfind(ns, mnt->mountpoint, mnt->parent);
+  if (current == 0 || &current->mnt != mnt) {
     // error - not actually mounted.
-    release(&myproc()->nsproxy->mount_ns->lock);
+    releasewrite(&ns->lock);
     cprintf("current=0\n");
     return -1;
   }
 
   if (current->mnt.parent == 0) {
     // error - can't unmount root filesystem
-    release(&myproc()->nsproxy->mount_ns->lock);
+    releasewrite(&ns->lock);
     cprintf("current->mnt.parent == 0\n");
     return -1;
   }
 
-  acquire(&mount_holder.mnt_list_lock);
-  
-  // Base ref is 1, +1 for the mount being acquired before entering this method.
-  if (current->mnt.ref > 2) {
+  if (mntclaim(&current->mnt) != 0) {
     // error - can't unmount as there are references.
-    release(&mount_holder.mnt_list_lock);
-    release(&myproc()->nsproxy->mount_ns->lock);
+    releasewrite(&ns->lock);
     return -1;
   }
 
-  // remove from linked list
-  *previous = current->next;
-  release(&myproc()->nsproxy->mount_ns->lock);
-
-  struct inode *oldmountpoint = current->mnt.mountpoint;
-  int olddev = current->mnt.dev;
-  current->mnt.mountpoint = 0;
-  current->mnt.parent->ref--;
-  current->mnt.ref = 0;
-  current->mnt.dev = 0;
-  current->next = 0;
-  
-  release(&mount_holder.mnt_list_lock);
-
-  iput(oldmountpoint);
-  deviceput(olddev);
+  mntunlink(ns, current);
+  releasewrite(&ns->lock);
+
+  mntfree(current);
   return 0;
 }
 
 struct mount*
 mntlookup(struct inode *mountpoint, struct mount *parent)
 {
-  acquire(&myproc()->nsproxy->mount_ns->lock);
+  struct mount_ns *ns = myproc()->nsproxy->mount_ns;
+  struct mount *mnt = 0;
 
-  struct mount_list *entry = getactivemounts();
-  while (entry != 0) {
-    if (entry->mnt.mountpoint == mountpoint && entry->mnt.parent == parent) {
-      release(&myproc()->nsproxy->mount_ns->lock);
-      return mntdup(&entry->mnt);
-    }
-    entry = entry->next;
+  acquireread(&ns->lock);
+  struct mount_list *entry = mntfind(ns, mountpoint, parent);
+  if (entry != 0) {
+    mnt = mntdup(&entry->mnt);
   }
-
-  release(&myproc()->nsproxy->mount_ns->lock);
-  return 0;
+  releaseread(&ns->lock);
+  return mnt;
 }
 
 void
 printmounts(void)
 {
-  acquire(&myproc()->nsproxy->mount_ns->lock);
+  struct mount_ns *ns = myproc()->nsproxy->mount_ns;
 
-  struct mount_list *entry = getactivemounts();
+  acquireread(&ns->lock);
+
+  struct mount_list *entry = ns->active_mounts;
   int i = 0;
   cprintf("Printing mounts:\n");
   while (entry != 0) {
@@ -225,95 +293,115 @@ printmounts(void)
     entry = entry->next;
   }
 
-  release(&myproc()->nsproxy->mount_ns->lock);
+  releaseread(&ns->lock);
 }
 
+// Unmount everything in a namespace that is no longer referenced,
+// so no lock is needed.
 void
-umountall(struct mount_list* mounts)
+umountall(struct mount_ns *ns)
 {
-  while (mounts != 0) {
-    struct mount_list* next = mounts->next;
-    if (mounts->mnt.parent == 0) {
-      // No need to unmount root - 
-      mounts->mnt.ref = 0;
-    } else if (umount(&mounts->mnt) != 0) {
+  struct mount_list *entry;
+
+  // Children are in front of their parents, so they go first.
+  while ((entry = ns->active_mounts) != 0) {
+    if (entry->mnt.parent == 0) {
+      // No need to unmount root -
+      entry->mnt.ref = 0;
+    } else if (mntclaim(&entry->mnt) != 0) {
       panic("failed to umount upon namespace close");
     }
-    mounts = next;
+    mntunlink(ns, entry);
+    mntfree(entry);
   }
 }
 
-static struct mount_list*
-shallowcopyactivemounts(struct mount **newcwdmount)
+// Free a list of copied mounts that was never linked into a namespace.
+static void
+freemntchain(struct mount_list *entry)
 {
-  struct mount_list *head = 0;
-  struct mount_list *entry = myproc()->nsproxy->mount_ns->active_mounts;
-  struct mount_list *prev = 0;
   while (entry != 0) {
+    struct mount_list *next = entry->next;
+    mntfree(entry);
+    entry = next;
+  }
+}
+
+// Copy the entries of oldns into a new list in the same order. Each
+// old entry records its copy, so parents are translated in a second
+// pass without searching the list. Caller must hold oldns->lock for
+// writing, since the copy fields are shared. On failure *head holds
+// what was copied so far, with no parents set.
+static int
+copymountlist(struct mount_ns *oldns, struct mount_list **head, struct mount **newcwdmount)
+{
+  struct mount_list *entry;
+  struct mount_list *prev = 0;
+
+  *head = 0;
+  for (entry = oldns->active_mounts; entry != 0; entry = entry->next) {
     struct mount_list* newentry = allocmntlist();
-    if (head == 0) {
-      head = newentry;
+    if (newentry == 0) {
+      return -1;
+    }
+    if (*head == 0) {
+      *head = newentry;
+    }
+    if (entry->mnt.mountpoint != 0) {
+      newentry->mnt.mountpoint = idup(entry->mnt.mountpoint);
     }
-    newentry->mnt.ref = 1;
-    newentry->mnt.mountpoint = idup(entry->mnt.mountpoint);
-    newentry->mnt.parent = 0;
     newentry->mnt.dev=entry->mnt.dev;
     deviceget(newentry->mnt.dev);
+    newentry->prev = prev;
     if (prev != 0) {
       prev->next = newentry;
     }
+    entry->copy = newentry;
 
-    if (myproc()->cwdmount == &entry->mnt) {
+    if (myproc()->files->cwdmount == &entry->mnt) {
       *newcwdmount = &newentry->mnt;
     }
 
     prev = newentry;
-    entry = entry->next;
   }
-  
-
-  return head;
-}
-
-static void
-fixparents(struct mount_list* newentry)
-{
-  struct mount_list *entry = myproc()->nsproxy->mount_ns->active_mounts;
 
-  while (entry != 0) {    
+  for (entry = oldns->active_mounts; entry != 0; entry = entry->next) {
     if (entry->mnt.parent != 0) {
-      struct mount_list *finder = myproc()->nsproxy->mount_ns->active_mounts;
-      struct mount_list *newfinder = newentry;
-      while (finder != 0 && entry->mnt.parent != &finder->mnt) {
-        finder = finder->next;
-        newfinder = newfinder->next;
-      }
-
-      if (finder == 0) {
-        panic("invalid mount tree structure");
-      }
-
-      newentry->mnt.parent = mntdup(&newfinder->mnt);
+      entry->copy->mnt.parent = mntdup(&MNTLIST(entry->mnt.parent)->copy->mnt);
     }
-
-    newentry = newentry->next;
-    entry = entry->next;
   }
+
+  return 0;
 }
 
-struct mount_list*
-copyactivemounts(void)
+// Fill ns, a new namespace, with a copy of the current process's
+// mounts and move the process's working directory into the copy.
+// The process must not share its file table with threads.
+// Returns -1 if memory cannot be allocated.
+int
+copyactivemounts(struct mount_ns *ns)
 {
-  acquire(&myproc()->nsproxy->mount_ns->lock);
-  struct mount *oldcwdmount = myproc()->cwdmount;
+  struct mount_ns *oldns = myproc()->nsproxy->mount_ns;
+  struct mount *oldcwdmount = myproc()->files->cwdmount;
   struct mount *newcwdmount = 0;
-  struct mount_list *newentry = shallowcopyactivemounts(&newcwdmount);
-  fixparents(newentry);
-  release(&myproc()->nsproxy->mount_ns->lock);
+  struct mount_list *newentry;
 
-  myproc()->cwdmount = mntdup(newcwdmount);
+  acquirewrite(&oldns->lock);
+  if (copymountlist(oldns, &newentry, &newcwdmount) != 0) {
+    releasewrite(&oldns->lock);
+    freemntchain(newentry);
+    return -1;
+  }
+  releasewrite(&oldns->lock);
+
+  ns->active_mounts = newentry;
+  for (; newentry != 0; newentry = newentry->next) {
+    mnthashadd(ns, newentry);
+  }
+
+  myproc()->files->cwdmount = mntdup(newcwdmount);
   mntput(oldcwdmount);
-  return newentry;
+  return 0;
 }
 
 struct mount*
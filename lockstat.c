@@ -0,0 +1,27 @@
+// Print spinlock contention statistics.
+// The kernel must be built with lockstat=true.
+//
+// usage: lockstat [-r]
+//   -r  clear the counters after printing them
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+int
+main(int argc, char **argv)
+{
+  int reset = 0;
+
+  if(argc > 2 || (argc == 2 && strcmp(argv[1], "-r") != 0)){
+    printf(2, "usage: lockstat [-r]\n");
+    exit(1);
+  }
+  if(argc == 2)
+    reset = 1;
+  if(lockstat(reset) < 0){
+    printf(2, "lockstat: kernel built without lockstat=true\n");
+    exit(1);
+  }
+  exit(0);
+}
@@ -0,0 +1,78 @@
+// Spinlock torture benchmark.
+// Runs one process per CPU, each acquiring and releasing the same
+// kernel lock for a while, and reports how often each process got
+// the lock: the total measures throughput, the spread fairness.
+//
+// usage: locktorture [nproc [msec]]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define MAXPROC 8
+
+int
+main(int argc, char **argv)
+{
+  int nproc = 4, msec = 1000;
+  int fds[2], count[MAXPROC], result[2];
+  int i, n, total, min, max;
+
+  if(argc > 1)
+    nproc = atoi(argv[1]);
+  if(argc > 2)
+    msec = atoi(argv[2]);
+  if(argc > 3 || nproc < 1 || nproc > MAXPROC || msec < 1){
+    printf(2, "usage: locktorture [nproc [msec]], nproc <= %d\n", MAXPROC);
+    exit(1);
+  }
+
+  if(pipe(fds) < 0){
+    printf(2, "locktorture: pipe failed\n");
+    exit(1);
+  }
+  for(i = 0; i < nproc; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf(2, "locktorture: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      close(fds[0]);
+      result[0] = i;
+      result[1] = locktorture(msec * 1000);
+      write(fds[1], result, sizeof(result));
+      exit(0);
+    }
+  }
+  close(fds[1]);
+
+  // Each result is a single write smaller than the pipe buffer,
+  // so results from different children don't interleave.
+  for(n = 0; n < nproc; n++){
+    if(read(fds[0], result, sizeof(result)) != sizeof(result) ||
+       result[0] < 0 || result[0] >= nproc){
+      printf(2, "locktorture: lost a result\n");
+      exit(1);
+    }
+    count[result[0]] = result[1];
+  }
+  close(fds[0]);
+  for(n = 0; n < nproc; n++)
+    wait(0);
+
+  total = 0;
+  min = max = count[0];
+  for(i = 0; i < nproc; i++){
+    printf(1, "proc %d: %d\n", i, count[i]);
+    total += count[i];
+    if(count[i] < min)
+      min = count[i];
+    if(count[i] > max)
+      max = count[i];
+  }
+  printf(1, "total %d acquisitions in %d ms, %d per ms\n",
+         total, msec, total / msec);
+  printf(1, "fairness (min/max) %d%%\n", max ? min * 100 / max : 100);
+  exit(0);
+}
@@ -79,8 +79,8 @@ install_trans(void)
     struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
     memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
     bwrite(dbuf);  // write dst to disk
-    cgroup_mem_stat_file_dirty_decr(dbuf->cgroup);
-    cgroup_mem_stat_file_dirty_aggregated_incr(dbuf->cgroup);
+    cgroup_mem_stat_file_dirty_decr(dbuf->dirty_cgroup);
+    cgroup_mem_stat_file_dirty_aggregated_incr(dbuf->dirty_cgroup);
     brelse(lbuf);
     brelse(dbuf);
   }
@@ -113,7 +113,8 @@ write_head(void)
   for (i = 0; i < log.lh.n; i++) {
     hb->block[i] = log.lh.block[i];
   }
-  bwrite(buf);
+  // The header is shared by all cgroups in the transaction.
+  bwritefor(buf, cgroup_root());
   brelse(buf);
 }
 
@@ -130,6 +131,11 @@ recover_from_log(void)
 void
 begin_op(void)
 {
+  // Hold back a cgroup over its limits before it takes any file
+  // system lock. Its writes reach the disk in a later commit.
+  cgroup_io_throttle(-1, 0);
+  cgroup_io_throttle(-1, 1);
+
   acquire(&log.lock);
   while(1){
     if(log.committing){
@@ -188,7 +194,9 @@ write_log(void)
     struct buf *to = bread(log.dev, log.start+tail+1); // log block
     struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
     memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
+    // The copy is charged to the cgroup that dirtied the block,
+    // not to the process that happens to commit.
+    bwritefor(to, from->dirty_cgroup ? from->dirty_cgroup : cgroup_root());
     brelse(from);
     brelse(to);
   }
@@ -239,8 +247,8 @@ log_write(struct buf *b)
   log.lh.block[i] = b->blockno;
   if (i == log.lh.n) {
     log.lh.n++;
-    b->cgroup = proc_get_cgroup();
-    cgroup_mem_stat_file_dirty_incr(b->cgroup);
+    b->dirty_cgroup = proc_get_cgroup();
+    cgroup_mem_stat_file_dirty_incr(b->dirty_cgroup);
   }
   b->flags |= B_DIRTY; // prevent eviction
   release(&log.lock);
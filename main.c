@@ -29,6 +29,7 @@ main(void)
   mpinit();        // detect other processors
   lapicinit();     // interrupt controller
   seginit();       // segment descriptors
+  slabinit();      // kernel object caches
   picinit();       // disable pic
   ioapicinit();    // another interrupt controller
   consoleinit();   // console hardware
@@ -37,14 +38,18 @@ main(void)
   pinit();         // process table
   tvinit();        // trap vectors
   binit();         // buffer cache
-  fileinit();      // file table
+  pipeinit();      // pipe cache
+  futexinit();     // futex wait queues
+  shminit();       // shared memory segments
+  mmapinit();      // mapped files and their page cache
   ideinit();       // disk
   startothers();   // start other processors
   kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // must come after startothers()
+  fileinit();      // file table, sized by the free memory
   cginit();        // cgroup table, must come before userinit()
+  namespaceinit(); // initialize namespaces, must come before userinit()
   userinit();      // first user process
   devinit();       // initialize devices
-  namespaceinit(); // initialize namespaces
   mpmain();        // finish this processor's setup
 }
 
@@ -64,6 +69,7 @@ mpmain(void)
 {
   cprintf("cpu%d: starting %d\n", cpuid(), cpuid());
   idtinit();       // load idt register
+  sysenterinit();  // fast system call entry
   xchg(&(mycpu()->started), 1); // tell startothers() we're up
   scheduler();     // start running processes
 }
@@ -8,6 +8,13 @@
 #define KERNBASE 0x80000000         // First kernel virtual address
 #define KERNLINK (KERNBASE+EXTMEM)  // Address where kernel is linked
 
+// Shared memory segments are mapped just below the kernel, one
+// SHMMAXSIZE slot per segment. Mapped files go between MMAPBASE and
+// the segments; process memory must stay below MMAPBASE.
+#define SHMMAXSIZE (SHMMAXPAGES*PGSIZE)
+#define SHMBASE (KERNBASE - NSHM*SHMMAXSIZE)
+#define MMAPBASE 0x40000000
+
 #define V2P(a) (((uint) (a)) - KERNBASE)
 #define P2V(a) (((void *) (a)) + KERNBASE)
 
@@ -0,0 +1,541 @@
+// Memory-mapped files.
+//
+// mmap() records a mapping of a file in the vma table and maps
+// nothing; pages are mapped on demand by mmapfault() when the
+// process touches them. The mappings belong to a page table, like
+// shared memory segments: fork copies them and the last process to
+// leave an address space through exit or exec unmaps them.
+//
+// Mapped file pages come from a page cache of whole pages, so
+// processes mapping the same file page share one physical page.
+// A MAP_SHARED mapping maps the cached page itself, writable if the
+// mapping is. A MAP_PRIVATE mapping maps it read-only and replaces
+// it with a private copy on the first write. The hardware marks
+// written pages with PTE_D, and munmap writes those of shared
+// mappings back to the file through the log. writei() updates the
+// cached copy of a page, so mappings see later writes to the file;
+// read() sees writes through a mapping once it is unmapped.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "fs.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "fcntl.h"
+#include "cgroup.h"
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+struct cpage {
+  uint dev;
+  uint inum;                   // 0 once the file is truncated
+  uint pgoff;                  // page number in the file
+  int ref;                     // page table entries mapping the page
+  int valid;                   // page has been read from the file?
+  struct sleeplock lock;       // held while reading the page in
+  char *page;
+  struct cpage *prev;          // LRU cache list
+  struct cpage *next;
+};
+
+static struct {
+  struct spinlock lock;
+  struct cpage cpage[NPCACHE];
+
+  // Linked list of all pages, through prev/next.
+  // head.next is most recently used.
+  struct cpage head;
+} pcache;
+
+struct vma {
+  pde_t *pgdir;                // address space, 0 if the slot is free
+  uint addr;
+  uint len;                    // multiple of PGSIZE
+  int prot;
+  int flags;
+  struct file *file;
+  uint off;                    // file offset of addr
+};
+
+static struct {
+  struct spinlock lock;
+  struct vma vma[NVMA];
+} vmatable;
+
+void
+mmapinit(void)
+{
+  struct cpage *c;
+
+  initlock(&vmatable.lock, "vmatable");
+  initlock(&pcache.lock, "pcache");
+  pcache.head.prev = &pcache.head;
+  pcache.head.next = &pcache.head;
+  for(c = pcache.cpage; c < pcache.cpage+NPCACHE; c++){
+    c->next = pcache.head.next;
+    c->prev = &pcache.head;
+    initsleeplock(&c->lock, "cpage");
+    pcache.head.next->prev = c;
+    pcache.head.next = c;
+  }
+}
+
+// Return the cached page pgoff of file ip with a reference,
+// reading it in if needed. Returns 0 if memory is short.
+static struct cpage*
+pget(struct inode *ip, uint pgoff)
+{
+  struct cgroup *cg = proc_get_cgroup();
+  struct cpage *c;
+
+  acquire(&pcache.lock);
+  for(c = pcache.head.next; c != &pcache.head; c = c->next){
+    if(c->dev == ip->dev && c->inum == ip->inum && c->pgoff == pgoff){
+      c->ref++;
+      release(&pcache.lock);
+      goto found;
+    }
+  }
+
+  // Not cached; recycle the least recently used unmapped page.
+  for(c = pcache.head.prev; c != &pcache.head; c = c->prev){
+    if(c->ref == 0){
+      c->dev = ip->dev;
+      c->inum = ip->inum;
+      c->pgoff = pgoff;
+      c->valid = 0;
+      c->ref = 1;
+      release(&pcache.lock);
+      goto found;
+    }
+  }
+  release(&pcache.lock);
+  return 0;
+
+found:
+  acquiresleep(&c->lock);
+  if(c->page == 0 && (c->page = kalloc()) == 0){
+    releasesleep(&c->lock);
+    acquire(&pcache.lock);
+    c->ref--;
+    c->inum = 0;
+    release(&pcache.lock);
+    return 0;
+  }
+  // Read in under the inode lock, so that writei() either sees the
+  // page valid and updates it or runs before it is read.
+  ilock(ip);
+  if(!c->valid){
+    memset(c->page, 0, PGSIZE);
+    readi(ip, c->page, pgoff*PGSIZE, PGSIZE);
+    c->valid = 1;
+  } else
+    cgroup_mem_stat_pgfault_incr(cg);
+  iunlock(ip);
+  releasesleep(&c->lock);
+  return c;
+}
+
+// Drop a reference to c.
+static void
+pput(struct cpage *c)
+{
+  acquire(&pcache.lock);
+  c->ref--;
+  if(c->ref == 0){
+    // no one is waiting for it.
+    c->next->prev = c->prev;
+    c->prev->next = c->next;
+    c->next = pcache.head.next;
+    c->prev = &pcache.head;
+    pcache.head.next->prev = c;
+    pcache.head.next = c;
+  }
+  release(&pcache.lock);
+}
+
+// Return the cached page at physical address pa, or 0 if pa is a
+// private copy. Caller must hold pcache.lock.
+static struct cpage*
+plookup(uint pa)
+{
+  struct cpage *c;
+
+  for(c = pcache.cpage; c < pcache.cpage+NPCACHE; c++)
+    if(c->ref > 0 && c->page && V2P(c->page) == pa)
+      return c;
+  return 0;
+}
+
+// Drop the mapping of the page at physical address pa.
+static void
+putpage(uint pa)
+{
+  struct cpage *c;
+
+  acquire(&pcache.lock);
+  c = plookup(pa);
+  release(&pcache.lock);
+  if(c)
+    pput(c);
+  else
+    kfree(P2V(pa));
+}
+
+// Copy n bytes written at off in ip to the cached pages.
+// Called by writei(); caller must hold ip->lock.
+void
+pcache_write(struct inode *ip, char *src, uint off, uint n)
+{
+  struct cpage *c;
+  uint start, end;
+
+  acquire(&pcache.lock);
+  for(c = pcache.cpage; c < pcache.cpage+NPCACHE; c++){
+    if(!c->valid || c->dev != ip->dev || c->inum != ip->inum)
+      continue;
+    start = c->pgoff * PGSIZE;
+    end = start + PGSIZE;
+    if(off >= end || off + n <= start)
+      continue;
+    if(off > start)
+      memmove(c->page + (off - start), src, min(n, end - off));
+    else
+      memmove(c->page, src + (start - off), min(off + n - start, PGSIZE));
+  }
+  release(&pcache.lock);
+}
+
+// Forget the cached pages of ip, whose contents are being freed.
+// Pages still mapped stay with their mappings.
+void
+pcache_invalidate(struct inode *ip)
+{
+  struct cpage *c;
+
+  acquire(&pcache.lock);
+  for(c = pcache.cpage; c < pcache.cpage+NPCACHE; c++){
+    if(c->dev == ip->dev && c->inum == ip->inum){
+      c->inum = 0;
+      c->valid = 0;
+    }
+  }
+  release(&pcache.lock);
+}
+
+// Return the mapping containing va in pgdir.
+// Caller must hold vmatable.lock.
+static struct vma*
+vmafind(pde_t *pgdir, uint va)
+{
+  struct vma *v;
+
+  for(v = vmatable.vma; v < &vmatable.vma[NVMA]; v++)
+    if(v->pgdir == pgdir && va >= v->addr && va < v->addr + v->len)
+      return v;
+  return 0;
+}
+
+// Write the page at va of shared mapping v back to its file.
+static void
+writeback(struct vma *v, uint va, char *page)
+{
+  int max = ((MAXOPBLOCKS-1-1-2) / 2) * 512;
+  struct inode *ip = v->file->ip;
+  uint off, n, i, n1;
+
+  off = v->off + (va - v->addr);
+  for(i = 0; ; i += n1){
+    begin_op();
+    ilock(ip);
+    // Never extend the file past its size.
+    n = off < ip->size ? min(ip->size - off, PGSIZE) : 0;
+    n1 = min(n - min(i, n), max);
+    if(n1 > 0)
+      writei(ip, page + i, off + i, n1);
+    iunlock(ip);
+    end_op();
+    if(n1 == 0)
+      break;
+  }
+}
+
+// Unmap the pages of v, which is no longer in vmatable. The pages
+// may already have been made not present by unmapuvm().
+static void
+unmapvma(struct vma *v)
+{
+  pte_t *pte;
+  uint va;
+
+  for(va = v->addr; va < v->addr + v->len; va += PGSIZE){
+    if((pte = walkpgdir(v->pgdir, (char*)va, 0)) == 0 || PTE_ADDR(*pte) == 0)
+      continue;
+    if((v->flags & MAP_SHARED) && (*pte & PTE_D))
+      writeback(v, va, P2V(PTE_ADDR(*pte)));
+    putpage(PTE_ADDR(*pte));
+    *pte = 0;
+  }
+  fileclose(v->file);
+}
+
+// Map len bytes of f from offset off into the current process.
+// Returns the address of the mapping, or -1.
+int
+mmap(uint len, int prot, int flags, struct file *f, uint off)
+{
+  struct proc *curproc = myproc();
+  struct vma *v, *slot;
+  uint addr;
+  int moved;
+
+  if(len == 0 || len > SHMBASE - MMAPBASE || off % PGSIZE != 0)
+    return -1;
+  if(flags != MAP_SHARED && flags != MAP_PRIVATE)
+    return -1;
+  if(!(prot & PROT_READ) || (prot & ~(PROT_READ|PROT_WRITE)))
+    return -1;
+  if(f->type != FD_INODE || f->ip->type != T_FILE || !f->readable)
+    return -1;
+  if(flags == MAP_SHARED && (prot & PROT_WRITE) && !f->writable)
+    return -1;
+  len = PGROUNDUP(len);
+
+  acquire(&vmatable.lock);
+  slot = 0;
+  for(v = vmatable.vma; v < &vmatable.vma[NVMA]; v++)
+    if(v->pgdir == 0){
+      slot = v;
+      break;
+    }
+
+  // Take the lowest free range that fits.
+  addr = MMAPBASE;
+  do {
+    moved = 0;
+    for(v = vmatable.vma; v < &vmatable.vma[NVMA]; v++){
+      if(v->pgdir == curproc->pgdir &&
+         addr < v->addr + v->len && v->addr < addr + len){
+        addr = v->addr + v->len;
+        moved = 1;
+      }
+    }
+  } while(moved && addr + len <= SHMBASE);
+  if(slot == 0 || addr + len > SHMBASE){
+    release(&vmatable.lock);
+    return -1;
+  }
+
+  slot->pgdir = curproc->pgdir;
+  slot->addr = addr;
+  slot->len = len;
+  slot->prot = prot;
+  slot->flags = flags;
+  slot->file = filedup(f);
+  slot->off = off;
+  release(&vmatable.lock);
+  return addr;
+}
+
+// Remove the mapping at addr of len bytes from the current process,
+// writing back pages written through a shared mapping. Only a whole
+// mapping can be removed.
+int
+munmap(uint addr, uint len)
+{
+  struct proc *curproc = myproc();
+  struct vma *v, copy;
+
+  acquire(&vmatable.lock);
+  if((v = vmafind(curproc->pgdir, addr)) == 0 ||
+     v->addr != addr || v->len != PGROUNDUP(len)){
+    release(&vmatable.lock);
+    return -1;
+  }
+  copy = *v;
+  v->pgdir = 0;
+  release(&vmatable.lock);
+
+  // Threads on other cpus may still cache the pages and write to them,
+  // so the dirty bits are only final once their TLBs are flushed.
+  if(curproc->mm){
+    unmapuvm(copy.pgdir, copy.addr + copy.len, copy.addr);
+    tlbshootdown(curproc->mm);
+  }
+  unmapvma(&copy);
+  lcr3(V2P(curproc->pgdir));
+  return 0;
+}
+
+// Remove every mapping of pgdir. Called by the last process to
+// leave an address space, and by freevm() for page tables that
+// never got that far.
+void
+munmapall(pde_t *pgdir)
+{
+  struct vma *v, copy;
+
+  for(;;){
+    acquire(&vmatable.lock);
+    for(v = vmatable.vma; v < &vmatable.vma[NVMA]; v++)
+      if(v->pgdir == pgdir)
+        break;
+    if(v == &vmatable.vma[NVMA]){
+      release(&vmatable.lock);
+      return;
+    }
+    copy = *v;
+    v->pgdir = 0;
+    release(&vmatable.lock);
+    unmapvma(&copy);
+  }
+}
+
+// Give the child page table d the mappings of pgdir, sharing the
+// pages in the page cache and copying private ones. The child's
+// pages start clean, so only the parent writes back what it wrote.
+// Used by copyuvm().
+int
+mmapcopy(pde_t *pgdir, pde_t *d)
+{
+  struct vma *v, *nv;
+  pte_t *pte, *dpte;
+  struct cpage *c;
+  uint va, pa;
+  char *mem;
+
+  acquire(&vmatable.lock);
+  for(v = vmatable.vma; v < &vmatable.vma[NVMA]; v++){
+    if(v->pgdir != pgdir)
+      continue;
+    for(nv = vmatable.vma; nv < &vmatable.vma[NVMA]; nv++)
+      if(nv->pgdir == 0)
+        break;
+    if(nv == &vmatable.vma[NVMA])
+      goto bad;
+    *nv = *v;
+    nv->pgdir = d;
+    filedup(nv->file);
+
+    for(va = v->addr; va < v->addr + v->len; va += PGSIZE){
+      if((pte = walkpgdir(pgdir, (char*)va, 0)) == 0 || !(*pte & PTE_P))
+        continue;
+      pa = PTE_ADDR(*pte);
+      acquire(&pcache.lock);
+      if((c = plookup(pa)) != 0)
+        c->ref++;
+      release(&pcache.lock);
+      if(c == 0){
+        if((mem = kalloc()) == 0)
+          goto bad;
+        memmove(mem, P2V(pa), PGSIZE);
+        pa = V2P(mem);
+      }
+      if((dpte = walkpgdir(d, (char*)va, 1)) == 0){
+        putpage(pa);
+        goto bad;
+      }
+      *dpte = pa | (PTE_FLAGS(*pte) & ~(PTE_D|PTE_A));
+    }
+  }
+  release(&vmatable.lock);
+  return 0;
+
+bad:
+  release(&vmatable.lock);
+  munmapall(d);
+  return -1;
+}
+
+// Map in the page of a mapped file at va on a page fault with
+// error code err. Returns 0 if the faulting access can be retried,
+// -1 if va is not in a mapping that allows the access.
+int
+mmapfault(uint va, uint err)
+{
+  struct proc *curproc = myproc();
+  struct vma *v;
+  struct file *f;
+  struct cpage *c, *old;
+  pte_t *pte;
+  uint off, pa, perm;
+  int prot, flags;
+  char *mem;
+
+  va = PGROUNDDOWN(va);
+  acquire(&vmatable.lock);
+  if((v = vmafind(curproc->pgdir, va)) == 0 ||
+     ((err & FEC_WR) && !(v->prot & PROT_WRITE))){
+    release(&vmatable.lock);
+    return -1;
+  }
+  f = filedup(v->file);
+  off = v->off + (va - v->addr);
+  prot = v->prot;
+  flags = v->flags;
+  release(&vmatable.lock);
+
+  cgroup_io_throttle(f->ip->dev, 0);
+  if((c = pget(f->ip, off / PGSIZE)) == 0)
+    goto bad;
+  if(flags == MAP_PRIVATE && (err & FEC_WR)){
+    // Copy on write.
+    if((mem = kalloc()) == 0){
+      pput(c);
+      goto bad;
+    }
+    memmove(mem, c->page, PGSIZE);
+    pput(c);
+    pa = V2P(mem);
+    perm = PTE_W|PTE_U;
+  } else {
+    pa = V2P(c->page);
+    perm = PTE_U;
+    if(flags == MAP_SHARED && (prot & PROT_WRITE))
+      perm |= PTE_W;
+  }
+
+  // The mapping may have gone, or another thread may have faulted
+  // the page in, while the page was read.
+  acquire(&vmatable.lock);
+  if((v = vmafind(curproc->pgdir, va)) == 0 || v->file != f ||
+     (pte = walkpgdir(curproc->pgdir, (char*)va, 1)) == 0){
+    release(&vmatable.lock);
+    putpage(pa);
+    goto bad;
+  }
+  if((*pte & PTE_P) && ((*pte & PTE_W) || !(err & FEC_WR))){
+    release(&vmatable.lock);
+    putpage(pa);
+    fileclose(f);
+    return 0;
+  }
+  old = 0;
+  if(*pte & PTE_P){
+    // Replace the read-only cached page of a private mapping.
+    acquire(&pcache.lock);
+    old = plookup(PTE_ADDR(*pte));
+    release(&pcache.lock);
+  }
+  *pte = pa | perm | PTE_P;
+  release(&vmatable.lock);
+  if(old){
+    // Other threads may still read the old page until their TLBs
+    // are flushed.
+    tlbshootdown(curproc->mm);
+    pput(old);
+  }
+  lcr3(V2P(curproc->pgdir));
+  fileclose(f);
+  return 0;
+
+bad:
+  fileclose(f);
+  return -1;
+}
@@ -5,4 +5,3 @@ struct mount {
   uint dev;
 };
 
-#define NMOUNT (200)
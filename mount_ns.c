@@ -5,6 +5,7 @@
 #include "mmu.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "rwlock.h"
 #include "fs.h"
 #include "sleeplock.h"
 #include "file.h"
@@ -14,15 +15,13 @@
 
 struct {
   struct spinlock lock;
-  struct mount_ns mount_ns[NNAMESPACE];
+  struct kmem_cache* cache;
 } mountnstable;
 
 void mount_nsinit()
 {
   initlock(&mountnstable.lock, "mountns");
-  for (int i = 0; i < NNAMESPACE; i++) {
-    initlock(&mountnstable.mount_ns[i].lock, "mount_ns");
-  }
+  mountnstable.cache = kmem_cache_create("mount_ns", sizeof(struct mount_ns));
 }
 
 struct mount_ns* mount_nsdup(struct mount_ns* mount_ns)
@@ -40,35 +39,40 @@ void mount_nsput(struct mount_ns* mount_ns)
   if (mount_ns->ref == 1) {
     release(&mountnstable.lock);
 
-    umountall(mount_ns->active_mounts);
-    mount_ns->active_mounts = 0;
+    umountall(mount_ns);
 
     acquire(&mountnstable.lock);
   }
-  mount_ns->ref--;
+  if (--mount_ns->ref == 0) {
+    kmem_cache_free(mountnstable.cache, mount_ns);
+  }
   release(&mountnstable.lock);
 }
 
 static struct mount_ns* allocmount_ns()
 {
-  acquire(&mountnstable.lock);
-  for (int i = 0; i < NNAMESPACE; i++) {
-    if (mountnstable.mount_ns[i].ref == 0) {
-      struct mount_ns* mount_ns = &mountnstable.mount_ns[i];
-      mount_ns->ref = 1;
-      release(&mountnstable.lock);
-      return mount_ns;
-    }
+  struct mount_ns* mount_ns = kmem_cache_alloc(mountnstable.cache);
+  if (!mount_ns) {
+    return 0;
   }
-  release(&mountnstable.lock);
-
-  panic("out of mount_ns objects");
+  initrwlock(&mount_ns->lock, "mount_ns");
+  mount_ns->ref = 1;
+  mount_ns->root = 0;
+  mount_ns->active_mounts = 0;
+  memset(mount_ns->mnt_hash, 0, sizeof(mount_ns->mnt_hash));
+  return mount_ns;
 }
 
 struct mount_ns* copymount_ns()
 {
   struct mount_ns* mount_ns = allocmount_ns();
-  mount_ns->active_mounts = copyactivemounts();
+  if (mount_ns == 0) {
+    return 0;
+  }
+  if (copyactivemounts(mount_ns) != 0) {
+    kmem_cache_free(mountnstable.cache, mount_ns);
+    return 0;
+  }
   mount_ns->root = getroot(mount_ns->active_mounts);
   return mount_ns;
 }
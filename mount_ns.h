@@ -3,9 +3,12 @@
  * farther in the back.
  */
 
+#define MNTHASHSIZE 32
+
 struct mount_ns {
   int ref;
-  struct spinlock lock; // protects active_mounts
+  struct rwlock lock; // protects active_mounts; lookups only read
   struct mount* root;
   struct mount_list *active_mounts;
+  struct mount_list *mnt_hash[MNTHASHSIZE]; // active_mounts by (parent, mountpoint)
 };
\ No newline at end of file
@@ -407,6 +407,45 @@ namespacetest(void) {
   }
 }
 
+static int
+nestednamespacetest(void) {
+  if (mounta() != 0) {
+    return 1;
+  }
+
+  mkdir("a/b");
+  if (mount("internal_fs_b", "a/b", 0) != 0) {
+    printf(1, "nestednamespacetest: mount failed\n");
+    return 1;
+  }
+
+  int pid = fork();
+  if (pid == 0) {
+    // The copied nested mount must hang off the copied parent.
+    if (unshare(MOUNT_NS) != 0 || testfile("a/b/nestedns") != 0) {
+      exit(1);
+    }
+    if (umount("a") != -1 || umount("a/b") != 0 || umounta() != 0) {
+      printf(1, "nestednamespacetest: bad umount in namespace\n");
+      exit(1);
+    }
+    exit(0);
+  }
+
+  int status;
+  wait(&status);
+  if (WEXITSTATUS(status) != 0) {
+    return 1;
+  }
+
+  if (unlink("a/b/nestedns") != 0 || umount("a/b") != 0 || umounta() != 0) {
+    printf(1, "nestednamespacetest: cleanup failed\n");
+    return 1;
+  }
+
+  return 0;
+}
+
 static int
 namespacefiletest(void) {
   if (mounta() != 0) {
@@ -485,6 +524,52 @@ cdinthenouttest(void) {
 }
 
 
+static int
+concurrentlookuptest(void) {
+  if (mounta() != 0) {
+    return 1;
+  }
+
+  if (createfile("a/concurrentlookup", "aaa") != 0) {
+    return 1;
+  }
+
+  // Children resolve paths through the mount at the same time;
+  // afterwards every mount reference they took must be dropped.
+  int i, j;
+  for (i = 0; i < 4; i++) {
+    int pid = fork();
+    if (pid < 0) {
+      printf(1, "concurrentlookuptest: fork failed\n");
+      return 1;
+    }
+    if (pid == 0) {
+      struct stat st;
+      for (j = 0; j < 200; j++) {
+        if (stat("a/concurrentlookup", &st) < 0) {
+          printf(1, "concurrentlookuptest: stat failed\n");
+          exit(1);
+        }
+      }
+      exit(0);
+    }
+  }
+
+  int failed = 0;
+  for (i = 0; i < 4; i++) {
+    int status;
+    wait(&status);
+    if (WEXITSTATUS(status) != 0) {
+      failed = 1;
+    }
+  }
+
+  if (unlink("a/concurrentlookup") != 0 || umounta() != 0) {
+    return 1;
+  }
+
+  return failed;
+}
 
 int
 main(int argc, char *argv[])
@@ -502,8 +587,10 @@ main(int argc, char *argv[])
   run_test(umountwithopenfiletest, "umountwithopenfiletest");
   run_test(errorondeletedevicetest, "errorondeletedevicetest");
   run_test(namespacetest, "namespacetest");
+  run_test(nestednamespacetest, "nestednamespacetest");
   run_test(namespacefiletest, "namespacefiletest");
   run_test(cdinthenouttest, "cdinthenouttest");
+  run_test(concurrentlookuptest, "concurrentlookuptest");
 
   unlink("a");
   unlink("b");
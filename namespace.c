@@ -15,13 +15,14 @@
 
 struct {
   struct spinlock lock;
-  struct nsproxy nsproxy[NNAMESPACE];
+  struct kmem_cache* cache;
 } namespacetable;
 
 void
 namespaceinit(void)
 {
     initlock(&namespacetable.lock, "namespace");
+    namespacetable.cache = kmem_cache_create("nsproxy", sizeof(struct nsproxy));
     mount_nsinit();
     pid_ns_init();
 }
@@ -39,6 +40,9 @@ namespaceput(struct nsproxy* nsproxy)
         acquire(&namespacetable.lock);
     }
     nsproxy->ref -= 1;
+    if (nsproxy->ref == 0) {
+        kmem_cache_free(namespacetable.cache, nsproxy);
+    }
     release(&namespacetable.lock);
 }
 
@@ -54,14 +58,12 @@ namespacedup(struct nsproxy* nsproxy)
 static struct nsproxy*
 allocnsproxyinternal(void)
 {
-    for (int i = 0; i < NNAMESPACE; i++) {
-        if (namespacetable.nsproxy[i].ref == 0) {
-            namespacetable.nsproxy[i].ref++;
-            return &namespacetable.nsproxy[i];
-        }
+    struct nsproxy* nsproxy = kmem_cache_alloc(namespacetable.cache);
+    if (!nsproxy) {
+        return 0;
     }
-
-    panic("out of nsproxy objects");
+    nsproxy->ref = 1;
+    return nsproxy;
 }
 
 struct nsproxy*
@@ -69,8 +71,14 @@ emptynsproxy(void)
 {
     acquire(&namespacetable.lock);
     struct nsproxy* result = allocnsproxyinternal();
+    if (result == 0) {
+        panic("emptynsproxy: out of memory");
+    }
     result->mount_ns = newmount_ns();
     result->pid_ns = pid_ns_new(0);
+    if (result->mount_ns == 0 || result->pid_ns == 0) {
+        panic("emptynsproxy: out of memory");
+    }
     release(&namespacetable.lock);
 
     return result;
@@ -80,6 +88,9 @@ struct nsproxy*
 namespace_replace_pid_ns(struct nsproxy* oldns, struct pid_ns* pid_ns)
 {
     struct nsproxy* nsproxy = allocnsproxyinternal();
+    if (nsproxy == 0) {
+        return 0;
+    }
     nsproxy->mount_ns = mount_nsdup(oldns->mount_ns);
     nsproxy->pid_ns = pid_ns_dup(pid_ns);
     return nsproxy;
@@ -91,7 +102,12 @@ unshare(int nstype)
     acquire(&namespacetable.lock);
     if (myproc()->nsproxy->ref > 1) {
         struct nsproxy *oldns = myproc()->nsproxy;
-        myproc()->nsproxy = allocnsproxyinternal();
+        struct nsproxy *newns = allocnsproxyinternal();
+        if (newns == 0) {
+            release(&namespacetable.lock);
+            return -1;
+        }
+        myproc()->nsproxy = newns;
         myproc()->nsproxy->mount_ns = mount_nsdup(oldns->mount_ns);
         myproc()->nsproxy->pid_ns = pid_ns_dup(oldns->pid_ns);
         oldns->ref--;
@@ -100,8 +116,17 @@ unshare(int nstype)
     switch(nstype) {
         case MOUNT_NS:
             {
+                // The working directory moves into the new namespace,
+                // which threads sharing it are not in.
+                if (unsharefiles() < 0) {
+                  return -1;
+                }
                 struct mount_ns* previous = myproc()->nsproxy->mount_ns;
-                myproc()->nsproxy->mount_ns = copymount_ns();
+                struct mount_ns* copy = copymount_ns();
+                if (copy == 0) {
+                  return -1;
+                }
+                myproc()->nsproxy->mount_ns = copy;
                 mount_nsput(previous);
                 return 0;
             }
@@ -112,6 +137,9 @@ unshare(int nstype)
               }
 
               myproc()->child_pid_ns = pid_ns_new(myproc()->nsproxy->pid_ns);
+              if (myproc()->child_pid_ns == 0) {
+                return -1;
+              }
               return 0;
             }
         default:
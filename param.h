@@ -1,11 +1,12 @@
 #ifndef XV6_PARAM_H
 #define XV6_PARAM_H
 
-#define NPROC        64  // maximum number of processes
+#define NPROC       512  // maximum number of processes
 #define KSTACKSIZE 4096  // size of per-process kernel stack
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
-#define NFILE       100  // open files per system
+#define NFILE      1000  // minimum open files per system
+#define NCGROUP      64  // maximum number of cgroups
 #define NINODE       50  // maximum number of active i-nodes
 #define NDEV         10  // maximum major device number
 #define MAX_TTY       4  // maximum minor tty number
@@ -16,8 +17,11 @@
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       2000  // size of file system in blocks
 #define INT_FSSIZE   80  // size of internal file systems in blocks
-#define NNAMESPACE   20  // maximum number of namespaces
 #define MAX_PATH_LENGTH 512 // maximum path length allowed
 #define MAX_CGROUP_FILE_NAME_LENGTH 64 // maximum allowed length of cgroup file name
+#define NSHM         16  // maximum number of shared memory segments
+#define SHMMAXPAGES  16  // maximum pages in a shared memory segment
+#define NVMA         64  // maximum number of file mappings
+#define NPCACHE      64  // size of the page cache for mapped files
 
 #endif
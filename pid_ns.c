@@ -12,25 +12,31 @@
 
 struct {
   struct spinlock lock;
-  struct pid_ns namespaces[NNAMESPACE];
+  struct kmem_cache* cache;
 } pidnstable;
 
 void pid_ns_init()
 {
   initlock(&pidnstable.lock, "pidns");
-  for (int i = 0; i < NNAMESPACE; i++) {
-    initlock(&pidnstable.namespaces[i].lock, "pidns");
-    pidnstable.namespaces[i].ref = 0;
-  }
+  pidnstable.cache = kmem_cache_create("pid_ns", sizeof(struct pid_ns));
 }
 
 void pid_ns_put(struct pid_ns* pid_ns)
 {
   acquire(&pidnstable.lock);
-  if (!pid_ns->ref) {
-      panic("pid_ns_put: ref == 0");
+  // A namespace holds a reference to its parent, so freeing
+  // one may release the whole chain of ancestors.
+  while (pid_ns) {
+    if (!pid_ns->ref) {
+        panic("pid_ns_put: ref == 0");
+    }
+    if (--pid_ns->ref) {
+      break;
+    }
+    struct pid_ns* parent = pid_ns->parent;
+    kmem_cache_free(pidnstable.cache, pid_ns);
+    pid_ns = parent;
   }
-  pid_ns->ref--;
   release(&pidnstable.lock);
 }
 
@@ -42,23 +48,23 @@ void pid_ns_get(struct pid_ns* pid_ns)
 }
 
 struct pid_ns* pid_ns_alloc() {
-  acquire(&pidnstable.lock);
-  for (int i = 0; i < NNAMESPACE; i++) {
-    struct pid_ns* pid_ns = &pidnstable.namespaces[i];
-    if (pid_ns->ref == 0) {
-      pid_ns->ref = 1;
-      release(&pidnstable.lock);
-      return pid_ns;
-    }
+  struct pid_ns* pid_ns = kmem_cache_alloc(pidnstable.cache);
+  if (!pid_ns) {
+    return 0;
   }
-  release(&pidnstable.lock);
-  panic("out of pid_ns objects");
+  initlock(&pid_ns->lock, "pidns");
+  pid_ns->ref = 1;
+  return pid_ns;
 }
 
 void pid_ns_init_ns(struct pid_ns* pid_ns, struct pid_ns* parent) {
+  if (parent) {
+    pid_ns_get(parent);
+  }
   pid_ns->parent = parent;
   pid_ns->next_pid = 1;
   pid_ns->pid1_ns_killed = 0;
+  memset(pid_ns->pid_hash, 0, sizeof(pid_ns->pid_hash));
 }
 struct pid_ns* pid_ns_dup(struct pid_ns* pid_ns) {
   pid_ns_get(pid_ns);
@@ -67,6 +73,9 @@ struct pid_ns* pid_ns_dup(struct pid_ns* pid_ns) {
 
 struct pid_ns* pid_ns_new(struct pid_ns* parent) {
   struct pid_ns * pid_ns = pid_ns_alloc();
+  if (pid_ns == 0) {
+    return 0;
+  }
   pid_ns_init_ns(pid_ns, parent);
   return pid_ns;
 }
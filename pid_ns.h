@@ -1,4 +1,7 @@
 #define MAX_PID_NS_DEPTH 4
+#define PIDHASHSIZE 64  // buckets in the pid to process hash of a pid_ns
+
+struct pid_entry;
 
 struct pid_ns {
   int ref;
@@ -6,6 +9,7 @@ struct pid_ns {
   struct spinlock lock;
   int next_pid;
   int pid1_ns_killed;  // Indicated whether the process with pid 1 in the namespace was killed or not
+  struct pid_entry* pid_hash[PIDHASHSIZE];  // Processes by pid, protected by ptable.lock
 };
 
 void pid_ns_init();
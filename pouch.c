@@ -428,7 +428,7 @@ static int pouch_fork(char* container_name){
         if(close(cgroup_procs_fd) < 0)
             return -1;
         if(write_to_cconf(container_name, tty_name, pid) >= 0)
-           wait(0);
+           waitpid(pid, 0, 0);
 
 
 
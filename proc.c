@@ -4,18 +4,35 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "x86.h"
+#include "traps.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "sleeplock.h"
+#include "file.h"
 #include "wstatus.h"
 #include "pid_ns.h"
 #include "namespace.h"
 #include "cpu_account.h"
 
+#define PIDHASH(pid) ((pid) & (PIDHASHSIZE - 1))
+
 struct {
   struct spinlock lock;
-  struct proc proc[NPROC];
+  struct kmem_cache *cache;
+  struct kmem_cache *mmcache;
+  struct proc *list;  // All allocated processes
+  int nproc;          // Number of allocated processes
 } ptable;
 
+// An address space shared by a process and the threads it clone()s.
+// Processes that never cloned have no mm and own their pgdir alone.
+struct mm {
+  int ref;                // processes using the address space
+  int live;               // of those, ones that have not exited
+  struct sleeplock lock;  // serializes growproc() and fork()
+  struct proc *owner;     // charged for the memory, see ownsmem()
+};
+
 /*Return the process id inside the given namespace, else returns zero*/
 int get_pid_for_ns(struct proc* proc, struct pid_ns* pid_ns) {
   for (int i = 0; i < MAX_PID_NS_DEPTH; i++) {
@@ -32,6 +49,94 @@ int proc_pid(struct proc* proc) {
 
 static struct proc *initproc;
 
+// Add p to the pid hash of every pid namespace it has a pid in.
+// The ptable lock must be held.
+static void
+pidhash_insert(struct proc *p)
+{
+  struct pid_entry *e, **bucket;
+
+  for (int i = 0; i < MAX_PID_NS_DEPTH && p->pids[i].pid_ns; i++) {
+    e = &p->pids[i];
+    bucket = &e->pid_ns->pid_hash[PIDHASH(e->pid)];
+    e->proc = p;
+    e->next = *bucket;
+    *bucket = e;
+  }
+}
+
+// Remove p from the pid hashes. The ptable lock must be held.
+static void
+pidhash_remove(struct proc *p)
+{
+  struct pid_entry *e, **pp;
+
+  for (int i = 0; i < MAX_PID_NS_DEPTH && p->pids[i].pid_ns; i++) {
+    e = &p->pids[i];
+    for (pp = &e->pid_ns->pid_hash[PIDHASH(e->pid)]; *pp; pp = &(*pp)->next) {
+      if (*pp == e) {
+        *pp = e->next;
+        break;
+      }
+    }
+    e->next = 0;
+  }
+}
+
+// Return the process whose pid inside pid_ns is pid, else 0.
+// The ptable lock must be held.
+static struct proc*
+find_proc(struct pid_ns *pid_ns, int pid)
+{
+  struct pid_entry *e;
+
+  for (e = pid_ns->pid_hash[PIDHASH(pid)]; e; e = e->next)
+    if (e->pid == pid && e->pid_ns == pid_ns)
+      return e->proc;
+  return 0;
+}
+
+// Move p to the children list of parent.
+// The ptable lock must be held.
+static void
+setparent(struct proc *p, struct proc *parent)
+{
+  if (p->parent == parent)
+    return;
+  if (p->parent) {
+    if (p->sibprev)
+      p->sibprev->sibnext = p->sibnext;
+    else
+      p->parent->children = p->sibnext;
+    if (p->sibnext)
+      p->sibnext->sibprev = p->sibprev;
+  }
+  p->parent = parent;
+  p->sibprev = 0;
+  p->sibnext = 0;
+  if (parent) {
+    p->sibnext = parent->children;
+    if (parent->children)
+      parent->children->sibprev = p;
+    parent->children = p;
+  }
+}
+
+// Unlink p from the process list and free it.
+// The ptable lock must be held.
+static void
+freeproc(struct proc *p)
+{
+  if (p->prev)
+    p->prev->next = p->next;
+  else if (ptable.list == p)
+    ptable.list = p->next;
+  if (p->next)
+    p->next->prev = p->prev;
+  ptable.nproc--;
+  kmem_cache_free(ptable.cache, p);
+}
+
 extern void forkret(void);
 extern void trapret(void);
 static void wakeup1(void *chan);
@@ -40,6 +145,198 @@ void
 pinit(void)
 {
   initlock(&ptable.lock, "ptable");
+  ptable.cache = kmem_cache_create("proc", sizeof(struct proc));
+  ptable.mmcache = kmem_cache_create("mm", sizeof(struct mm));
+}
+
+// Drop a use of the address space pgdir, shared through mm if mm is
+// not 0, and free it with the last use.
+void
+mmput(struct mm *mm, pde_t *pgdir)
+{
+  if(mm != 0 && __sync_sub_and_fetch(&mm->ref, 1) > 0)
+    return;
+  freevm(pgdir);
+  if(mm != 0)
+    kmem_cache_free(ptable.mmcache, mm);
+}
+
+// Called by a process leaving the address space pgdir, shared
+// through mm if mm is not 0, by exit() or exec(). The last process
+// to leave removes its file mappings, which may sleep, while the
+// address space itself is freed later by mmput().
+void
+mmleave(struct mm *mm, pde_t *pgdir)
+{
+  if(mm != 0 && __sync_sub_and_fetch(&mm->live, 1) > 0)
+    return;
+  munmapall(pgdir);
+}
+
+// Is p charged for the memory of its address space? An address space
+// shared by threads is charged once, to the one owning it.
+int
+ownsmem(struct proc *p)
+{
+  return p->mm == 0 || p->mm->owner == p;
+}
+
+// Make p stop owning its address space, if it does: another thread
+// of it that is still alive is charged for the address space instead,
+// so it stays charged until the last thread is gone. Called with the
+// ptable lock held, once p is no longer charged for it.
+static void
+mmdisown(struct proc *p)
+{
+  struct mm *mm = p->mm;
+  struct cgroup *cgroup;
+  struct proc *q;
+
+  if(mm == 0 || mm->owner != p)
+    return;
+  for(q = ptable.list; q; q = q->next)
+    if(q != p && q->mm == mm && !q->killed &&
+       (q->state == SLEEPING || q->state == RUNNABLE || q->state == RUNNING))
+      break;
+  mm->owner = q;
+  if(q == 0)
+    return;
+  for(cgroup = q->cgroup; cgroup; cgroup = cgroup->parent){
+    cgroup->current_mem += q->sz;
+    cgroup->current_page += PGROUNDUP(q->sz)/PGSIZE;
+  }
+}
+
+// Remove p, which is exiting or being killed, from its cgroup,
+// handing its charge for an address space other threads still use
+// to one of them. The ptable lock must be held.
+static void
+cgroup_leave(struct proc *p)
+{
+  cgroup_erase(p->cgroup, p);
+  mmdisown(p);
+}
+
+// Give the current process a file table of its own, if it shares
+// one with threads. Returns -1 if memory cannot be allocated.
+int
+unsharefiles(void)
+{
+  struct proc *curproc = myproc();
+  struct files *fs;
+
+  if(curproc->files->ref == 1)
+    return 0;
+  if((fs = filescopy(curproc->files)) == 0)
+    return -1;
+  filesput(curproc->files);
+  curproc->files = fs;
+  return 0;
+}
+
+// Mark p killed, waking it up if it sleeps. The ptable lock must
+// be held.
+static void
+setkilled(struct proc *p)
+{
+  p->killed = 1;
+  if(p->state == SLEEPING){
+    p->state = RUNNABLE;
+    cpu_account_process_runnable(p);
+  }
+}
+
+// Kill every process using the address space mm. They are all marked
+// killed before any leaves its cgroup, so the charge for mm is not
+// handed from one to the next. The ptable lock must be held.
+static void
+killmm(struct mm *mm)
+{
+  struct proc *p;
+
+  for(p = ptable.list; p; p = p->next)
+    if(p->mm == mm)
+      setkilled(p);
+  for(p = ptable.list; p; p = p->next)
+    if(p->mm == mm)
+      cgroup_leave(p);
+}
+
+// Give the current process the address space pgdir of size sz, built
+// by exec(), and charge its cgroup for it instead of the old one. The
+// other threads of an address space it shared are killed, and the
+// ones it created are passed to init to collect.
+void
+execmm(pde_t *pgdir, uint sz)
+{
+  struct proc *curproc = myproc();
+  struct mm *mm = curproc->mm;
+  struct cgroup *cgroup;
+  struct proc *p, *next;
+  uint charged;
+
+  acquire(&ptable.lock);
+  charged = PROC_CHARGED_MEM(curproc);
+  for(cgroup = curproc->cgroup; cgroup; cgroup = cgroup->parent)
+    cgroup->current_mem += sz - charged;
+  if(mm != 0){
+    if(mm->owner == curproc)
+      mm->owner = 0;
+    for(p = curproc->children; p; p = next){
+      next = p->sibnext;
+      if(p->thread && p->mm == mm){
+        setparent(p, initproc);
+        if(p->state == ZOMBIE)
+          wakeup1(initproc);
+      }
+    }
+  }
+  curproc->pgdir = pgdir;
+  curproc->mm = 0;
+  curproc->thread = 0;
+  curproc->sz = sz;
+  if(mm != 0)
+    killmm(mm);
+  release(&ptable.lock);
+}
+
+// Flush the TLB of every other cpu running a thread of mm, and wait
+// until they have, so that the pages unmapped from the address space
+// can be freed. The caller flushes its own TLB.
+// Must be called without spinlocks held: cpus waiting for each other's
+// shootdowns take the interrupt while they wait.
+void
+tlbshootdown(struct mm *mm)
+{
+  uint flushes[NCPU];
+  char wait[NCPU];
+  struct cpu *c, *self;
+  struct proc *p;
+  int i;
+
+  if(mm == 0 || mm->live < 2)
+    return;
+
+  pushcli();
+  if(mycpu()->ncli != 1)
+    panic("tlbshootdown: locks held");
+  self = mycpu();
+  // The cleared page table entries must be visible before a cpu is
+  // found not to run mm, since it reloads %cr3 when it starts to.
+  __sync_synchronize();
+  for(i = 0; i < ncpu; i++){
+    c = &cpus[i];
+    flushes[i] = c->tlbflushes;
+    p = c->proc;
+    wait[i] = c != self && p != 0 && p->mm == mm;
+    if(wait[i])
+      lapicipi(c->apicid, T_TLBFLUSH);
+  }
+  popcli();
+
+  for(i = 0; i < ncpu; i++)
+    while(wait[i] && cpus[i].tlbflushes == flushes[i])
+      ;
 }
 
 // Must be called with interrupts disabled
@@ -55,42 +352,34 @@ static void hlt()
 }
 
 // Must be called with interrupts disabled to avoid the caller being
-// rescheduled between reading lapicid and running through the loop.
+// rescheduled and using another cpu's structure.
+// seginit() points %gs at this cpu's struct cpu.
 struct cpu*
 mycpu(void)
 {
-  int apicid, i;
+  struct cpu *c;
 
   if(readeflags()&FL_IF)
     panic("mycpu called with interrupts enabled\n");
 
-  apicid = lapicid();
-  // APIC IDs are not guaranteed to be contiguous. Maybe we should have
-  // a reverse map, or reserve a register to store &cpus[i].
-  for (i = 0; i < ncpu; ++i) {
-    if (cpus[i].apicid == apicid)
-      return &cpus[i];
-  }
-  panic("unknown apicid\n");
+  asm volatile("movl %%gs:0, %0" : "=r" (c));
+  return c;
 }
 
-// Disable interrupts so that we are not rescheduled
-// while reading proc from the cpu structure
+// The load is a single instruction, so even if we are rescheduled
+// right after it, it returned the process running on this cpu: us.
 struct proc*
 myproc(void) {
-  struct cpu *c;
   struct proc *p;
-  pushcli();
-  c = mycpu();
-  p = c->proc;
-  popcli();
+
+  asm volatile("movl %%gs:4, %0" : "=r" (p));
   return p;
 }
 
 //PAGEBREAK: 32
-// Look in the process table for an UNUSED proc.
-// If found, change state to EMBRYO and initialize
-// state required to run in the kernel.
+// Allocate a proc and add it to the process list.
+// If successful, its state is EMBRYO and the state
+// required to run in the kernel is initialized.
 // Otherwise return 0.
 static struct proc*
 allocproc(void)
@@ -99,22 +388,34 @@ allocproc(void)
   char *sp;
 
   acquire(&ptable.lock);
-
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == UNUSED)
-      goto found;
-
+  if(ptable.nproc >= NPROC){
+    release(&ptable.lock);
+    return 0;
+  }
+  ptable.nproc++;
   release(&ptable.lock);
-  return 0;
 
-found:
+  if((p = kmem_cache_alloc(ptable.cache)) == 0){
+    acquire(&ptable.lock);
+    ptable.nproc--;
+    release(&ptable.lock);
+    return 0;
+  }
+  memset(p, 0, sizeof(*p));
   p->state = EMBRYO;
-  p->killed = 0; // Prevents process allocating with killed=1 flag. This behavior was exhibited as a bug and this prevents it.
+
+  acquire(&ptable.lock);
+  p->next = ptable.list;
+  if(ptable.list)
+    ptable.list->prev = p;
+  ptable.list = p;
   release(&ptable.lock);
 
   // Allocate kernel stack.
   if((p->kstack = kalloc()) == 0){
-    p->state = UNUSED;
+    acquire(&ptable.lock);
+    freeproc(p);
+    release(&ptable.lock);
     return 0;
   }
   sp = p->kstack + KSTACKSIZE;
@@ -139,9 +440,21 @@ found:
   // Set cpu information.
   p->cpu_account_frame = 0;
   p->cpu_time = 0;
+  p->cpu_user_time = 0;
+  p->cpu_system_time = 0;
+  p->cpu_run_user_time = 0;
   p->cpu_period_time = 0;
   p->cpu_percent = 0;
 
+  // Set scheduling statistics.
+  p->sched_run_delay = 0;
+  p->sched_max_wait = 0;
+  p->sched_nvcsw = 0;
+  p->sched_nivcsw = 0;
+  p->sched_migrations = 0;
+  p->sched_last_cpu = -1;
+  p->psi_flags = 0;
+
   return p;
 }
 
@@ -173,8 +486,10 @@ userinit(void)
   p->tf->eip = 0;  // beginning of initcode.S
 
   safestrcpy(p->name, "initcode", sizeof(p->name));
-  p->cwd = initprocessroot(&p->cwdmount);
-  safestrcpy(p->cwdp, "/", sizeof(p->cwdp));
+  if((p->files = filesalloc()) == 0)
+    panic("userinit: out of memory?");
+  p->files->cwd = initprocessroot(&p->files->cwdmount);
+  safestrcpy(p->files->cwdp, "/", sizeof(p->files->cwdp));
   p->nsproxy = emptynsproxy();
 
   p->ns_pid = pid_ns_next_pid(p->nsproxy->pid_ns);
@@ -188,12 +503,15 @@ userinit(void)
   // because the assignment might not be atomic.
   acquire(&ptable.lock);
 
+  pidhash_insert(p);
+
   // Associate with the root cgroup, can discard return value because
-  // this fails only if there is no room.
+  // the root cgroup has no limits.
   cgroup_insert(cgroup_root(), p);
 
   // Set state to runnable.
   p->state = RUNNABLE;
+  cpu_account_process_runnable(p);
 
   release(&ptable.lock);
 }
@@ -206,37 +524,71 @@ growproc(int n)
   uint sz;
   struct proc* curproc = myproc();
   struct cgroup* cgroup = curproc->cgroup;
+  struct mm *mm = curproc->mm;
+  struct proc *p;
 
-  // In case trying to grow process's memory over memory limit, and
-  // given memory controller is enabled, return failure
-  if (n > 0) {
-    if (curproc->cgroup->mem_controller_enabled &&
-      (curproc->cgroup->current_mem + n) > curproc->cgroup->max_mem)
-      return -1;
+  // A shared address space is charged to the cgroup of its owner.
+  if (mm) {
+    acquire(&ptable.lock);
+    if (mm->owner)
+      cgroup = mm->owner->cgroup;
+    release(&ptable.lock);
   }
 
+  // In case trying to grow process's memory over memory limit, and
+  // given memory controller is enabled, make room or return failure
+  if (n > 0 && cgroup_mem_charge(cgroup, n) < 0)
+    return -1;
+
+  // Threads sharing the address space must not grow it at once.
+  if (mm)
+    acquiresleep(&mm->lock);
+
   sz = curproc->sz;
   if (n > 0) {// In this case we update protected memory inside of allocuvm function  
     if ((sz = allocuvm(curproc->pgdir, sz, sz + n, cgroup)) == 0)
-      return -1;
+      goto bad;
   }
   else if (n < 0) {
+    // Threads on other cpus may still cache the pages being freed.
+    if (mm) {
+      unmapuvm(curproc->pgdir, sz, sz + n);
+      tlbshootdown(mm);
+    }
     if ((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0){
-      return -1;
+      goto bad;
     }else{
-      update_protect_mem(curproc->cgroup, curproc->sz, sz);
+      update_protect_mem(cgroup, curproc->sz, sz);
     }
   }
 
-  curproc->sz = sz;
+  if (mm) {
+    // Every thread sees the new size, which the owner is charged
+    // for along with it, if the address space still has one.
+    acquire(&ptable.lock);
+    for (p = ptable.list; p; p = p->next)
+      if (p->mm == mm)
+        p->sz = sz;
+    for (cgroup = mm->owner ? mm->owner->cgroup : 0; cgroup; cgroup = cgroup->parent)
+      cgroup->current_mem += n;
+    release(&ptable.lock);
+    releasesleep(&mm->lock);
+  } else {
+    curproc->sz = sz;
 
-  // Update memory usage in cgroup and its ancestors
-  do {
-    cgroup->current_mem += n;
+    // Update memory usage in cgroup and its ancestors
+    do {
+      cgroup->current_mem += n;
     } while ((cgroup = cgroup->parent));
+  }
 
   switchuvm(curproc);
   return 0;
+
+bad:
+  if (mm)
+    releasesleep(&mm->lock);
+  return -1;
 }
 
 void
@@ -258,15 +610,81 @@ update_protect_mem(struct cgroup* cgroup, int oldsz, int newsz)
     }
 }
 
+// Give np, whose memory and trap frame are already set up, the rest
+// of curproc's state, make it curproc's child and make it runnable.
+// A thread stays in curproc's pid namespace even if curproc has
+// unshared one for its children.
+// Threads share curproc's file table, other processes get a copy.
+// Returns the pid of np, or -1 without having changed np if its
+// namespaces or file table can't be allocated.
+static int
+copyproc(struct proc *np, struct proc *curproc, int thread)
+{
+  int i, pid;
+
+  struct pid_ns* cur = thread ? 0 : curproc->child_pid_ns;
+  if (cur) {
+    if ((np->nsproxy = namespace_replace_pid_ns(curproc->nsproxy, cur)) == 0)
+      return -1;
+  } else {
+    np->nsproxy = namespacedup(curproc->nsproxy);
+    cur = np->nsproxy->pid_ns;
+  }
+
+  if (thread)
+    np->files = filesdup(curproc->files);
+  else if ((np->files = filescopy(curproc->files)) == 0) {
+    namespaceput(np->nsproxy);
+    np->nsproxy = 0;
+    return -1;
+  }
+
+  // for each pid_ns get me a pid
+  i = 0;
+  while (cur) {
+    if (i >= MAX_PID_NS_DEPTH) {
+      panic("too many danif!");
+    }
+
+    np->pids[i].pid = pid_ns_next_pid(cur);
+    np->pids[i].pid_ns = cur;
+    i++;
+    cur = cur->parent;
+  }
+
+  np->ns_pid = np->pids[0].pid;
+
+  safestrcpy(np->name, curproc->name, sizeof(curproc->name));
+
+  pid = get_pid_for_ns(np, curproc->nsproxy->pid_ns);
+
+  acquire(&ptable.lock);
+
+  pidhash_insert(np);
+  setparent(np, curproc);
+
+  // Associate the new process with the current process cgroup.
+  // can discard return value because the limits were checked above.
+  cgroup_insert(curproc->cgroup, np);
+
+  // Set new process to runnable.
+  np->state = RUNNABLE;
+  cpu_account_process_runnable(np);
+
+  release(&ptable.lock);
+
+  return pid;
+}
+
 // Create a new process copying p as the parent.
 // Sets up stack to return as if from system call.
 // Caller must set state of returned proc to RUNNABLE.
 int
 fork(void)
 {
-  int i, pid;
   struct proc *np;
   struct proc *curproc = myproc();
+  int pid;
 
   // Check if the current process has a child pid namespace and if its pid1 was killed.
   if (curproc->child_pid_ns && curproc->child_pid_ns->pid1_ns_killed) {
@@ -280,9 +698,8 @@ fork(void)
            return -1;
 
   // In case trying to fork a new process and the cgroup reached its memory limit,
-  // given memory controller is enabled, return failure
-  if (curproc->cgroup->mem_controller_enabled &&
-    (curproc->cgroup->current_mem + curproc->sz) > curproc->cgroup->max_mem)
+  // given memory controller is enabled, make room or return failure
+  if (cgroup_mem_charge(curproc->cgroup, curproc->sz) < 0)
     return -1;
 
   // Allocate process.
@@ -290,99 +707,131 @@ fork(void)
     return -1;
   }
 
-  // Copy process state from proc.
-  if ((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0) {
+  // Copy process state from proc, while no thread resizes it.
+  if (curproc->mm)
+    acquiresleep(&curproc->mm->lock);
+  np->pgdir = copyuvm(curproc->pgdir, curproc->sz);
+  np->sz = curproc->sz;
+  if (curproc->mm)
+    releasesleep(&curproc->mm->lock);
+  if (np->pgdir == 0) {
     kfree(np->kstack);
-    np->kstack = 0;
-    np->state = UNUSED;
+    acquire(&ptable.lock);
+    freeproc(np);
+    release(&ptable.lock);
     return -1;
   }
-  np->sz = curproc->sz;
-  np->parent = curproc;
   *np->tf = *curproc->tf;
 
   // Clear %eax so that fork returns 0 in the child.
   np->tf->eax = 0;
 
-  for (i = 0; i < NOFILE; i++)
-    if (curproc->ofile[i])
-      np->ofile[i] = filedup(curproc->ofile[i]);
-  np->cwd = idup(curproc->cwd);
-  safestrcpy(np->cwdp, curproc->cwdp, sizeof(curproc->cwdp));
-  np->cwdmount = mntdup(curproc->cwdmount);
-
-  struct pid_ns* cur = curproc->child_pid_ns;
-  if (cur) {
-    np->nsproxy = namespace_replace_pid_ns(curproc->nsproxy, cur);
-  } else {
-    np->nsproxy = namespacedup(curproc->nsproxy);
-    cur = np->nsproxy->pid_ns;
-  }
-
-  // for each pid_ns get me a pid
-  i = 0;
-  while (cur) {
-    if (i >= MAX_PID_NS_DEPTH) {
-      panic("too many danif!");
-    }
-
-    np->pids[i].pid = pid_ns_next_pid(cur);
-    np->pids[i].pid_ns = cur;
-    i++;
-    cur = cur->parent;
+  if ((pid = copyproc(np, curproc, 0)) < 0) {
+    freevm(np->pgdir);
+    kfree(np->kstack);
+    acquire(&ptable.lock);
+    freeproc(np);
+    release(&ptable.lock);
+    return -1;
   }
+  return pid;
+}
 
-  np->ns_pid = np->pids[0].pid;
+// Create a thread: a new process sharing the address space, open
+// files and current directory of the current one, starting at
+// fn(arg1, arg2) on the one page user stack at stack. The thread
+// must not return from fn; it calls exit().
+int
+clone(void (*fn)(void*, void*), void *arg1, void *arg2, void *stack)
+{
+  struct proc *np;
+  struct proc *curproc = myproc();
+  struct mm *mm;
+  uint sp, ustack[3];
 
-  safestrcpy(np->name, curproc->name, sizeof(curproc->name));
+  if ((uint)stack >= curproc->sz || (uint)stack + PGSIZE > curproc->sz ||
+      (uint)stack + PGSIZE < (uint)stack)
+    return -1;
 
-  pid = get_pid_for_ns(np, curproc->nsproxy->pid_ns);
+  if ( curproc->cgroup->pid_controller_enabled &&
+       (curproc->cgroup->num_of_procs + 1) > curproc->cgroup->max_num_of_procs )
+           return -1;
 
-  acquire(&ptable.lock);
+  // The first clone() makes the address space shared.
+  if ((mm = curproc->mm) == 0) {
+    if ((mm = kmem_cache_alloc(ptable.mmcache)) == 0)
+      return -1;
+    mm->ref = 1;
+    mm->live = 1;
+    initsleeplock(&mm->lock, "mm");
+    mm->owner = curproc;
+    curproc->mm = mm;
+  }
 
-  // Associate the new process with the current process cgroup.
-  // can discard return value because this fails only if there is no room
-  // which is checked earlier by allocproc.
-  cgroup_insert(curproc->cgroup, np);
+  if ((np = allocproc()) == 0) {
+    return -1;
+  }
 
-  // Set new process to runnable.
-  np->state = RUNNABLE;
+  __sync_fetch_and_add(&mm->ref, 1);
+  __sync_fetch_and_add(&mm->live, 1);
+  np->mm = mm;
+  np->pgdir = curproc->pgdir;
+  np->sz = curproc->sz;
+  np->thread = 1;
+  np->ustack = stack;
+  *np->tf = *curproc->tf;
 
-  release(&ptable.lock);
+  // Fake return PC, then the arguments to fn.
+  ustack[0] = 0xffffffff;
+  ustack[1] = (uint)arg1;
+  ustack[2] = (uint)arg2;
+  sp = (uint)stack + PGSIZE - sizeof(ustack);
+  if (copyout(np->pgdir, sp, ustack, sizeof(ustack)) < 0) {
+    np->mm = 0;
+    __sync_fetch_and_sub(&mm->live, 1);
+    mmput(mm, np->pgdir);
+    kfree(np->kstack);
+    acquire(&ptable.lock);
+    freeproc(np);
+    release(&ptable.lock);
+    return -1;
+  }
+  np->tf->esp = sp;
+  np->tf->eip = (uint)fn;
 
-  return pid;
+  return copyproc(np, curproc, 1);
 }
 
-/*Kill the given process p, and set its parent to given process reaper*/
+/*Kill the given process p, and set its parent to given process reaper.
+The threads sharing the address space of p are killed along with it.*/
 void kill_proc(struct proc* p, struct proc* reaper) {
-   p->killed = 1;
-   if (p->state == SLEEPING)
-    p->state = RUNNABLE;
-   p->parent = reaper;
-   cgroup_erase(p->cgroup, p);
-   update_protect_mem(p->cgroup, p->sz, 0);
+   setparent(p, reaper);
+   if (p->mm) {
+    killmm(p->mm);
+   } else {
+    setkilled(p);
+    cgroup_leave(p);
+   }
+   update_protect_mem(p->cgroup, PROC_CHARGED_MEM(p), 0);
 }
 
 /*Kill all the processes inside the namespace of a given process, called parent
 reaper in this case becomes their parent process*/
 void kill_all_pid_ns(struct proc* parent, struct proc* reaper, struct pid_ns* curpidns) {
-  struct proc *p;
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    /*If the process is not the parent, and it is in the same namespace as parent, kill it*/
-    if(p != parent && p->nsproxy->pid_ns == curpidns) {
-      kill_proc(p, reaper);
+  struct pid_entry *e;
+  for (int i = 0; i < PIDHASHSIZE; i++) {
+    for (e = curpidns->pid_hash[i]; e; e = e->next) {
+      /*If the process is not the parent, and its own namespace is the namespace of parent, kill it*/
+      if (e->proc != parent && e->proc->pids[0].pid_ns == curpidns) {
+        kill_proc(e->proc, reaper);
+      }
     }
   }
 }
 
 /*Return the process whose pid=1 inside the given namespace*/
 struct proc* get_pid1_for_ns(struct pid_ns* pid_ns) {
-  for (struct proc* p = ptable.proc; p < &ptable.proc[NPROC]; p++) {
-    if(get_pid_for_ns(p, pid_ns) == 1){
-      return p;
-    }
-  }
-  return 0;
+  return find_proc(pid_ns, 1);
 }
 
 // Exit the current process.  Does not return.
@@ -394,42 +843,37 @@ exit(int status)
   struct proc *curproc = myproc();
   struct proc *p;
   struct pid_ns *curpidns;
-  int fd;
 
   curproc->status = status;
 
   if(curproc == initproc)
     panic("init exiting");
 
-  // Close all open files.
-  for(fd = 0; fd < NOFILE; fd++){
-    if(curproc->ofile[fd]){
-      fileclose(curproc->ofile[fd]);
-      curproc->ofile[fd] = 0;
-    }
-  }
+  mmleave(curproc->mm, curproc->pgdir);
 
-  begin_op();
-  iput(curproc->cwd);
-  end_op();
+  // Close all open files, unless threads still use them.
+  filesput(curproc->files);
+  curproc->files = 0;
 
-  mntput(curproc->cwdmount);
-  curproc->cwdmount = 0;
-  *curproc->cwdp = 0;
-  curproc->cwd = 0;
+  // The zombie keeps its pid namespace alive until it is reaped,
+  // since it stays in the namespace pid hash until then.
+  curpidns = pid_ns_dup(curproc->nsproxy->pid_ns);
+
+  namespaceput(curproc->nsproxy);
+
+  acquire(&ptable.lock);
 
   struct proc* procpid1 = 0;
   // Find process with pid 1 within namespace
-  procpid1 = get_pid1_for_ns(curproc->nsproxy->pid_ns);
+  procpid1 = get_pid1_for_ns(curpidns);
 
   // Here we could not find process with pid 1 inside the namespace, and pid 1 wasn't marked as killed
-  if (procpid1 == 0 && curproc->nsproxy->pid_ns->pid1_ns_killed == 0)
+  if (procpid1 == 0 && curpidns->pid1_ns_killed == 0)
     panic("couldn't find pid 1");
-  curpidns = curproc->nsproxy->pid_ns;
-
-  namespaceput(curproc->nsproxy);
+  // Orphans of a namespace whose pid 1 is gone go to init.
+  if (procpid1 == 0)
+    procpid1 = initproc;
 
-  acquire(&ptable.lock);
   // Parent might be sleeping in wait().
   wakeup1(curproc->parent);
 
@@ -439,16 +883,20 @@ exit(int status)
 
     kill_all_pid_ns(curproc, curproc->parent, curpidns); // Documentation for this command see above
 
+    // Children outside of the namespace go to the reaper as well.
+    while((p = curproc->children) != 0){
+      setparent(p, curproc->parent);
+      if(p->state == ZOMBIE)
+        wakeup1(curproc->parent);
+    }
+
   } else { // The current process does not hold pid 1 within its namespace
 
     // Pass the child processes of the current process to pid 1 process within the namespace
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->parent == curproc){
-        p->parent = procpid1;
-        if(p->state == ZOMBIE) {
-          wakeup1(initproc);
-        }
-      }
+    while((p = curproc->children) != 0){
+      setparent(p, procpid1);
+      if(p->state == ZOMBIE)
+        wakeup1(procpid1);
     }
   }
 
@@ -457,8 +905,8 @@ exit(int status)
     pid_ns_put(curproc->child_pid_ns);
 
   // Remove the process cgroup.
-  cgroup_erase(curproc->cgroup, curproc);
-  update_protect_mem(curproc->cgroup, curproc->sz, 0);
+  cgroup_leave(curproc);
+  update_protect_mem(curproc->cgroup, PROC_CHARGED_MEM(curproc), 0);
 
   // Jump into the scheduler, never to return.
   curproc->state = ZOMBIE;
@@ -466,43 +914,55 @@ exit(int status)
   panic("zombie exit");
 }
 
+// Free the zombie p. The ptable lock must be held.
+static void
+reap(struct proc *p)
+{
+  kfree(p->kstack);
+  mmput(p->mm, p->pgdir);
+  setparent(p, 0);
+  pidhash_remove(p);
+  pid_ns_put(p->pids[0].pid_ns);
+  freeproc(p);
+}
+
+// Is p a thread sharing the address space of curproc?
+// Such threads are collected by join(), not waitpid().
+static int
+isthreadof(struct proc *p, struct proc *curproc)
+{
+  return p->thread && p->mm != 0 && p->mm == curproc->mm;
+}
+
 // Wait for a child process to exit and return its pid.
-// Return -1 if this process has no children.
+// If pid is -1 any child will do, otherwise only the child with that pid.
+// With WNOHANG in options, return 0 instead of blocking if the child
+// has not exited yet.
+// Return -1 if this process has no such child.
 int
-wait(int *wstatus)
+waitpid(int pid, int *wstatus, int options)
 {
   struct proc *p;
-  int havekids, pid;
+  int havekids;
   struct proc *curproc = myproc();
 
   acquire(&ptable.lock);
   for(;;){
-    // Scan through table looking for exited children.
+    // Look through the children for exited ones.
     havekids = 0;
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->parent != curproc)
-        continue;
-      havekids = 1;
-      if(p->state == ZOMBIE){
-        // Found one.
-        pid = get_pid_for_ns(p, curproc->nsproxy->pid_ns);
-        kfree(p->kstack);
-        p->kstack = 0;
-        freevm(p->pgdir);
-        p->ns_pid = 0;
-        memset(p->pids, 0, sizeof(p->pids));
-        p->child_pid_ns = 0;
-        p->parent = 0;
-        p->name[0] = 0;
-        p->killed = 0;
-        p->state = UNUSED;
-        if (wstatus != 0)
-         *wstatus = W_STOPCODE(p->status);
-        p->status = 0;
-
-        release(&ptable.lock);
-        return pid;
+    if(pid == -1){
+      for(p = curproc->children; p; p = p->sibnext){
+        if(isthreadof(p, curproc))
+          continue;
+        havekids = 1;
+        if(p->state == ZOMBIE)
+          goto found;
       }
+    } else if((p = find_proc(curproc->nsproxy->pid_ns, pid)) != 0 &&
+              p->parent == curproc && !isthreadof(p, curproc)){
+      havekids = 1;
+      if(p->state == ZOMBIE)
+        goto found;
     }
 
     // No point waiting if we don't have any children.
@@ -511,9 +971,72 @@ wait(int *wstatus)
       return -1;
     }
 
+    if(options & WNOHANG){
+      release(&ptable.lock);
+      return 0;
+    }
+
     // Wait for children to exit.  (See wakeup1 call in proc_exit.)
     sleep(curproc, &ptable.lock);  //DOC: wait-sleep
   }
+
+found:
+  pid = get_pid_for_ns(p, curproc->nsproxy->pid_ns);
+  if (wstatus != 0)
+   *wstatus = W_STOPCODE(p->status);
+  reap(p);
+
+  release(&ptable.lock);
+  return pid;
+}
+
+// Wait for a thread created by clone() to exit and return its pid.
+// The user stack given to clone() is stored in *stack so the
+// caller can free it.
+// Return -1 if this process has no threads.
+int
+join(void **stack)
+{
+  struct proc *p;
+  int havekids, pid;
+  struct proc *curproc = myproc();
+
+  acquire(&ptable.lock);
+  for(;;){
+    havekids = 0;
+    for(p = curproc->children; p; p = p->sibnext){
+      if(!isthreadof(p, curproc))
+        continue;
+      havekids = 1;
+      if(p->state == ZOMBIE)
+        goto found;
+    }
+
+    if(havekids == 0 || curproc->killed){
+      release(&ptable.lock);
+      return -1;
+    }
+
+    // Wait for threads to exit.  (See wakeup1 call in proc_exit.)
+    sleep(curproc, &ptable.lock);
+  }
+
+found:
+  pid = get_pid_for_ns(p, curproc->nsproxy->pid_ns);
+  if (stack != 0)
+    *stack = p->ustack;
+  reap(p);
+
+  release(&ptable.lock);
+  return pid;
+}
+
+// Wait for any child process to exit and return its pid.
+// Return -1 if this process has no children.
+int
+wait(int *wstatus)
+{
+  return waitpid(-1, wstatus, 0);
 }
 
 //PAGEBREAK: 42
@@ -549,7 +1072,7 @@ scheduler(void)
     cpu_account_schedule_start(&cpu);
 
     // Loop over process table looking for process to run.
-    for (p = ptable.proc; p < &ptable.proc[NPROC]; p++) {
+    for (p = ptable.list; p; p = p->next) {
       // Update proc information.
       cpu_account_schedule_proc_update(&cpu, p);
 
@@ -560,9 +1083,10 @@ scheduler(void)
 
       // Cpu set controller and freezer are only defined on runnable processes which are not killed.
       if (p->killed == 0) {
-          // If the cpu set controller enabled, and the cpu doesn't match the one that is supposed to run the process
-          // then don't let the process run on this cpu.
-          if (p->cgroup->set_controller_enabled && p->cgroup->cpu_to_use != c->apicid) {
+          // If this cpu is not in the effective cpus of the group, which the cpu set
+          // controllers of the group and its ancestors restrict, then don't let the
+          // process run on this cpu.
+          if (!(p->cgroup->cpus_effective & (1 << (c - cpus)))) {
               continue;
           }
 
@@ -653,6 +1177,7 @@ yield(void)
 {
   acquire(&ptable.lock);  //DOC: yieldlock
   myproc()->state = RUNNABLE;
+  cpu_account_process_runnable(myproc());
   sched();
   release(&ptable.lock);
 }
@@ -676,6 +1201,8 @@ forkret(void)
     mntinit(); // initialize mounts
   }
 
+  cpu_account_trap_exit(myproc());
+
   // Return to "caller", actually trapret (see allocproc).
 }
 
@@ -726,9 +1253,11 @@ wakeup1(void *chan)
 {
   struct proc *p;
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == SLEEPING && p->chan == chan)
+  for(p = ptable.list; p; p = p->next)
+    if(p->state == SLEEPING && p->chan == chan){
       p->state = RUNNABLE;
+      cpu_account_process_runnable(p);
+    }
 }
 
 // Wake up all processes sleeping on chan.
@@ -749,18 +1278,42 @@ kill(int pid)
   struct proc *p;
 
   acquire(&ptable.lock);
-  struct pid_ns* pid_ns = myproc()->nsproxy->pid_ns;
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(get_pid_for_ns(p, pid_ns) == pid){
-       kill_proc(p, p->parent);
-       release(&ptable.lock);
-       return 0;
-    }
+  if((p = find_proc(myproc()->nsproxy->pid_ns, pid)) != 0){
+    kill_proc(p, p->parent);
+    release(&ptable.lock);
+    return 0;
   }
   release(&ptable.lock);
   return -1;
 }
 
+// Kill the process using the most memory in cgroup or its descendants,
+// to make room for the current process, which is never chosen.
+// Returns 0 if a process was killed, -1 if there was none to kill.
+int
+oom_kill(struct cgroup *cgroup)
+{
+  struct proc *p, *victim = 0;
+  struct cgroup *cg;
+
+  acquire(&ptable.lock);
+  for(p = ptable.list; p; p = p->next){
+    if(p == myproc() || p == initproc || p->killed ||
+       (p->state != SLEEPING && p->state != RUNNABLE && p->state != RUNNING))
+      continue;
+    for(cg = p->cgroup; cg && cg != cgroup; cg = cg->parent)
+      ;
+    if(cg && (!victim || PROC_CHARGED_MEM(p) > PROC_CHARGED_MEM(victim)))
+      victim = p;
+  }
+  // Killing erases the victim from its cgroup, releasing its memory
+  // charge right away.
+  if(victim)
+    kill_proc(victim, victim->parent);
+  release(&ptable.lock);
+  return victim ? 0 : -1;
+}
+
 //PAGEBREAK: 36
 // Print a process listing to console.  For debugging.
 // Runs when user types ^P on console.
@@ -781,7 +1334,7 @@ procdump(void)
   char *state;
   uint pc[10];
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+  for(p = ptable.list; p; p = p->next){
     if(p->state == UNUSED)
       continue;
     if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
@@ -819,14 +1372,12 @@ cgroup_move_proc(struct cgroup * cgroup, int pid)
 
     acquire(&ptable.lock);
 
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-        if(proc_pid(p) == pid)
-            if(p->state == SLEEPING || p->state == RUNNABLE || p->state == RUNNING)
-                if(unsafe_cgroup_insert(cgroup, p) == 0){
-                    release(&ptable.lock);
-                    return 0;
-                }
-    }
+    if((p = find_proc(myproc()->nsproxy->pid_ns, pid)) != 0)
+        if(p->state == SLEEPING || p->state == RUNNABLE || p->state == RUNNING)
+            if(unsafe_cgroup_insert(cgroup, p) == 0){
+                release(&ptable.lock);
+                return 0;
+            }
     release(&ptable.lock);
     return -1;
 }
@@ -16,7 +16,12 @@ struct cpu {
   volatile uint started;       // Has the CPU started?
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
-  struct proc *proc;           // The process running on this cpu or null
+  volatile uint tlbflushes;    // TLB shootdowns handled, see tlbshootdown()
+
+  // Per-cpu data at the base of the SEG_KCPU segment, so the kernel
+  // reaches it through %gs in a single load. Keep the two together.
+  struct cpu *self;            // &cpus[this cpu], at %gs:0
+  struct proc *proc;           // The process running on this cpu or null, at %gs:4
 };
 
 extern struct cpu cpus[NCPU];
@@ -46,6 +51,8 @@ enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 struct pid_entry {
   struct pid_ns* pid_ns;
   int pid;
+  struct pid_entry* next;  // Next entry in the pid_ns hash bucket
+  struct proc* proc;       // Process owning this entry
 };
 
 
@@ -53,6 +60,9 @@ struct pid_entry {
 struct proc {
   uint sz;                     // Size of process memory (bytes)
   pde_t* pgdir;                // Page table
+  struct mm *mm;               // Address space shared with threads, or 0
+  int thread;                  // Created by clone(), collected by join()
+  void *ustack;                // User stack given to clone()
   char *kstack;                // Bottom of kernel stack for this process
   enum procstate state;        // Process state
   /* int pid;                     // Process ID */
@@ -63,21 +73,42 @@ struct proc {
   struct context *context;     // swtch() here to run process
   void *chan;                  // If non-zero, sleeping on chan
   int killed;                  // If non-zero, have been killed
-  struct file *ofile[NOFILE];  // Open files
-  struct inode *cwd;           // Current directory
-  struct mount *cwdmount;      // Mount in which current directory lies
+  struct files *files;         // Open files and current directory
+  struct file *fdheld;         // Held for the current system call, see fdget()
   char name[16];               // Process name (debugging)
   struct nsproxy *nsproxy;     // Namespace proxy object
   struct pid_ns *child_pid_ns; // PID namespace for child procs
   int status;                  // Process exit status
-  char cwdp[MAX_PATH_LENGTH];  // Current directory path.
   struct cgroup * cgroup;      // The process control group.
   unsigned int cpu_time;       // Process cpu time.
+  unsigned int cpu_user_time;  // Part of cpu_time spent in user mode.
+  unsigned int cpu_system_time;// Part of cpu_time spent in the kernel.
+  unsigned int cpu_user_stamp; // When the process last returned to user mode.
+  unsigned int cpu_run_user_time; // User time since it was last scheduled.
   unsigned int cpu_period_time;// Cpu time in microseconds in the last accounting frame.
   unsigned int cpu_percent;   // Cpu usage percentage in the last accounting frame.
   unsigned int cpu_account_frame; // The cpu account frame.
+  unsigned int sched_run_delay;  // Time spent runnable waiting for a cpu.
+  unsigned int sched_max_wait;   // Longest wait for a cpu.
+  unsigned int sched_runnable_stamp; // When the process last became runnable.
+  unsigned int sched_nvcsw;      // Voluntary context switches.
+  unsigned int sched_nivcsw;     // Involuntary context switches.
+  unsigned int sched_migrations; // Times it ran on a different cpu than before.
+  int sched_last_cpu;            // Cpu it last ran on, or -1.
+  int psi_flags;                 // Resources it stalls on while sleeping (psi.h).
+  struct proc *next;           // Next process in the process list
+  struct proc *prev;           // Previous process in the process list
+  struct proc *cgnext;         // Next process in the cgroup
+  struct proc *cgprev;         // Previous process in the cgroup
+  struct proc *children;       // First child process
+  struct proc *sibnext;        // Next child of the parent
+  struct proc *sibprev;        // Previous child of the parent
 };
 
+// Memory charged to the cgroup of p. Threads share their memory,
+// which is charged once, to the one owning it (see ownsmem()).
+#define PROC_CHARGED_MEM(p) (ownsmem(p) ? (p)->sz : 0)
+
 /**
  * Returns the pid of the given proc, using the current
  * process namespace.
@@ -0,0 +1,169 @@
+// Pressure stall information.
+//
+// The first cpu samples every process every PSI_SAMPLE_TICKS timer
+// ticks. Sampling walks all processes with the process and cgroup
+// tables locked, so it is done less often than the tick. A process
+// that is runnable but not running stalls on the cpu, one sleeping
+// with PSI_IOWAIT or PSI_MEMSTALL set stalls on the disk or on memory.
+// The process counts towards its cgroup and all of its ancestors. The
+// time between samples is added to the "some" stall time of a cgroup
+// if one of its processes stalls, and to the "full" stall time if in
+// addition none of them makes progress. Every PSI_PERIOD the stall
+// times of the period are folded into decaying averages.
+
+#include "cgroup.h"
+#include "psi.h"
+#include "steady_clock.h"
+
+#define PSI_PERIOD (2 * 1000 * 1000) // 2s between average updates.
+#define PSI_SAMPLE_TICKS 10           // Timer ticks between samples.
+
+// Fixed point decay factors of the averages per period,
+// e^(-2/10), e^(-2/60) and e^(-2/300) times PSI_FIXED_1.
+#define PSI_FIXED_1 2048
+static const unsigned int psi_exp[NR_PSI_AVGS] = {1677, 1981, 2034};
+
+static unsigned int psi_last_sample;
+static unsigned int psi_period_start;
+static unsigned int psi_ticks;
+
+void psi_tick(void)
+{
+    unsigned int now, delta;
+    unsigned int period = 0;
+
+    if (++psi_ticks < PSI_SAMPLE_TICKS)
+        return;
+    psi_ticks = 0;
+
+    // The time since the last sample is attributed to this sample.
+    now = steady_clock_now();
+    delta = now - psi_last_sample;
+
+    // Nothing to attribute the time since boot to.
+    if (!psi_last_sample) {
+        psi_last_sample = now;
+        psi_period_start = now;
+        return;
+    }
+
+    psi_last_sample = now;
+    if (now - psi_period_start >= PSI_PERIOD) {
+        period = now - psi_period_start;
+        psi_period_start = now;
+    }
+
+    proc_lock();
+    cgroup_lock();
+    cgroup_psi_sample(delta, period);
+    cgroup_unlock();
+    proc_unlock();
+}
+
+int psi_enter(int flags)
+{
+    struct proc * p = myproc();
+    int old;
+
+    if (!p)
+        return 0;
+    old = p->psi_flags;
+    p->psi_flags |= flags;
+    return old;
+}
+
+void psi_leave(int flags)
+{
+    struct proc * p = myproc();
+
+    if (p)
+        p->psi_flags = flags;
+}
+
+void psi_group_account(struct psi_group * group, struct proc * p)
+{
+    switch (p->state) {
+        case RUNNING:
+            ++group->nr_oncpu;
+            ++group->nr_running;
+            break;
+        case RUNNABLE:
+            // A frozen process does not want to run.
+            if (!p->cgroup->is_frozen)
+                ++group->nr_running;
+            break;
+        case SLEEPING:
+            if (p->psi_flags & PSI_IOWAIT)
+                ++group->nr_iowait;
+            if (p->psi_flags & PSI_MEMSTALL)
+                ++group->nr_memstall;
+            break;
+        default:
+            break;
+    }
+}
+
+static void psi_group_stall(struct psi_group * group,
+                            int resource,
+                            char some,
+                            char full,
+                            unsigned int delta)
+{
+    if (some) {
+        group->total[resource][PSI_SOME] += delta;
+        group->period[resource][PSI_SOME] += delta;
+    }
+    if (full) {
+        group->total[resource][PSI_FULL] += delta;
+        group->period[resource][PSI_FULL] += delta;
+    }
+}
+
+void psi_group_record(struct psi_group * group, unsigned int delta)
+{
+    psi_group_stall(group, PSI_CPU,
+                    group->nr_running > group->nr_oncpu,
+                    group->nr_running && !group->nr_oncpu,
+                    delta);
+    psi_group_stall(group, PSI_MEM,
+                    group->nr_memstall,
+                    group->nr_memstall && !group->nr_running,
+                    delta);
+    psi_group_stall(group, PSI_IO,
+                    group->nr_iowait,
+                    group->nr_iowait && !group->nr_running,
+                    delta);
+
+    group->nr_oncpu = 0;
+    group->nr_running = 0;
+    group->nr_iowait = 0;
+    group->nr_memstall = 0;
+}
+
+void psi_group_average(struct psi_group * group, unsigned int period)
+{
+    // Microseconds in a ten-thousandth of the period, so that
+    // stall * 100 / unit is the stalled share in millionths.
+    unsigned int unit = period / 10000;
+
+    if (!unit)
+        return;
+
+    for (int resource = 0; resource < NR_PSI_RESOURCES; resource++) {
+        for (int state = 0; state < NR_PSI_STATES; state++) {
+            unsigned int * avg = group->avg[resource][state];
+            unsigned int pct = group->period[resource][state] * 100 / unit;
+
+            if (pct > 1000000)
+                pct = 1000000;
+
+            for (int i = 0; i < NR_PSI_AVGS; i++)
+                avg[i] = (avg[i] * psi_exp[i] +
+                          pct * (PSI_FIXED_1 - psi_exp[i]) +
+                          PSI_FIXED_1 / 2) /
+                         PSI_FIXED_1;
+
+            group->period[resource][state] = 0;
+        }
+    }
+}
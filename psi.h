@@ -0,0 +1,74 @@
+#ifndef XV6_PSI_H
+#define XV6_PSI_H
+
+struct proc;
+
+#define PSI_CPU 0 // Runnable processes waiting for a cpu.
+#define PSI_MEM 1 // Processes waiting for memory.
+#define PSI_IO 2  // Processes waiting for the disk.
+#define NR_PSI_RESOURCES 3
+
+#define PSI_SOME 0 // At least one process stalled.
+#define PSI_FULL 1 // Stalled and no process running.
+#define NR_PSI_STATES 2
+
+#define NR_PSI_AVGS 3 // Averages over 10, 60 and 300 seconds.
+
+#define PSI_IOWAIT (1 << 0)   // Process sleeps waiting for the disk.
+#define PSI_MEMSTALL (1 << 1) // Process sleeps waiting for memory.
+
+/**
+ * Pressure stall information of a cgroup.
+ * Stall times are in microseconds, averages in millionths of the time,
+ * so that 1000000 means stalled all the time.
+ */
+struct psi_group
+{
+    unsigned int nr_oncpu;    /* Sampled number of running processes.*/
+    unsigned int nr_running;  /* Sampled number of running and runnable processes.*/
+    unsigned int nr_iowait;   /* Sampled number of processes waiting for the disk.*/
+    unsigned int nr_memstall; /* Sampled number of processes waiting for memory.*/
+
+    unsigned int total[NR_PSI_RESOURCES][NR_PSI_STATES]; /* Total stall time.*/
+    unsigned int period[NR_PSI_RESOURCES][NR_PSI_STATES]; /* Stall time in the
+                                                              current averaging period.*/
+    unsigned int avg[NR_PSI_RESOURCES][NR_PSI_STATES][NR_PSI_AVGS]; /* Decaying averages.*/
+};
+
+/**
+ * Sample the state of all processes into the pressure of their cgroups
+ * every few timer ticks.
+ * Called on every timer tick of the first cpu.
+ */
+void psi_tick(void);
+
+/**
+ * Mark the current process as stalled on the resources in flags
+ * (PSI_IOWAIT, PSI_MEMSTALL) while it sleeps.
+ * Returns the previous stall flags, to be passed to psi_leave.
+ */
+int psi_enter(int flags);
+
+/**
+ * Restore the stall flags returned by the matching psi_enter.
+ */
+void psi_leave(int flags);
+
+/**
+ * Count process p in the sampled process numbers of group.
+ */
+void psi_group_account(struct psi_group * group, struct proc * p);
+
+/**
+ * Add delta microseconds to the stall times of group according to the
+ * sampled process numbers, and clear the numbers for the next sample.
+ */
+void psi_group_record(struct psi_group * group, unsigned int delta);
+
+/**
+ * Fold the stall times of the averaging period that lasted period
+ * microseconds into the averages of group.
+ */
+void psi_group_average(struct psi_group * group, unsigned int period);
+
+#endif
@@ -0,0 +1,94 @@
+// Reader-writer spin locks, for data that is read far more often
+// than it changes. Like spinlocks, they disable interrupts while
+// held and must not be held across sleep().
+//
+// A writer first sets RW_WRITER, which keeps new readers out, and
+// then waits for the readers already inside to leave, so a steady
+// stream of readers cannot starve it.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "x86.h"
+#include "mmu.h"
+#include "proc.h"
+#include "rwlock.h"
+
+void
+initrwlock(struct rwlock *lk, char *name)
+{
+  lk->name = name;
+  lk->cnt = 0;
+  lk->cpu = 0;
+}
+
+void
+acquireread(struct rwlock *lk)
+{
+  uint cnt;
+
+  pushcli(); // disable interrupts to avoid deadlock.
+  if(holdingwrite(lk))
+    panic("acquireread");
+
+  // The compare-and-swap is atomic and a full memory barrier.
+  for(;;){
+    cnt = *(volatile uint*)&lk->cnt;
+    if(!(cnt & RW_WRITER) && __sync_bool_compare_and_swap(&lk->cnt, cnt, cnt + 1))
+      break;
+    pause();
+  }
+}
+
+void
+releaseread(struct rwlock *lk)
+{
+  if((lk->cnt & ~RW_WRITER) == 0)
+    panic("releaseread");
+
+  __sync_fetch_and_sub(&lk->cnt, 1);
+  popcli();
+}
+
+void
+acquirewrite(struct rwlock *lk)
+{
+  uint cnt;
+
+  pushcli(); // disable interrupts to avoid deadlock.
+  if(holdingwrite(lk))
+    panic("acquirewrite");
+
+  // Claim the writer bit, then wait for the readers to drain.
+  for(;;){
+    cnt = *(volatile uint*)&lk->cnt;
+    if(!(cnt & RW_WRITER) && __sync_bool_compare_and_swap(&lk->cnt, cnt, cnt | RW_WRITER))
+      break;
+    pause();
+  }
+  while(*(volatile uint*)&lk->cnt != RW_WRITER)
+    pause();
+
+  lk->cpu = mycpu();
+}
+
+void
+releasewrite(struct rwlock *lk)
+{
+  if(!holdingwrite(lk))
+    panic("releasewrite");
+
+  lk->cpu = 0;
+  __sync_synchronize();
+
+  // No readers can be inside, so this clears the whole word.
+  asm volatile("movl $0, %0" : "+m" (lk->cnt) : );
+  popcli();
+}
+
+// Check whether this cpu is holding the lock for writing.
+int
+holdingwrite(struct rwlock *lk)
+{
+  return (lk->cnt & RW_WRITER) && lk->cpu == mycpu();
+}
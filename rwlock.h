@@ -0,0 +1,17 @@
+#ifndef XV6_RWLOCK_H
+#define XV6_RWLOCK_H
+
+// Reader-writer spin lock: held either by any number of
+// readers or by a single writer.
+struct rwlock {
+  uint cnt;          // Number of readers, plus RW_WRITER while a
+                     // writer holds or is waiting for the lock.
+
+  // For debugging:
+  char *name;        // Name of lock.
+  struct cpu *cpu;   // The cpu holding the lock for writing.
+};
+
+#define RW_WRITER 0x80000000
+
+#endif
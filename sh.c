@@ -329,7 +329,7 @@ int
 main(void)
 {
   static char buf[100];
-  int fd, retval;
+  int fd, retval, pid;
   struct cmd* pcmd;
 
   // Ensure that three file descriptors are open.
@@ -351,9 +351,9 @@ main(void)
       continue;
     }
 
-    if(fork1() == 0)
+    if((pid = fork1()) == 0)
       runcmd(pcmd);
-    wait(&last_cmd_retval);
+    waitpid(pid, &last_cmd_retval, 0);
     last_cmd_retval_update_wait_exit_status();
   }
   exit(0);
@@ -0,0 +1,288 @@
+// Shared memory segments.
+//
+// A segment is a set of physical pages named by an integer key.
+// shmat() maps a segment into the current address space, creating
+// it on first use, and shmdt() unmaps it. Segment id i is always
+// mapped at SHMBASE + i*SHMMAXSIZE, so a page table alone says which
+// segments it has attached: fork copies the attachments and freeing
+// a page table drops them. The pages are counted by the number of
+// page tables that map them and freed with the last one.
+//
+// The memory of a segment is charged to the cgroup of the process
+// that created it until the segment is freed.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "cgroup.h"
+
+struct shmseg {
+  int key;
+  uint npages;                 // 0 if the slot is free
+  int nattach;                 // page tables mapping the segment
+  struct cgroup *cgroup;       // charged for the pages
+  char *pages[SHMMAXPAGES];
+};
+
+static struct {
+  struct spinlock lock;
+  struct shmseg seg[NSHM];
+} shmtable;
+
+void
+shminit(void)
+{
+  initlock(&shmtable.lock, "shm");
+}
+
+static uint
+shmaddr(struct shmseg *s)
+{
+  return SHMBASE + (s - shmtable.seg) * SHMMAXSIZE;
+}
+
+// Is segment s mapped in pgdir? Caller must hold shmtable.lock.
+static int
+shmmapped(pde_t *pgdir, struct shmseg *s)
+{
+  return ismapped(pgdir, shmaddr(s));
+}
+
+// Charge n bytes to cgroup and its ancestors, or uncharge them if n
+// is negative. Returns -1 if the charge is over the memory limit of
+// the cgroup or an ancestor.
+static int
+shmcharge(struct cgroup *cgroup, int n)
+{
+  struct cgroup *cg;
+
+  cgroup_lock();
+  for (cg = cgroup; n > 0 && cg; cg = cg->parent) {
+    if (cg->mem_controller_enabled && cg->current_mem + n > cg->max_mem) {
+      cgroup_unlock();
+      return -1;
+    }
+  }
+  for (cg = cgroup; cg; cg = cg->parent)
+    cg->current_mem += n;
+  cgroup->current_page += n / PGSIZE;
+
+  // The segment keeps a deleted cgroup's slot from being reused.
+  if (n > 0)
+    cgroup->ref_count++;
+  else {
+    cgroup->ref_count--;
+    if (cgroup->ref_count == 0 && *cgroup->cgroup_dir_path == 0)
+      decrement_nr_dying_descendants(cgroup->parent);
+  }
+  cgroup_unlock();
+  return 0;
+}
+
+// Free the pages of a segment nobody maps.
+// Caller must hold shmtable.lock.
+static void
+shmfree(struct shmseg *s)
+{
+  uint i;
+
+  for(i = 0; i < s->npages; i++)
+    kfree(s->pages[i]);
+  shmcharge(s->cgroup, -(int)(s->npages * PGSIZE));
+  s->npages = 0;
+  s->cgroup = 0;
+}
+
+// Create segment key with size bytes in a free slot.
+// Caller must hold shmtable.lock.
+static struct shmseg*
+shmcreate(int key, uint size)
+{
+  struct shmseg *s;
+  uint i;
+
+  for(s = shmtable.seg; s < &shmtable.seg[NSHM]; s++)
+    if(s->npages == 0)
+      break;
+  if(s == &shmtable.seg[NSHM])
+    return 0;
+
+  s->cgroup = myproc()->cgroup;
+  if(shmcharge(s->cgroup, PGROUNDUP(size)) < 0)
+    return 0;
+  s->key = key;
+  s->nattach = 0;
+  for(s->npages = 0; s->npages < PGROUNDUP(size) / PGSIZE; s->npages++){
+    if((s->pages[s->npages] = kalloc()) == 0){
+      for(i = 0; i < s->npages; i++)
+        kfree(s->pages[i]);
+      shmcharge(s->cgroup, -(int)PGROUNDUP(size));
+      s->npages = 0;
+      return 0;
+    }
+    memset(s->pages[s->npages], 0, PGSIZE);
+  }
+  return s;
+}
+
+// Map the pages of s into pgdir. Caller must hold shmtable.lock.
+static int
+shmmap(pde_t *pgdir, struct shmseg *s)
+{
+  if(mapshared(pgdir, shmaddr(s), s->pages, s->npages) < 0)
+    return -1;
+  s->nattach++;
+  return 0;
+}
+
+// Drop the attachment of s by pgdir, freeing s with the last one.
+// Caller must hold shmtable.lock.
+static void
+shmdetach(pde_t *pgdir, struct shmseg *s)
+{
+  unmapshared(pgdir, shmaddr(s), s->npages);
+  if(--s->nattach == 0)
+    shmfree(s);
+}
+
+// Find the segment named key. Caller must hold shmtable.lock.
+static struct shmseg*
+shmfind(int key)
+{
+  struct shmseg *s;
+
+  for(s = shmtable.seg; s < &shmtable.seg[NSHM]; s++)
+    if(s->npages != 0 && s->key == key)
+      return s;
+  return 0;
+}
+
+// Attach the segment named key to the current process, creating it
+// with size bytes if it does not exist. Returns the address it is
+// mapped at, or -1 if an existing segment is smaller than size, it
+// is already attached or memory is short.
+int
+shmat(int key, uint size)
+{
+  struct proc *curproc = myproc();
+  struct shmseg *s;
+  int va;
+
+  if(size == 0 || size > SHMMAXSIZE)
+    return -1;
+
+  acquire(&shmtable.lock);
+  if((s = shmfind(key)) == 0){
+    // Make room in the cgroup as for any other allocation, which may
+    // sleep, and look again since the segment may now exist.
+    release(&shmtable.lock);
+    if(cgroup_mem_charge(curproc->cgroup, PGROUNDUP(size)) < 0)
+      return -1;
+    acquire(&shmtable.lock);
+  }
+  if(s == 0 && (s = shmfind(key)) == 0){
+    if((s = shmcreate(key, size)) == 0)
+      goto bad;
+  } else if(size > s->npages * PGSIZE || shmmapped(curproc->pgdir, s))
+    goto bad;
+  if(shmmap(curproc->pgdir, s) < 0){
+    if(s->nattach == 0)
+      shmfree(s);
+    goto bad;
+  }
+  va = shmaddr(s);
+  release(&shmtable.lock);
+  switchuvm(curproc);
+  return va;
+
+bad:
+  release(&shmtable.lock);
+  return -1;
+}
+
+// Detach the segment mapped at addr from the current process.
+int
+shmdt(uint addr)
+{
+  struct proc *curproc = myproc();
+  struct shmseg *s;
+
+  if(addr < SHMBASE || (addr - SHMBASE) % SHMMAXSIZE != 0)
+    return -1;
+  s = &shmtable.seg[(addr - SHMBASE) / SHMMAXSIZE];
+
+  acquire(&shmtable.lock);
+  if(s->npages == 0 || !shmmapped(curproc->pgdir, s)){
+    release(&shmtable.lock);
+    return -1;
+  }
+  if(curproc->mm){
+    // Threads on other cpus may still cache the pages, so they are
+    // freed only after their TLBs are flushed. The segment stays
+    // attached meanwhile, but no longer mapped in the page table.
+    unmapshared(curproc->pgdir, shmaddr(s), s->npages);
+    release(&shmtable.lock);
+    tlbshootdown(curproc->mm);
+    acquire(&shmtable.lock);
+    if(--s->nattach == 0)
+      shmfree(s);
+  } else
+    shmdetach(curproc->pgdir, s);
+  release(&shmtable.lock);
+  switchuvm(curproc);
+  return 0;
+}
+
+// Attach to the child page table d every segment attached to the
+// parent page table pgdir. Used by copyuvm().
+int
+shmcopy(pde_t *pgdir, pde_t *d)
+{
+  struct shmseg *s;
+
+  acquire(&shmtable.lock);
+  for(s = shmtable.seg; s < &shmtable.seg[NSHM]; s++){
+    if(s->npages == 0 || !shmmapped(pgdir, s))
+      continue;
+    if(shmmap(d, s) < 0){
+      release(&shmtable.lock);
+      return -1;
+    }
+  }
+  release(&shmtable.lock);
+  return 0;
+}
+
+// Detach every segment attached to pgdir, before it is freed.
+void
+shmdetachall(pde_t *pgdir)
+{
+  struct shmseg *s;
+
+  acquire(&shmtable.lock);
+  for(s = shmtable.seg; s < &shmtable.seg[NSHM]; s++)
+    if(s->npages != 0 && shmmapped(pgdir, s))
+      shmdetach(pgdir, s);
+  release(&shmtable.lock);
+}
+
+// Does [va, va+len) lie within a segment attached to pgdir?
+int
+shmcontains(pde_t *pgdir, uint va, uint len)
+{
+  struct shmseg *s;
+  int r;
+
+  if(va < SHMBASE || va >= KERNBASE)
+    return 0;
+  s = &shmtable.seg[(va - SHMBASE) / SHMMAXSIZE];
+  acquire(&shmtable.lock);
+  r = s->npages != 0 && shmmapped(pgdir, s) &&
+      va + len >= va && va + len <= shmaddr(s) + s->npages * PGSIZE;
+  release(&shmtable.lock);
+  return r;
+}
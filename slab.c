@@ -0,0 +1,268 @@
+// Slab allocator for fixed-size kernel objects.
+//
+// Each kmem_cache hands out objects of a single size. Objects are
+// carved out of whole pages obtained from kalloc(); every page (a slab)
+// starts with a small header that keeps the slab's free object list,
+// so the slab an object belongs to is found by rounding the object's
+// address down to a page boundary.
+//
+// On top of the slabs each cache keeps a small per-CPU array of free
+// objects. Allocation and free are served from the current CPU's
+// array with interrupts off and no lock taken; only when the array
+// runs empty or full is the cache lock acquired to move a batch of
+// objects from or to the slabs. Empty slabs beyond one spare are
+// handed back to kalloc(), so the number of objects of a type is
+// bounded by memory rather than by a compile-time table size.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+
+#define NKMEMCACHE   16  // maximum number of object caches
+#define CPUCACHESIZE 8   // free objects kept per CPU
+#define CPUCACHEHALF (CPUCACHESIZE / 2)
+
+struct freeobj {
+  struct freeobj *next;
+};
+
+struct slab {
+  struct kmem_cache *cache;
+  struct slab *next;       // partial, full or empty list of the cache
+  struct slab *prev;
+  struct freeobj *free;    // free objects in this slab
+  uint inuse;              // allocated objects, including per-CPU ones
+};
+
+struct cpucache {
+  uint avail;
+  void *obj[CPUCACHESIZE];
+};
+
+struct kmem_cache {
+  char *name;
+  uint size;               // object size, rounded up to a word
+  uint perslab;            // objects per slab
+  struct spinlock lock;    // protects the slab lists and counters
+  struct slab *partial;    // slabs with some free objects
+  struct slab *full;       // slabs with no free objects
+  struct slab *empty;      // at most one slab with no objects in use
+  uint nslabs;             // slabs currently owned by the cache
+  uint nactive;            // objects handed out to callers
+  struct cpucache cpu[NCPU];
+};
+
+static struct {
+  struct spinlock lock;
+  int ncache;
+  struct kmem_cache cache[NKMEMCACHE];
+} kmemcaches;
+
+void
+slabinit(void)
+{
+  initlock(&kmemcaches.lock, "kmemcaches");
+}
+
+// Create a cache of objects of the given size.
+// Caches live for the lifetime of the kernel.
+struct kmem_cache*
+kmem_cache_create(char *name, uint size)
+{
+  struct kmem_cache *c;
+
+  if(size < sizeof(struct freeobj))
+    size = sizeof(struct freeobj);
+  size = (size + sizeof(uint) - 1) & ~(sizeof(uint) - 1);
+  if(size > PGSIZE - sizeof(struct slab))
+    panic("kmem_cache_create: object too large");
+
+  acquire(&kmemcaches.lock);
+  if(kmemcaches.ncache == NKMEMCACHE)
+    panic("kmem_cache_create: out of caches");
+  c = &kmemcaches.cache[kmemcaches.ncache++];
+  release(&kmemcaches.lock);
+
+  memset(c, 0, sizeof(*c));
+  c->name = name;
+  c->size = size;
+  c->perslab = (PGSIZE - sizeof(struct slab)) / size;
+  initlock(&c->lock, name);
+  return c;
+}
+
+static void
+slab_unlink(struct slab **list, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    *list = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+  s->next = s->prev = 0;
+}
+
+static void
+slab_push(struct slab **list, struct slab *s)
+{
+  s->prev = 0;
+  s->next = *list;
+  if(*list)
+    (*list)->prev = s;
+  *list = s;
+}
+
+// Allocate a new slab and carve it into free objects.
+// Caller must hold c->lock.
+static struct slab*
+slab_grow(struct kmem_cache *c)
+{
+  struct slab *s;
+  char *obj;
+  uint i;
+
+  if((s = (struct slab*)kalloc()) == 0)
+    return 0;
+  s->cache = c;
+  s->inuse = 0;
+  s->free = 0;
+  obj = (char*)(s + 1);
+  for(i = 0; i < c->perslab; i++, obj += c->size){
+    ((struct freeobj*)obj)->next = s->free;
+    s->free = (struct freeobj*)obj;
+  }
+  c->nslabs++;
+  slab_push(&c->partial, s);
+  return s;
+}
+
+// Take one object out of the slabs. Caller must hold c->lock.
+static void*
+slab_alloc(struct kmem_cache *c)
+{
+  struct slab *s;
+  struct freeobj *obj;
+
+  if((s = c->partial) == 0){
+    if((s = c->empty) != 0){
+      c->empty = 0;
+      slab_push(&c->partial, s);
+    } else if((s = slab_grow(c)) == 0)
+      return 0;
+  }
+  obj = s->free;
+  s->free = obj->next;
+  s->inuse++;
+  if(s->free == 0){
+    slab_unlink(&c->partial, s);
+    slab_push(&c->full, s);
+  }
+  return obj;
+}
+
+// Return one object to its slab. Caller must hold c->lock.
+static void
+slab_free(struct kmem_cache *c, void *v)
+{
+  struct slab *s;
+  struct freeobj *obj;
+
+  s = (struct slab*)PGROUNDDOWN((uint)v);
+  if(s->cache != c)
+    panic("kmem_cache_free: wrong cache");
+
+  obj = (struct freeobj*)v;
+  if(s->free == 0){
+    slab_unlink(&c->full, s);
+    slab_push(&c->partial, s);
+  }
+  obj->next = s->free;
+  s->free = obj;
+  if(--s->inuse > 0)
+    return;
+
+  // Keep one empty slab around to absorb alloc/free bursts,
+  // give the rest back to the page allocator.
+  slab_unlink(&c->partial, s);
+  if(c->empty == 0){
+    c->empty = s;
+    return;
+  }
+  c->nslabs--;
+  kfree((char*)s);
+}
+
+// Allocate an object from the cache.
+// Returns 0 if memory cannot be allocated.
+void*
+kmem_cache_alloc(struct kmem_cache *c)
+{
+  struct cpucache *cc;
+  void *obj;
+
+  pushcli();
+  cc = &c->cpu[cpuid()];
+  if(cc->avail == 0){
+    // Refill half of this CPU's array from the slabs.
+    acquire(&c->lock);
+    while(cc->avail < CPUCACHEHALF){
+      if((obj = slab_alloc(c)) == 0)
+        break;
+      cc->obj[cc->avail++] = obj;
+    }
+    release(&c->lock);
+    if(cc->avail == 0){
+      popcli();
+      return 0;
+    }
+  }
+  obj = cc->obj[--cc->avail];
+  __sync_fetch_and_add(&c->nactive, 1);
+  popcli();
+  return obj;
+}
+
+// Return an object to the cache it was allocated from.
+void
+kmem_cache_free(struct kmem_cache *c, void *obj)
+{
+  struct cpucache *cc;
+
+  // Fill with junk to catch dangling refs.
+  memset(obj, 1, c->size);
+
+  pushcli();
+  cc = &c->cpu[cpuid()];
+  if(cc->avail == CPUCACHESIZE){
+    // Flush half of this CPU's array back to the slabs.
+    acquire(&c->lock);
+    while(cc->avail > CPUCACHEHALF)
+      slab_free(c, cc->obj[--cc->avail]);
+    release(&c->lock);
+  }
+  cc->obj[cc->avail++] = obj;
+  __sync_fetch_and_sub(&c->nactive, 1);
+  popcli();
+}
+
+// Print the state of every cache to the console.
+void
+kmem_cache_dump(void)
+{
+  struct kmem_cache *c;
+  int i;
+
+  acquire(&kmemcaches.lock);
+  for(i = 0; i < kmemcaches.ncache; i++){
+    c = &kmemcaches.cache[i];
+    acquire(&c->lock);
+    cprintf("%s: size %d perslab %d slabs %d active %d\n",
+            c->name, c->size, c->perslab, c->nslabs, c->nactive);
+    release(&c->lock);
+  }
+  release(&kmemcaches.lock);
+}
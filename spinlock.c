@@ -8,13 +8,118 @@
 #include "mmu.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "steady_clock.h"
+
+#if XV6_LOCKSTAT
+#define NLOCKCLASS   64  // maximum number of distinct lock names
+#define NLOCKSTATTOP 16  // locks printed by lockstat_dump()
+
+// Contention statistics, shared by all locks initialized with
+// the same name: every pipe lock is accounted as "pipe".
+// Counters are updated with atomic instructions since locks of
+// one class may be held on several CPUs at once.
+struct lockclass {
+  char *name;
+  uint nacquire;                // acquisitions
+  uint ncontended;              // acquisitions that had to spin
+  unsigned long long nspin;     // spin loop iterations
+  unsigned long long wait;      // cycles spent spinning
+  unsigned long long maxhold;   // longest time held, in cycles
+};
+
+// The class table is guarded by a bare xchg flag rather than a
+// spinlock: initlock() runs before mycpu() works.
+static struct {
+  uint locked;
+  int nclass;
+  struct lockclass class[NLOCKCLASS];
+} lockstat;
+
+static void
+lockstat_lock(uint *eflags)
+{
+  *eflags = readeflags();
+  cli();
+  while(xchg(&lockstat.locked, 1) != 0)
+    ;
+  __sync_synchronize();
+}
+
+static void
+lockstat_unlock(uint eflags)
+{
+  __sync_synchronize();
+  asm volatile("movl $0, %0" : "+m" (lockstat.locked) : );
+  if(eflags & FL_IF)
+    sti();
+}
+
+// Find or create the class for locks called name.
+// Returns 0 when the table is full; such locks are not profiled.
+static struct lockclass*
+lockclass_get(char *name)
+{
+  struct lockclass *c;
+  uint eflags;
+  int i;
+
+  lockstat_lock(&eflags);
+  for(i = 0; i < lockstat.nclass; i++){
+    c = &lockstat.class[i];
+    if(c->name == name || strncmp(c->name, name, 32) == 0)
+      goto out;
+  }
+  c = 0;
+  if(lockstat.nclass < NLOCKCLASS){
+    c = &lockstat.class[lockstat.nclass++];
+    c->name = name;
+  }
+out:
+  lockstat_unlock(eflags);
+  return c;
+}
+
+static void
+lockstat_acquired(struct spinlock *lk, uint spins, unsigned long long start)
+{
+  struct lockclass *c = lk->class;
+
+  lk->holdstart = steady_clock_cycles();
+  if(c == 0)
+    return;
+  __sync_fetch_and_add(&c->nacquire, 1);
+  if(spins == 0)
+    return;
+  __sync_fetch_and_add(&c->ncontended, 1);
+  __sync_fetch_and_add(&c->nspin, spins);
+  __sync_fetch_and_add(&c->wait, lk->holdstart - start);
+}
+
+static void
+lockstat_released(struct spinlock *lk)
+{
+  struct lockclass *c = lk->class;
+  unsigned long long hold, max;
+
+  if(c == 0)
+    return;
+  hold = steady_clock_cycles() - lk->holdstart;
+  while((max = c->maxhold) < hold)
+    if(__sync_bool_compare_and_swap(&c->maxhold, max, hold))
+      break;
+}
+#endif
 
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
-  lk->locked = 0;
+  lk->next = 0;
+  lk->owner = 0;
   lk->cpu = 0;
+#if XV6_LOCKSTAT
+  lk->class = lockclass_get(name);
+#endif
 }
 
 // Acquire the lock.
@@ -24,13 +129,28 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  uint ticket;
+
   pushcli(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
-  // The xchg is atomic.
-  while(xchg(&lk->locked, 1) != 0)
-    ;
+  // Take a ticket and wait for our turn. The xadd is atomic;
+  // while waiting only owner is read, so the spinning CPUs
+  // share its cache line instead of bouncing it with writes.
+  ticket = xadd(&lk->next, 1);
+#if XV6_LOCKSTAT
+  unsigned long long start = steady_clock_cycles();
+  uint spins = 0;
+
+  while(*(volatile uint*)&lk->owner != ticket){
+    pause();
+    spins++;
+  }
+#else
+  while(*(volatile uint*)&lk->owner != ticket)
+    pause();
+#endif
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -40,6 +160,9 @@ acquire(struct spinlock *lk)
   // Record info about lock acquisition for debugging.
   lk->cpu = mycpu();
   getcallerpcs(&lk, lk->pcs);
+#if XV6_LOCKSTAT
+  lockstat_acquired(lk, spins, start);
+#endif
 }
 
 // Release the lock.
@@ -49,6 +172,9 @@ release(struct spinlock *lk)
   if(!holding(lk))
     panic("release");
 
+#if XV6_LOCKSTAT
+  lockstat_released(lk);
+#endif
   lk->pcs[0] = 0;
   lk->cpu = 0;
 
@@ -59,10 +185,10 @@ release(struct spinlock *lk)
   // stores; __sync_synchronize() tells them both not to.
   __sync_synchronize();
 
-  // Release the lock, equivalent to lk->locked = 0.
-  // This code can't use a C assignment, since it might
-  // not be atomic. A real OS would use C atomics here.
-  asm volatile("movl $0, %0" : "+m" (lk->locked) : );
+  // Hand the lock to the next ticket, equivalent to lk->owner++.
+  // Only the holder writes owner, so the increment needs no lock
+  // prefix, but it must be a single store that waiters can see.
+  asm volatile("incl %0" : "+m" (lk->owner) : );
 
   popcli();
 }
@@ -89,9 +215,85 @@ getcallerpcs(void *v, uint pcs[])
 int
 holding(struct spinlock *lock)
 {
-  return lock->locked && lock->cpu == mycpu();
+  return lock->owner != lock->next && lock->cpu == mycpu();
+}
+
+// Print the most contended lock classes, by cycles spent
+// spinning, to the console. If reset is set, clear the counters
+// afterwards. Returns -1 if the kernel was built without
+// lockstat=true.
+int
+lockstat_dump(int reset)
+{
+#if XV6_LOCKSTAT
+  struct lockclass *c, *top;
+  char printed[NLOCKCLASS];
+  int i, n, nclass;
+
+  nclass = lockstat.nclass;
+  memset(printed, 0, sizeof(printed));
+  cprintf("lock: acquired contended spins wait(us) maxhold(us)\n");
+  for(n = 0; n < NLOCKSTATTOP; n++){
+    top = 0;
+    for(i = 0; i < nclass; i++){
+      c = &lockstat.class[i];
+      if(printed[i] || c->nacquire == 0)
+        continue;
+      if(top == 0 || c->wait > top->wait)
+        top = c;
+    }
+    if(top == 0)
+      break;
+    printed[top - lockstat.class] = 1;
+    cprintf("%s: %d %d %d %d %d\n", top->name, top->nacquire,
+            top->ncontended, (uint)top->nspin,
+            (uint)steady_clock_cycles_to_us(top->wait),
+            (uint)steady_clock_cycles_to_us(top->maxhold));
+  }
+
+  // Counters may be updated concurrently; a reset only needs
+  // to be approximately right.
+  if(reset){
+    for(i = 0; i < nclass; i++){
+      c = &lockstat.class[i];
+      c->nacquire = c->ncontended = 0;
+      c->nspin = c->wait = c->maxhold = 0;
+    }
+  }
+  return 0;
+#else
+  return -1;
+#endif
 }
 
+// Lock torture test: acquire and release one shared lock for usec
+// microseconds and return how many times this process got it.
+// Running one process per CPU measures the lock's throughput (the
+// sum) and fairness (the spread between processes).
+static struct {
+  struct spinlock lock;
+  struct proc * volatile holder;
+} torture = { .lock = { .name = "torture" } };
+
+int
+locktorture(int usec)
+{
+  unsigned long long end;
+  int n;
+
+  n = 0;
+  end = steady_clock_now() + usec;
+  while(steady_clock_now() < end){
+    acquire(&torture.lock);
+    if(torture.holder != 0)
+      panic("locktorture");
+    torture.holder = myproc();
+    torture.holder = 0;
+    release(&torture.lock);
+    n++;
+  }
+  return n;
+}
 
 // Pushcli/popcli are like cli/sti except that they are matched:
 // it takes two popcli to undo two pushcli.  Also, if interrupts
@@ -2,14 +2,23 @@
 #define XV6_SPINLOCK_H
 
 // Mutual exclusion lock.
+// A ticket lock: the lock is free when owner == next, and
+// waiters are served in the order they arrived.
 struct spinlock {
-  uint locked;       // Is the lock held?
+  uint next;         // Next ticket to hand out.
+  uint owner;        // Ticket of the current holder.
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
   uint pcs[10];      // The call stack (an array of program counters)
                      // that locked the lock.
+
+#if XV6_LOCKSTAT
+  // For contention profiling (make lockstat=true):
+  struct lockclass *class;      // Statistics shared by locks of this name.
+  unsigned long long holdstart; // Cycle count when the lock was acquired.
+#endif
 };
 
 #endif
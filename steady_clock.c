@@ -1,9 +1,20 @@
 #include "steady_clock.h"
 
+static const unsigned long tsc_frequency_khz = XV6_TSC_FREQUENCY;
+
 unsigned long long steady_clock_now()
 {
-    static const unsigned long tsc_frequency_khz = XV6_TSC_FREQUENCY;
+    return steady_clock_cycles_to_us(steady_clock_cycles());
+}
+
+unsigned long long steady_clock_cycles()
+{
     unsigned long long cycles = 0;
-    asm("rdtsc" : "=A" (cycles));
+    asm volatile("rdtsc" : "=A" (cycles));
+    return cycles;
+}
+
+unsigned long long steady_clock_cycles_to_us(unsigned long long cycles)
+{
     return cycles * 1000 / tsc_frequency_khz;
 }
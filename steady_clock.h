@@ -6,4 +6,15 @@
  */
 unsigned long long steady_clock_now();
 
+/**
+ * Returns the raw time stamp counter, for measuring intervals
+ * too short for steady_clock_now().
+ */
+unsigned long long steady_clock_cycles();
+
+/**
+ * Converts a number of time stamp counter cycles to microseconds.
+ */
+unsigned long long steady_clock_cycles_to_us(unsigned long long cycles);
+
 #endif
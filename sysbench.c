@@ -0,0 +1,66 @@
+// System call round-trip benchmark.
+// Times a null system call (getpid) with the time stamp counter,
+// entering the kernel both through sysenter, as the usys.S stubs
+// do, and through the int $T_SYSCALL trap gate.
+//
+// usage: sysbench [iterations]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "syscall.h"
+#include "traps.h"
+
+static unsigned long long
+rdtsc(void)
+{
+  unsigned long long cycles;
+
+  asm volatile("rdtsc" : "=A" (cycles));
+  return cycles;
+}
+
+static int
+getpid_int(void)
+{
+  int pid;
+
+  asm volatile("int %1" : "=a" (pid) : "i" (T_SYSCALL), "a" (SYS_getpid) : "memory");
+  return pid;
+}
+
+int
+main(int argc, char **argv)
+{
+  int i, n = 100000;
+  unsigned long long start, end;
+
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(argc > 2 || n < 1){
+    printf(2, "usage: sysbench [iterations]\n");
+    exit(1);
+  }
+
+  if(getpid_int() != getpid()){
+    printf(2, "sysbench: int and sysenter disagree\n");
+    exit(1);
+  }
+
+  // 32 bits of cycles are plenty for the default iteration count,
+  // and user programs have no 64-bit division.
+  start = rdtsc();
+  for(i = 0; i < n; i++)
+    getpid();
+  end = rdtsc();
+  printf(1, "getpid (sysenter): %d calls, %d cycles per call\n",
+         n, (uint)(end - start) / n);
+
+  start = rdtsc();
+  for(i = 0; i < n; i++)
+    getpid_int();
+  end = rdtsc();
+  printf(1, "getpid (int): %d calls, %d cycles per call\n",
+         n, (uint)(end - start) / n);
+  exit(0);
+}
@@ -31,3 +31,15 @@
 #define SYS_getcpu 30
 #define SYS_getmem 31
 #define SYS_kmemtest 32
+#define SYS_waitpid 33
+#define SYS_lockstat 34
+#define SYS_locktorture 35
+#define SYS_clone 36
+#define SYS_join 37
+#define SYS_futex_wait 38
+#define SYS_futex_wake 39
+#define SYS_shmat 40
+#define SYS_shmdt 41
+#define SYS_mmap 42
+#define SYS_munmap 43
+#define SYS_cgpoll 44
@@ -27,7 +27,7 @@ argfd(int n, int *pfd, struct file **pf)
 
   if(argint(n, &fd) < 0)
     return -1;
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+  if((f = fdget(fd)) == 0)
     return -1;
   if(pfd)
     *pfd = fd;
@@ -36,21 +36,76 @@ argfd(int n, int *pfd, struct file **pf)
   return 0;
 }
 
-// Allocate a file descriptor for the given file.
+// Return the open file of the current process with descriptor fd,
+// or 0 if there is none. While the file table is shared, another
+// thread may close fd at any time, so the file is held until the
+// system call returns (see fdput()). A system call gets one file.
+struct file*
+fdget(int fd)
+{
+  struct proc *curproc = myproc();
+  struct files *fs = curproc->files;
+  struct file *f;
+
+  if(fd < 0 || fd >= NOFILE)
+    return 0;
+  // Only the current process could share the table from here on.
+  if(fs->ref == 1)
+    return fs->ofile[fd];
+  acquire(&fs->lock);
+  if((f = fs->ofile[fd]) != 0)
+    curproc->fdheld = filedup(f);
+  release(&fs->lock);
+  return f;
+}
+
+// Release the file held by fdget(), if any. Called by syscall().
+void
+fdput(void)
+{
+  struct proc *curproc = myproc();
+
+  if(curproc->fdheld){
+    fileclose(curproc->fdheld);
+    curproc->fdheld = 0;
+  }
+}
+
+// Allocate the lowest free file descriptor for the given file.
 // Takes over file reference from caller on success.
-static int
+int
 fdalloc(struct file *f)
 {
   int fd;
-  struct proc *curproc = myproc();
+  struct files *fs = myproc()->files;
 
-  for(fd = 0; fd < NOFILE; fd++){
-    if(curproc->ofile[fd] == 0){
-      curproc->ofile[fd] = f;
-      return fd;
-    }
+  acquire(&fs->lock);
+  fd = __builtin_ctz(~fs->fdmap);
+  if(fd < NOFILE){
+    fs->ofile[fd] = f;
+    fs->fdmap |= 1 << fd;
   }
-  return -1;
+  release(&fs->lock);
+  return fd < NOFILE ? fd : -1;
+}
+
+// Release file descriptor fd of the current process and return its
+// file, or 0 if fd is not open. The caller gets the file reference.
+struct file*
+fdfree(int fd)
+{
+  struct files *fs = myproc()->files;
+  struct file *f;
+
+  if(fd < 0 || fd >= NOFILE)
+    return 0;
+  acquire(&fs->lock);
+  if((f = fs->ofile[fd]) != 0){
+    fs->ofile[fd] = 0;
+    fs->fdmap &= ~(1 << fd);
+  }
+  release(&fs->lock);
+  return f;
 }
 
 int
@@ -110,9 +165,10 @@ sys_close(void)
   int fd;
   struct file *f;
 
-  if(argfd(0, &fd, &f) < 0)
+  // Taken out of the table at once, in case another thread closes
+  // fd as well.
+  if(argint(0, &fd) < 0 || (f = fdfree(fd)) == 0)
     return -1;
-  myproc()->ofile[fd] = 0;
   if(f->type == FD_CG)
       cg_close(f);
   else
@@ -446,10 +502,11 @@ int
 sys_chdir(void)
 {
   char *path;
-  struct inode *ip;
-  struct proc *curproc = myproc();
-  struct mount *mnt;
+  struct inode *ip, *oldip;
+  struct files *fs = myproc()->files;
+  struct mount *mnt, *oldmnt;
   struct cgroup *cgp;
+  char cwdp[MAX_PATH_LENGTH];
 
   begin_op();
   if(argstr(0, &path) < 0){
@@ -458,7 +515,9 @@ sys_chdir(void)
   }
   if((cgp = get_cgroup_by_path(path))){
     end_op();
-    safestrcpy(curproc->cwdp, cgp->cgroup_dir_path, sizeof(cgp->cgroup_dir_path));
+    acquire(&fs->lock);
+    safestrcpy(fs->cwdp, cgp->cgroup_dir_path, sizeof(cgp->cgroup_dir_path));
+    release(&fs->lock);
     return 0;
   }
   if((ip = nameimount(path, &mnt)) == 0){
@@ -472,14 +531,19 @@ sys_chdir(void)
     return -1;
   }
   iunlock(ip);
-  if(curproc->cwd)
-    iput(curproc->cwd);
-  if(curproc->cwdmount)
-    mntput(curproc->cwdmount);
+  format_path(cwdp, path);
+  acquire(&fs->lock);
+  oldip = fs->cwd;
+  oldmnt = fs->cwdmount;
+  fs->cwd = ip;
+  fs->cwdmount = mnt;
+  safestrcpy(fs->cwdp, cwdp, sizeof(fs->cwdp));
+  release(&fs->lock);
+  if(oldip)
+    iput(oldip);
+  if(oldmnt)
+    mntput(oldmnt);
   end_op();
-  curproc->cwdmount = mnt;
-  curproc->cwd = ip;
-  format_path(curproc->cwdp, path);
   return 0;
 }
 
@@ -523,7 +587,7 @@ sys_pipe(void)
   fd0 = -1;
   if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
     if(fd0 >= 0)
-      myproc()->ofile[fd0] = 0;
+      fdfree(fd0);
     fileclose(rf);
     fileclose(wf);
     return -1;
@@ -532,3 +596,43 @@ sys_pipe(void)
   fd[1] = fd1;
   return 0;
 }
+
+int
+sys_mmap(void)
+{
+  struct file *f;
+  int addr, len, prot, flags, off;
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0 || argint(2, &prot) < 0 ||
+     argint(3, &flags) < 0 || argfd(4, 0, &f) < 0 || argint(5, &off) < 0)
+    return -1;
+  // The kernel picks the address.
+  if(addr != 0 || off < 0)
+    return -1;
+  return mmap(len, prot, flags, f, off);
+}
+
+int
+sys_munmap(void)
+{
+  int addr, len;
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0)
+    return -1;
+  return munmap(addr, len);
+}
+
+// Wait for the cgroup events file fd to change, or for timeout ticks
+// unless timeout is -1. Other negative timeouts are rejected.
+int
+sys_cgpoll(void)
+{
+  struct file *f;
+  int timeout;
+
+  if(argfd(0, 0, &f) < 0 || argint(1, &timeout) < 0)
+    return -1;
+  if(f->type != FD_CG)
+    return -1;
+  return cg_poll(f, timeout);
+}
@@ -22,7 +22,7 @@ argfd(int n, int *pfd, struct file **pf)
 
   if(argint(n, &fd) < 0)
     return -1;
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+  if((f = fdget(fd)) == 0)
     return -1;
   if(pfd)
     *pfd = fd;
@@ -58,6 +58,86 @@ sys_wait(void)
   return wait(wstatus);
 }
 
+int
+sys_waitpid(void)
+{
+  int pid, options;
+  int* wstatus;
+
+  if (argint(0, &pid) < 0 ||
+      argptr(1, (void*)&wstatus, sizeof(*wstatus)) < 0 ||
+      argint(2, &options) < 0)
+    return -1;
+  return waitpid(pid, wstatus, options);
+}
+
+int
+sys_clone(void)
+{
+  int fn, arg1, arg2, stack;
+
+  if (argint(0, &fn) < 0 ||
+      argint(1, &arg1) < 0 ||
+      argint(2, &arg2) < 0 ||
+      argint(3, &stack) < 0)
+    return -1;
+  return clone((void(*)(void*, void*))fn, (void*)arg1, (void*)arg2, (void*)stack);
+}
+
+int
+sys_join(void)
+{
+  void **stack;
+
+  if (argptr(0, (void*)&stack, sizeof(*stack)) < 0)
+    return -1;
+  return join(stack);
+}
+
+int
+sys_futex_wait(void)
+{
+  uint *addr;
+  int val;
+
+  if (argptr(0, (void*)&addr, sizeof(*addr)) < 0 ||
+      argint(1, &val) < 0)
+    return -1;
+  return futex_wait(addr, val);
+}
+
+int
+sys_futex_wake(void)
+{
+  uint *addr;
+  int n;
+
+  if (argptr(0, (void*)&addr, sizeof(*addr)) < 0 ||
+      argint(1, &n) < 0)
+    return -1;
+  return futex_wake(addr, n);
+}
+
+int
+sys_shmat(void)
+{
+  int key, size;
+
+  if (argint(0, &key) < 0 || argint(1, &size) < 0)
+    return -1;
+  return shmat(key, size);
+}
+
+int
+sys_shmdt(void)
+{
+  int addr;
+
+  if (argint(0, &addr) < 0)
+    return -1;
+  return shmdt(addr);
+}
+
 int
 sys_kill(void)
 {
@@ -129,6 +209,42 @@ sys_usleep(void)
   return 0;
 }
 
+static int
+ioctl_process(int request)
+{
+  struct proc *p = myproc();
+  int result;
+
+  proc_lock();
+  switch (request) {
+  case IOCTL_GET_PROCESS_CPU_PERCENT:
+    result = p->cpu_percent;
+    break;
+  case IOCTL_GET_PROCESS_CPU_TIME:
+    result = p->cpu_time;
+    break;
+  case IOCTL_GET_PROCESS_RUN_DELAY:
+    result = p->sched_run_delay;
+    break;
+  case IOCTL_GET_PROCESS_MAX_WAIT:
+    result = p->sched_max_wait;
+    break;
+  case IOCTL_GET_PROCESS_NVCSW:
+    result = p->sched_nvcsw;
+    break;
+  case IOCTL_GET_PROCESS_NIVCSW:
+    result = p->sched_nivcsw;
+    break;
+  case IOCTL_GET_PROCESS_MIGRATIONS:
+    result = p->sched_migrations;
+    break;
+  default:
+    result = -1;
+  }
+  proc_unlock();
+  return result;
+}
+
 int
 sys_ioctl(void)
 {
@@ -140,7 +256,14 @@ sys_ioctl(void)
   struct file *f;
   struct inode* ip;
 
-  if(argfd(0, &fd, &f) < 0 || argint(1, &request) < 0 || argint(2, &command) < 0)
+  if(argint(1, &request) < 0)
+    return -1;
+
+  // Requests about the calling process take no file.
+  if(request > IOCTL_CPU_START)
+    return ioctl_process(request);
+
+  if(argfd(0, &fd, &f) < 0 || argint(2, &command) < 0)
     return -1;
 
   if(!(command  & DEV_CONNECT) &&
@@ -159,33 +282,21 @@ sys_ioctl(void)
   ilock(ip);
 
   if( ip->type != T_DEV ){
-      iunlockput(ip);
+      iunlock(ip);
       return -1;
   }
 
   if(ip->major >= NDEV){
-     iunlockput(ip);
+     iunlock(ip);
      return -1;
   }
 
   if(ip->minor >= MAX_TTY){
-     iunlockput(ip);
+     iunlock(ip);
      return -1;
   }
 
-  int result;
   switch (request) {
-  case IOCTL_GET_PROCESS_CPU_PERCENT:
-    proc_lock();
-    result = myproc()->cpu_percent;
-    proc_unlock();
-    return result;
-  case IOCTL_GET_PROCESS_CPU_TIME:
-    proc_lock();
-    result = myproc()->cpu_time;
-    proc_unlock();
-    return result;
-
   case TTYSETS:
     if((command & DEV_DISCONNECT)){
       tty_disconnect(ip);
@@ -253,3 +364,23 @@ int
 sys_kmemtest(void) {
   return kmemtest();
 }
+
+int
+sys_lockstat(void)
+{
+  int reset;
+
+  if(argint(0, &reset) < 0)
+    return -1;
+  return lockstat_dump(reset);
+}
+
+int
+sys_locktorture(void)
+{
+  int usec;
+
+  if(argint(0, &usec) < 0 || usec < 0)
+    return -1;
+  return locktorture(usec);
+}
@@ -5,6 +5,8 @@
 #include "mmu.h"
 #include "proc.h"
 #include "cgroup.h"
+#include "cpu_account.h"
+#include "psi.h"
 #include "x86.h"
 #include "traps.h"
 #include "spinlock.h"
@@ -12,6 +14,7 @@
 // Interrupt descriptor table (shared by all CPUs).
 struct gatedesc idt[256];
 extern uint vectors[];  // in vectors.S: array of 256 entry pointers
+extern void sysenter_entry(void);  // in trapasm.S
 struct spinlock tickslock;
 uint ticks;
 
@@ -33,10 +36,25 @@ idtinit(void)
   lidt(idt, sizeof(idt));
 }
 
+// Set up this cpu for the sysenter system call path. sysenter loads
+// CS and SS from MSR_SYSENTER_CS and the following GDT slot, and
+// sysexit the user segments after those, which matches the order
+// of SEG_KCODE, SEG_KDATA, SEG_UCODE and SEG_UDATA. The kernel stack
+// is per process, so switchuvm() sets MSR_SYSENTER_ESP.
+void
+sysenterinit(void)
+{
+  wrmsr(MSR_SYSENTER_CS, SEG_KCODE << 3);
+  wrmsr(MSR_SYSENTER_EIP, (uint)sysenter_entry);
+}
+
 //PAGEBREAK: 41
 void
 trap(struct trapframe *tf)
 {
+  if(myproc() && (tf->cs&3) == DPL_USER)
+    cpu_account_trap_enter(myproc());
+
   if(tf->trapno == T_SYSCALL){
     if(myproc()->killed)
       exit(0);
@@ -44,6 +62,7 @@ trap(struct trapframe *tf)
     syscall();
     if(myproc()->killed)
       exit(0);
+    cpu_account_trap_exit(myproc());
     return;
   }
 
@@ -54,6 +73,8 @@ trap(struct trapframe *tf)
       ticks++;
       wakeup(&ticks);
       release(&tickslock);
+      psi_tick();
+      cgroup_events_tick();
     }
     lapiceoi();
     break;
@@ -72,6 +93,11 @@ trap(struct trapframe *tf)
     uartintr();
     lapiceoi();
     break;
+  case T_TLBFLUSH:
+    lcr3(rcr3());
+    mycpu()->tlbflushes++;
+    lapiceoi();
+    break;
   case T_IRQ0 + 7:
   case T_IRQ0 + IRQ_SPURIOUS:
     cprintf("cpu%d: spurious interrupt at %x:%x\n",
@@ -79,6 +105,15 @@ trap(struct trapframe *tf)
     lapiceoi();
     break;
 
+  case T_PGFLT:
+    // A fault in a mapped file may sleep reading the page in.
+    if(myproc() != 0 && (tf->cs&3) == DPL_USER){
+      uint va = rcr2();
+      sti();
+      if(mmapfault(va, tf->err) == 0)
+        break;
+    }
+    // fall through
   //PAGEBREAK: 13
   default:
     if(myproc() == 0 || (tf->cs&3) == 0){
@@ -112,4 +147,7 @@ trap(struct trapframe *tf)
   // Check if the process has been killed since we yielded
   if(myproc() && myproc()->killed && (tf->cs&3) == DPL_USER)
     exit(0);
+
+  if(myproc() && (tf->cs&3) == DPL_USER)
+    cpu_account_trap_exit(myproc());
 }
@@ -21,8 +21,11 @@ typedef union header Header;
 static Header base;
 static Header *freep;
 
-void
-free(void *ap)
+// Threads share the free list.
+static struct thread_spinlock lock;
+
+static void
+free_locked(void *ap)
 {
   Header *bp, *p;
 
@@ -43,6 +46,15 @@ free(void *ap)
   freep = p;
 }
 
+void
+free(void *ap)
+{
+  thread_spin_lock(&lock);
+  free_locked(ap);
+  thread_spin_unlock(&lock);
+}
+
+// Called with lock held.
 static Header*
 morecore(uint nu)
 {
@@ -56,7 +68,7 @@ morecore(uint nu)
     return 0;
   hp = (Header*)p;
   hp->s.size = nu;
-  free((void*)(hp + 1));
+  free_locked((void*)(hp + 1));
   return freep;
 }
 
@@ -67,6 +79,7 @@ malloc(uint nbytes)
   uint nunits;
 
   nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
+  thread_spin_lock(&lock);
   if((prevp = freep) == 0){
     base.s.ptr = freep = prevp = &base;
     base.s.size = 0;
@@ -81,10 +94,13 @@ malloc(uint nbytes)
         p->s.size = nunits;
       }
       freep = prevp;
+      thread_spin_unlock(&lock);
       return (void*)(p + 1);
     }
     if(p == freep)
-      if((p = morecore(nunits)) == 0)
+      if((p = morecore(nunits)) == 0){
+        thread_spin_unlock(&lock);
         return 0;
+      }
   }
 }
@@ -37,6 +37,18 @@ int getppid(void);
 int getcpu(void);
 int getmem(void);
 int kmemtest(void);
+int waitpid(int pid, int* wstatus, int options);
+int lockstat(int reset);
+int locktorture(int usec);
+int clone(void (*fn)(void*, void*), void *arg1, void *arg2, void *stack);
+int join(void **stack);
+int futex_wait(uint *addr, uint val);
+int futex_wake(uint *addr, int n);
+void* shmat(int key, uint size);
+int shmdt(void *addr);
+void* mmap(void *addr, uint len, int prot, int flags, int fd, int off);
+int munmap(void *addr, uint len);
+int cgpoll(int fd, int timeout);
 
 int mount(const char*, const char*, const char *);
 int umount(const char*);
@@ -69,5 +81,31 @@ int is_attached_tty(int tty_fd);
 int disconnect_tty(int tty_fd);
 int is_connected_tty(int tty_fd);
 
+// uthread.c
+struct thread_spinlock {
+  volatile uint locked;
+};
+
+struct thread_mutex {
+  volatile uint state;
+};
+
+struct thread_cond {
+  volatile uint seq;
+};
+
+int thread_create(void (*fn)(void*), void *arg);
+int thread_join(void);
+void thread_spin_init(struct thread_spinlock*);
+void thread_spin_lock(struct thread_spinlock*);
+void thread_spin_unlock(struct thread_spinlock*);
+void thread_mutex_init(struct thread_mutex*);
+void thread_mutex_lock(struct thread_mutex*);
+void thread_mutex_unlock(struct thread_mutex*);
+void thread_cond_init(struct thread_cond*);
+void thread_cond_wait(struct thread_cond*, struct thread_mutex*);
+void thread_cond_signal(struct thread_cond*);
+void thread_cond_broadcast(struct thread_cond*);
+
 
 #endif
@@ -1398,6 +1398,12 @@ forktest(void)
     exit(0);
   }
 
+  // the process table is not limited to 64 entries.
+  if(n < 100){
+    printf(1, "fork failed after %d processes\n", n);
+    exit(1);
+  }
+
   for(; n > 0; n--){
     if(wait(0) < 0){
       printf(1, "wait stopped early\n");
@@ -1853,6 +1859,625 @@ exitrctest()
   }
 }
 
+// file descriptors are handed out lowest-first, and the
+// system-wide file table is not limited to 100 entries.
+void
+fdtest(void)
+{
+  int fds[NOFILE];
+  int i, n, pid, pfd[2];
+  char c;
+
+  printf(stdout, "fd test\n");
+
+  n = 0;
+  while(n < NOFILE && (fds[n] = open("README", 0)) >= 0)
+    n++;
+  if(n == NOFILE){
+    printf(stdout, "fd test: opened more than NOFILE files\n");
+    exit(1);
+  }
+  close(fds[1]);
+  if((i = open("README", 0)) != fds[1]){
+    printf(stdout, "fd test: got fd %d instead of %d\n", i, fds[1]);
+    exit(1);
+  }
+  for(i = 0; i < n; i++)
+    close(fds[i]);
+
+  // 10 children with 15 files each need more than 100 file structures.
+  if(pipe(pfd) < 0){
+    printf(stdout, "fd test: pipe failed\n");
+    exit(1);
+  }
+  for(i = 0; i < 10; i++){
+    pid = fork();
+    if(pid < 0){
+      printf(stdout, "fd test: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      close(pfd[0]);
+      for(n = 0; n < 15; n++)
+        if(open("README", 0) < 0)
+          break;
+      c = n == 15 ? 'y' : 'n';
+      write(pfd[1], &c, 1);
+      // hold the files until every child reported
+      sleep(100);
+      exit(0);
+    }
+  }
+  close(pfd[1]);
+  for(i = 0; i < 10; i++){
+    if(read(pfd[0], &c, 1) != 1 || c != 'y'){
+      printf(stdout, "fd test: child could not open its files\n");
+      exit(1);
+    }
+  }
+  close(pfd[0]);
+  for(i = 0; i < 10; i++)
+    wait(0);
+
+  printf(stdout, "fd test ok\n");
+}
+
+// waitpid() reaps only the requested child, and WNOHANG
+// does not block while the child is still running.
+void
+waitpidtest(void)
+{
+  int slow, fast, wstatus;
+
+  printf(stdout, "waitpid test\n");
+
+  slow = fork();
+  if(slow == 0){
+    sleep(20);
+    exit(2);
+  }
+  fast = fork();
+  if(fast == 0)
+    exit(1);
+  if(slow < 0 || fast < 0){
+    printf(stdout, "waitpid test: fork failed\n");
+    exit(1);
+  }
+
+  if(waitpid(slow, 0, WNOHANG) != 0){
+    printf(stdout, "waitpid test: WNOHANG did not return 0\n");
+    exit(1);
+  }
+  if(waitpid(slow, &wstatus, 0) != slow || WEXITSTATUS(wstatus) != 2){
+    printf(stdout, "waitpid test: wrong child or status\n");
+    exit(1);
+  }
+  if(waitpid(slow, 0, 0) != -1){
+    printf(stdout, "waitpid test: reaped the same child twice\n");
+    exit(1);
+  }
+  if(waitpid(getpid(), 0, WNOHANG) != -1){
+    printf(stdout, "waitpid test: waited for a non-child\n");
+    exit(1);
+  }
+  if(waitpid(-1, &wstatus, 0) != fast || WEXITSTATUS(wstatus) != 1){
+    printf(stdout, "waitpid test: wrong child or status\n");
+    exit(1);
+  }
+  if(waitpid(-1, 0, WNOHANG) != -1){
+    printf(stdout, "waitpid test: found a child that does not exist\n");
+    exit(1);
+  }
+
+  printf(stdout, "waitpid test ok\n");
+}
+
+#define NTHREAD 4
+#define THREADITERS 1000
+
+static struct thread_spinlock threadlock;
+static int threadcounter;
+
+static void
+threadworker(void *arg)
+{
+  int i;
+  char *p;
+
+  for(i = 0; i < THREADITERS; i++){
+    thread_spin_lock(&threadlock);
+    threadcounter++;
+    thread_spin_unlock(&threadlock);
+
+    // malloc() must be safe to call from several threads.
+    if((p = malloc(32)) == 0){
+      printf(stdout, "thread test: malloc failed\n");
+      exit(1);
+    }
+    *p = (int)arg;
+    free(p);
+  }
+}
+
+// Threads share memory, so the counter sees every increment.
+void
+threadtest(void)
+{
+  int i, pid;
+
+  printf(stdout, "thread test\n");
+
+  thread_spin_init(&threadlock);
+  threadcounter = 0;
+  for(i = 0; i < NTHREAD; i++){
+    if(thread_create(threadworker, (void*)i) < 0){
+      printf(stdout, "thread test: thread_create failed\n");
+      exit(1);
+    }
+  }
+
+  // Threads are collected by join, not by wait.
+  pid = fork();
+  if(pid == 0)
+    exit(0);
+  if(wait(0) != pid){
+    printf(stdout, "thread test: wait returned a thread\n");
+    exit(1);
+  }
+
+  for(i = 0; i < NTHREAD; i++){
+    if(thread_join() < 0){
+      printf(stdout, "thread test: thread_join failed\n");
+      exit(1);
+    }
+  }
+  if(thread_join() != -1){
+    printf(stdout, "thread test: joined a thread that does not exist\n");
+    exit(1);
+  }
+  if(threadcounter != NTHREAD * THREADITERS){
+    printf(stdout, "thread test: counter %d, expected %d\n",
+           threadcounter, NTHREAD * THREADITERS);
+    exit(1);
+  }
+
+  printf(stdout, "thread test ok\n");
+}
+
+static volatile int shrinkdone;
+
+static void
+shrinkworker(void *arg)
+{
+  while(!shrinkdone)
+    ;
+}
+
+// Freeing memory shared with threads running on other cpus flushes
+// their TLBs before the pages are reused.
+void
+threadshrinktest(void)
+{
+  int i, pid;
+  char *p, *shm;
+
+  printf(stdout, "thread shrink test\n");
+
+  shrinkdone = 0;
+  for(i = 0; i < NTHREAD; i++){
+    if(thread_create(shrinkworker, 0) < 0){
+      printf(stdout, "thread shrink test: thread_create failed\n");
+      exit(1);
+    }
+  }
+
+  for(i = 0; i < 100; i++){
+    if((p = sbrk(4*4096)) == (char*)-1){
+      printf(stdout, "thread shrink test: sbrk failed\n");
+      exit(1);
+    }
+    p[0] = p[4*4096-1] = i;
+    if(sbrk(-4*4096) == (char*)-1){
+      printf(stdout, "thread shrink test: sbrk shrink failed\n");
+      exit(1);
+    }
+    if((shm = shmat(42, 4096)) == (char*)-1){
+      printf(stdout, "thread shrink test: shmat failed\n");
+      exit(1);
+    }
+    shm[0] = i;
+    if(shmdt(shm) < 0){
+      printf(stdout, "thread shrink test: shmdt failed\n");
+      exit(1);
+    }
+  }
+
+  // Forking copies the address space while no thread resizes it.
+  pid = fork();
+  if(pid == 0)
+    exit(0);
+  if(wait(0) != pid){
+    printf(stdout, "thread shrink test: wait failed\n");
+    exit(1);
+  }
+
+  shrinkdone = 1;
+  for(i = 0; i < NTHREAD; i++){
+    if(thread_join() < 0){
+      printf(stdout, "thread shrink test: thread_join failed\n");
+      exit(1);
+    }
+  }
+
+  printf(stdout, "thread shrink test ok\n");
+}
+
+static void
+sleepworker(void *arg)
+{
+  for(;;)
+    sleep(1);
+}
+
+// Killing a process, or exec'ing in it, kills its threads too.
+// They hold the write end of a pipe until they are gone.
+void
+threadkilltest(void)
+{
+  static char *args[] = { "echo", "thread kill test failed", 0 };
+  int fds[2], i, pid;
+  char c;
+
+  printf(stdout, "thread kill test\n");
+
+  for(i = 0; i < 2; i++){
+    if(pipe(fds) != 0){
+      printf(stdout, "thread kill test: pipe failed\n");
+      exit(1);
+    }
+    pid = fork();
+    if(pid < 0){
+      printf(stdout, "thread kill test: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      close(fds[0]);
+      if(thread_create(sleepworker, 0) < 0){
+        printf(stdout, "thread kill test: thread_create failed\n");
+        exit(1);
+      }
+      if(i == 1){
+        close(1);
+        exec("echo", args);
+        exit(1);
+      }
+      for(;;)
+        sleep(1);
+    }
+    close(fds[1]);
+    if(i == 0)
+      kill(pid);
+    if(wait(0) != pid){
+      printf(stdout, "thread kill test: wait failed\n");
+      exit(1);
+    }
+    if(read(fds[0], &c, 1) != 0){
+      printf(stdout, "thread kill test: thread still running\n");
+      exit(1);
+    }
+    close(fds[0]);
+  }
+
+  printf(stdout, "thread kill test ok\n");
+}
+
+static int threadfd;
+
+static void
+fileworker(void *arg)
+{
+  switch((int)arg){
+  case 0:
+    threadfd = open("threadfile", O_CREATE|O_RDWR);
+    break;
+  case 1:
+    close(threadfd);
+    break;
+  case 2:
+    chdir("threaddir");
+    break;
+  }
+}
+
+static void
+runfileworker(int op)
+{
+  if(thread_create(fileworker, (void*)op) < 0 || thread_join() < 0){
+    printf(stdout, "thread files test: thread failed\n");
+    exit(1);
+  }
+}
+
+// Threads share their open files and current directory.
+void
+threadfilestest(void)
+{
+  int fd;
+
+  printf(stdout, "thread files test\n");
+
+  runfileworker(0);
+  if(threadfd < 0 || write(threadfd, "x", 1) != 1){
+    printf(stdout, "thread files test: file opened by a thread not shared\n");
+    exit(1);
+  }
+  runfileworker(1);
+  if(write(threadfd, "x", 1) != -1){
+    printf(stdout, "thread files test: file closed by a thread still open\n");
+    exit(1);
+  }
+  unlink("threadfile");
+
+  if(mkdir("threaddir") != 0){
+    printf(stdout, "thread files test: mkdir failed\n");
+    exit(1);
+  }
+  runfileworker(2);
+  if((fd = open("threadfile", O_CREATE|O_RDWR)) < 0){
+    printf(stdout, "thread files test: create failed\n");
+    exit(1);
+  }
+  close(fd);
+  if(chdir("..") != 0 || (fd = open("threaddir/threadfile", 0)) < 0){
+    printf(stdout, "thread files test: directory changed by a thread not shared\n");
+    exit(1);
+  }
+  close(fd);
+  unlink("threaddir/threadfile");
+  unlink("threaddir");
+
+  printf(stdout, "thread files test ok\n");
+}
+
+static struct thread_mutex futexlock;
+static struct thread_cond futexcond;
+static int futexready;
+
+static void
+futexworker(void *arg)
+{
+  int i;
+
+  thread_mutex_lock(&futexlock);
+  while(!futexready)
+    thread_cond_wait(&futexcond, &futexlock);
+  thread_mutex_unlock(&futexlock);
+
+  for(i = 0; i < THREADITERS; i++){
+    thread_mutex_lock(&futexlock);
+    threadcounter++;
+    thread_mutex_unlock(&futexlock);
+  }
+}
+
+// Futex-based mutex and condition variable between threads.
+void
+futextest(void)
+{
+  uint word;
+  int i;
+
+  printf(stdout, "futex test\n");
+
+  // A stale value or a bad address returns at once.
+  word = 1;
+  if(futex_wait(&word, 0) != -1 || futex_wait((uint*)0xffffff00, 0) != -1){
+    printf(stdout, "futex test: futex_wait did not fail\n");
+    exit(1);
+  }
+  if(futex_wake(&word, 1) != 0){
+    printf(stdout, "futex test: woke a waiter that does not exist\n");
+    exit(1);
+  }
+
+  thread_mutex_init(&futexlock);
+  thread_cond_init(&futexcond);
+  futexready = 0;
+  threadcounter = 0;
+  for(i = 0; i < NTHREAD; i++){
+    if(thread_create(futexworker, 0) < 0){
+      printf(stdout, "futex test: thread_create failed\n");
+      exit(1);
+    }
+  }
+  sleep(1);
+  thread_mutex_lock(&futexlock);
+  futexready = 1;
+  thread_cond_broadcast(&futexcond);
+  thread_mutex_unlock(&futexlock);
+
+  for(i = 0; i < NTHREAD; i++){
+    if(thread_join() < 0){
+      printf(stdout, "futex test: thread_join failed\n");
+      exit(1);
+    }
+  }
+  if(threadcounter != NTHREAD * THREADITERS){
+    printf(stdout, "futex test: counter %d, expected %d\n",
+           threadcounter, NTHREAD * THREADITERS);
+    exit(1);
+  }
+
+  printf(stdout, "futex test ok\n");
+}
+
+#define SHMKEY 0x5348
+
+// Shared memory is seen by a forked child and by a process that
+// attaches it by key, and is gone once the last user detaches.
+void
+shmtest(void)
+{
+  int *a, *b;
+  int pid, fds[2];
+  char buf[4];
+
+  printf(stdout, "shm test\n");
+
+  if((a = shmat(SHMKEY, 2*4096)) == (void*)-1){
+    printf(stdout, "shm test: shmat failed\n");
+    exit(1);
+  }
+  if(a[0] != 0 || a[2*1024 - 1] != 0){
+    printf(stdout, "shm test: segment not zeroed\n");
+    exit(1);
+  }
+  if(shmat(SHMKEY, 4096) != (void*)-1){
+    printf(stdout, "shm test: attached a segment twice\n");
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "shm test: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    // The child inherits the mapping, and gets it back by key.
+    a[0] = 1;
+    if(shmdt(a) < 0 || (b = shmat(SHMKEY, 4096)) != a){
+      printf(stdout, "shm test: reattach failed\n");
+      exit(1);
+    }
+    b[1] = 2;
+    exit(0);
+  }
+  wait(0);
+  if(a[0] != 1 || a[1] != 2){
+    printf(stdout, "shm test: child writes not seen\n");
+    exit(1);
+  }
+
+  // System calls accept buffers in a segment.
+  memmove(a, "shm", 4);
+  if(pipe(fds) != 0 || write(fds[1], a, 4) != 4 ||
+     read(fds[0], buf, 4) != 4 || strcmp(buf, "shm") != 0){
+    printf(stdout, "shm test: pipe through segment failed\n");
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+
+  if(shmdt(a) < 0 || shmdt(a) != -1){
+    printf(stdout, "shm test: shmdt failed\n");
+    exit(1);
+  }
+  // The last detach freed the segment, so this makes a new one.
+  if((a = shmat(SHMKEY, 4*4096)) == (void*)-1 || a[0] != 0){
+    printf(stdout, "shm test: segment not freed\n");
+    exit(1);
+  }
+  shmdt(a);
+
+  printf(stdout, "shm test ok\n");
+}
+
+#define MMAPSIZE 6000
+
+// Mapped file pages read the file, private writes stay private and
+// shared writes reach the file and other mappings.
+void
+mmaptest(void)
+{
+  char *p, *q, buf[16];
+  int fd, i, pid;
+
+  printf(stdout, "mmap test\n");
+
+  fd = open("mmapfile", O_CREATE|O_RDWR);
+  for(i = 0; i < MMAPSIZE; i++){
+    buf[0] = 'a' + i % 26;
+    if(write(fd, buf, 1) != 1){
+      printf(stdout, "mmap test: write failed\n");
+      exit(1);
+    }
+  }
+  close(fd);
+
+  fd = open("mmapfile", O_RDONLY);
+  if(mmap(0, MMAPSIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0) != (void*)-1){
+    printf(stdout, "mmap test: shared writable mapping of read-only file\n");
+    exit(1);
+  }
+  p = mmap(0, MMAPSIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(p == (void*)-1){
+    printf(stdout, "mmap test: mmap failed\n");
+    exit(1);
+  }
+  for(i = 0; i < MMAPSIZE; i++){
+    if(p[i] != 'a' + i % 26){
+      printf(stdout, "mmap test: wrong byte at %d\n", i);
+      exit(1);
+    }
+  }
+  // Past the end of the file, the last page reads as zeros.
+  if(p[2*4096 - 1] != 0){
+    printf(stdout, "mmap test: bytes past end of file\n");
+    exit(1);
+  }
+  p[0] = 'X';
+  if(munmap(p, 4096) != -1 || munmap(p, MMAPSIZE) != 0){
+    printf(stdout, "mmap test: munmap failed\n");
+    exit(1);
+  }
+
+  fd = open("mmapfile", O_RDWR);
+  p = mmap(0, MMAPSIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  q = mmap(0, 4096, PROT_READ, MAP_SHARED, fd, 4096);
+  if(p == (void*)-1 || q == (void*)-1 || q == p){
+    printf(stdout, "mmap test: mmap failed\n");
+    exit(1);
+  }
+  if(p[0] != 'a'){
+    printf(stdout, "mmap test: private write reached the file\n");
+    exit(1);
+  }
+  p[4096] = 'Y';
+  if(q[0] != 'Y'){
+    printf(stdout, "mmap test: mappings don't share the page\n");
+    exit(1);
+  }
+  pid = fork();
+  if(pid == 0){
+    p[1] = 'Z';
+    exit(0);
+  }
+  wait(0);
+  if(p[1] != 'Z'){
+    printf(stdout, "mmap test: child write not seen\n");
+    exit(1);
+  }
+  // Writes to the file show through the mapping.
+  if(write(fd, "W", 1) != 1 || p[0] != 'W'){
+    printf(stdout, "mmap test: file write not seen\n");
+    exit(1);
+  }
+  munmap(q, 4096);
+  munmap(p, MMAPSIZE);
+  close(fd);
+
+  fd = open("mmapfile", O_RDONLY);
+  if(read(fd, buf, 2) != 2 || buf[0] != 'W' || buf[1] != 'Z'){
+    printf(stdout, "mmap test: shared writes not written back\n");
+    exit(1);
+  }
+  close(fd);
+  unlink("mmapfile");
+
+  printf(stdout, "mmap test ok\n");
+}
+
 void
 memtest()
 {
@@ -1914,6 +2539,15 @@ main(int argc, char *argv[])
   iref();
   forktest();
   bigdir(); // slow
+  fdtest();
+  waitpidtest();
+  threadtest();
+  threadshrinktest();
+  threadkilltest();
+  threadfilestest();
+  futextest();
+  shmtest();
+  mmaptest();
   memtest();
 
   uio();
@@ -0,0 +1,142 @@
+// User-level threads on top of the clone() and join() system calls,
+// and spin locks to protect the memory they share.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define THREAD_STACK_SIZE 4096  // clone() takes a one page stack
+
+// First function of every thread: run fn and exit with the thread.
+static void
+thread_start(void *fn, void *arg)
+{
+  ((void (*)(void*))fn)(arg);
+  exit(0);
+}
+
+// Start fn(arg) in a new thread sharing this process's memory.
+// Returns the thread's pid, or -1.
+int
+thread_create(void (*fn)(void*), void *arg)
+{
+  void *stack;
+  int pid;
+
+  if((stack = malloc(THREAD_STACK_SIZE)) == 0)
+    return -1;
+  if((pid = clone(thread_start, (void*)fn, arg, stack)) < 0)
+    free(stack);
+  return pid;
+}
+
+// Wait for one of this process's threads to exit and free its stack.
+// Returns its pid, or -1 if there are no threads.
+int
+thread_join(void)
+{
+  void *stack;
+  int pid;
+
+  if((pid = join(&stack)) >= 0)
+    free(stack);
+  return pid;
+}
+
+void
+thread_spin_init(struct thread_spinlock *lk)
+{
+  lk->locked = 0;
+}
+
+void
+thread_spin_lock(struct thread_spinlock *lk)
+{
+  uint old;
+
+  for(;;){
+    old = 1;
+    asm volatile("lock; xchgl %0, %1" : "+r" (old), "+m" (lk->locked) : : "memory");
+    if(old == 0)
+      return;
+    while(lk->locked)
+      asm volatile("pause" : : : "memory");
+  }
+}
+
+void
+thread_spin_unlock(struct thread_spinlock *lk)
+{
+  asm volatile("movl $0, %0" : "+m" (lk->locked) : : "memory");
+}
+
+// Mutexes that sleep in the kernel only when contended.
+// state is 0 when free, 1 when locked and 2 when locked with
+// (possible) waiters, so an uncontended lock and unlock never
+// enter the kernel.
+
+void
+thread_mutex_init(struct thread_mutex *m)
+{
+  m->state = 0;
+}
+
+void
+thread_mutex_lock(struct thread_mutex *m)
+{
+  uint c;
+
+  if((c = __sync_val_compare_and_swap(&m->state, 0, 1)) == 0)
+    return;
+  if(c != 2)
+    c = __sync_lock_test_and_set(&m->state, 2);
+  while(c != 0){
+    futex_wait((uint*)&m->state, 2);
+    c = __sync_lock_test_and_set(&m->state, 2);
+  }
+}
+
+void
+thread_mutex_unlock(struct thread_mutex *m)
+{
+  if(__sync_fetch_and_sub(&m->state, 1) != 1){
+    m->state = 0;
+    __sync_synchronize();
+    futex_wake((uint*)&m->state, 1);
+  }
+}
+
+// Condition variables: waiters sleep on a sequence number that
+// every signal bumps, so a signal between unlocking the mutex
+// and sleeping isn't lost.
+
+void
+thread_cond_init(struct thread_cond *cv)
+{
+  cv->seq = 0;
+}
+
+void
+thread_cond_wait(struct thread_cond *cv, struct thread_mutex *m)
+{
+  uint seq;
+
+  seq = cv->seq;
+  thread_mutex_unlock(m);
+  futex_wait((uint*)&cv->seq, seq);
+  thread_mutex_lock(m);
+}
+
+void
+thread_cond_signal(struct thread_cond *cv)
+{
+  __sync_fetch_and_add(&cv->seq, 1);
+  futex_wake((uint*)&cv->seq, 1);
+}
+
+void
+thread_cond_broadcast(struct thread_cond *cv)
+{
+  __sync_fetch_and_add(&cv->seq, 1);
+  futex_wake((uint*)&cv->seq, 0x7fffffff);
+}
@@ -17,23 +17,38 @@ void
 seginit(void)
 {
   struct cpu *c;
+  int apicid;
+
+  // mycpu() needs %gs, which is set up here, so find this
+  // cpu by its APIC ID.
+  apicid = lapicid();
+  for(c = cpus; c < &cpus[ncpu] && c->apicid != apicid; c++)
+    ;
+  if(c == &cpus[ncpu])
+    panic("seginit: unknown apicid");
 
   // Map "logical" addresses to virtual addresses using identity map.
   // Cannot share a CODE descriptor for both kernel and user
   // because it would have to have DPL_USR, but the CPU forbids
   // an interrupt from CPL=0 to DPL=3.
-  c = &cpus[cpuid()];
   c->gdt[SEG_KCODE] = SEG(STA_X|STA_R, 0, 0xffffffff, 0);
   c->gdt[SEG_KDATA] = SEG(STA_W, 0, 0xffffffff, 0);
   c->gdt[SEG_UCODE] = SEG(STA_X|STA_R, 0, 0xffffffff, DPL_USER);
   c->gdt[SEG_UDATA] = SEG(STA_W, 0, 0xffffffff, DPL_USER);
+
+  // Map per-cpu data at %gs.
+  c->gdt[SEG_KCPU] = SEG(STA_W, &c->self, 8, 0);
   lgdt(c->gdt, sizeof(c->gdt));
+  loadgs(SEG_KCPU << 3);
+
+  c->self = c;
+  c->proc = 0;
 }
 
 // Return the address of the PTE in page table pgdir
 // that corresponds to virtual address va.  If alloc!=0,
 // create any required page table pages.
-static pte_t *
+pte_t *
 walkpgdir(pde_t *pgdir, const void *va, int alloc)
 {
   pde_t *pde;
@@ -170,6 +185,7 @@ switchuvm(struct proc *p)
   mycpu()->gdt[SEG_TSS].s = 0;
   mycpu()->ts.ss0 = SEG_KDATA << 3;
   mycpu()->ts.esp0 = (uint)p->kstack + KSTACKSIZE;
+  wrmsr(MSR_SYSENTER_ESP, (uint)p->kstack + KSTACKSIZE);
   // setting IOPL=0 in eflags *and* iomb beyond the tss segment limit
   // forbids I/O instructions (e.g., inb and outb) from user space
   mycpu()->ts.iomb = (ushort) 0xFFFF;
@@ -226,7 +242,7 @@ allocuvm(pde_t* pgdir, uint oldsz, uint newsz, struct cgroup* cgroup)
     uint a;
     int set_cnt = 0;
     int pg_cnt = 0;
-    if (newsz >= KERNBASE)
+    if (newsz > MMAPBASE)
         return 0;
     if (newsz < oldsz)
         return oldsz;
@@ -277,7 +293,8 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
     pte = walkpgdir(pgdir, (char*)a, 0);
     if(!pte)
       a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
-    else if((*pte & PTE_P) != 0){
+    else if(PTE_ADDR(*pte) != 0){
+      // Present, or unmapped by unmapuvm() and not yet freed.
       pa = PTE_ADDR(*pte);
       if(pa == 0)
         panic("kfree");
@@ -289,6 +306,24 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
   return newsz;
 }
 
+// Make the user pages from oldsz down to newsz not present, but keep
+// their addresses in the page table, so that deallocuvm() frees them
+// once no cpu caches the old mappings.
+void
+unmapuvm(pde_t *pgdir, uint oldsz, uint newsz)
+{
+  pte_t *pte;
+  uint a;
+
+  for(a = PGROUNDUP(newsz); a < oldsz; a += PGSIZE){
+    pte = walkpgdir(pgdir, (char*)a, 0);
+    if(!pte)
+      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+    else
+      *pte &= ~PTE_P;
+  }
+}
+
 int
 dec_protect_mem(struct cgroup* cgroup)
 {
@@ -307,8 +342,49 @@ void inc_protect_mem(struct cgroup* cgroup, int n) {
     cgroup->protected_mem += n;
 }
 
+// Map the n shared pages at va in pgdir. The pages are not owned
+// by pgdir and must be unmapped with unmapshared() before it is
+// freed. Returns 0, or -1 with nothing mapped.
+int
+mapshared(pde_t *pgdir, uint va, char **pages, uint n)
+{
+  uint i;
+
+  for(i = 0; i < n; i++){
+    if(mappages(pgdir, (char*)va + i*PGSIZE, PGSIZE, V2P(pages[i]),
+                PTE_W|PTE_U) < 0){
+      unmapshared(pgdir, va, i);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Clear the mappings of n shared pages at va without freeing them.
+void
+unmapshared(pde_t *pgdir, uint va, uint n)
+{
+  pte_t *pte;
+  uint i;
+
+  for(i = 0; i < n; i++)
+    if((pte = walkpgdir(pgdir, (char*)va + i*PGSIZE, 0)) != 0)
+      *pte = 0;
+}
+
+// Is a page mapped at va in pgdir?
+int
+ismapped(pde_t *pgdir, uint va)
+{
+  pte_t *pte;
+
+  pte = walkpgdir(pgdir, (char*)va, 0);
+  return pte != 0 && (*pte & PTE_P) != 0;
+}
+
 // Free a page table and all the physical memory pages
-// in the user part.
+// in the user part. Mapped files and shared memory are
+// detached first, since their pages are not ours to free.
 void
 freevm(pde_t *pgdir)
 {
@@ -316,6 +392,8 @@ freevm(pde_t *pgdir)
 
   if(pgdir == 0)
     panic("freevm: no pgdir");
+  shmdetachall(pgdir);
+  munmapall(pgdir);
   deallocuvm(pgdir, KERNBASE, 0);
   for(i = 0; i < NPDENTRIES; i++){
     if(pgdir[i] & PTE_P){
@@ -364,6 +442,10 @@ copyuvm(pde_t *pgdir, uint sz)
     if(mappages(d, (void*)i, PGSIZE, V2P(mem), flags) < 0)
       goto bad;
   }
+  if(shmcopy(pgdir, d) < 0)
+    goto bad;
+  if(mmapcopy(pgdir, d) < 0)
+    goto bad;
   return d;
 
 bad:
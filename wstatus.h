@@ -22,3 +22,8 @@
 
 #define	W_EXITCODE(ret, sig)	((ret) << 8 | (sig))
 #define	W_STOPCODE(sig)		((sig) << 8 | _WSTOPPED)
+
+/*
+ * Option bits for waitpid.
+ */
+#define	WNOHANG		1	/* don't block if no child has exited */
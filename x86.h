@@ -130,6 +130,36 @@ xchg(volatile uint *addr, uint newval)
   return result;
 }
 
+// Atomically add incr to *addr and return the old value.
+static inline uint
+xadd(volatile uint *addr, uint incr)
+{
+  asm volatile("lock; xaddl %0, %1" :
+               "+r" (incr), "+m" (*addr) :
+               :
+               "cc");
+  return incr;
+}
+
+// Spin-wait loop hint: saves power and avoids the memory order
+// violation penalty when the loop exits.
+static inline void
+pause(void)
+{
+  asm volatile("pause");
+}
+
+// Model-specific registers used by sysenter.
+#define MSR_SYSENTER_CS  0x174  // kernel code selector
+#define MSR_SYSENTER_ESP 0x175  // kernel stack pointer
+#define MSR_SYSENTER_EIP 0x176  // kernel entry point
+
+static inline void
+wrmsr(uint msr, uint val)
+{
+  asm volatile("wrmsr" : : "c" (msr), "a" (val), "d" (0));
+}
+
 static inline uint
 rcr2(void)
 {
@@ -144,6 +174,14 @@ lcr3(uint val)
   asm volatile("movl %0,%%cr3" : : "r" (val));
 }
 
+static inline uint
+rcr3(void)
+{
+  uint val;
+  asm volatile("movl %%cr3,%0" : "=r" (val));
+  return val;
+}
+
 //PAGEBREAK: 36
 // Layout of the trap frame built on the stack by the
 // hardware and by trapasm.S, and passed to trap().